@@ -35,17 +35,69 @@
 -- =========================================================================
 -- Debug Flags
 -- =========================================================================
+-- F turns the debug logging on, see set_debug(). Each debug call must stay
+-- on a line of its own starting with "GP=F and debug(": src/lua/build.lua
+-- blanks those lines out of the production variant of the module.
 local GP;
-local F = true;
+local F = false;
 
 -- =========================================================================
 -- Config Variables
 -- =========================================================================
+-- Expbins are stored as the list [EXP_TAG, expiry, data]. EXP_TAG is a
+-- negative fixint so the marker costs a single byte. Bins written by older
+-- versions of the module are maps {EXP_ID = expiry, EXP_DATA = data}; they
+-- are still read and get rewritten as lists the next time they are written.
+local EXP_TAG = -25;
 local EXP_ID = "expbin_ttl";
 local EXP_DATA = "data";
 local CITRUSLEAF_EPOCH = 1262304000
+-- Element bins give each element of a bin its own expiry. They are stored
+-- as the list [EXP_ELEM_TAG, entries], where entries is a list of
+-- [expiry, key, val] sorted by expiry, with the elements that never expire
+-- (expiry 0) last. Expired elements are thus always a prefix of entries,
+-- found by binary search. Dropping them, the key lookup of put_elem and its
+-- insert still copy or visit the other entries, and every write rewrites
+-- the whole bin, so writes are linear in its size. Element bins are not
+-- expbins, but they are counted in EXP_META with the expiry of their first
+-- element, get returns their live elements as a map, and clean drops their
+-- expired elements.
+local EXP_ELEM_TAG = -26;
+-- Record level expiry summary, stored as the list [earliest, count]: the
+-- earliest non-zero expiry of the record's expbins and elements (0 if none
+-- expire) and the number of expbins and element bins. Every write keeps
+-- count exact, but put/touch only ever lower earliest, so it may be earlier
+-- than the real first expiry until clean, clean_all, trim or get_repair
+-- recomputes it. Records written by get_repair() carry the time of that
+-- write as a third element.
+local EXP_META = "expbin_meta";
+-- Optional expiry bucket index, kept if DUE_BUCKET is above 0: the bin
+-- EXP_DUE holds the earliest expiry of the record rounded up to a multiple
+-- of DUE_BUCKET seconds, and is missing if none of its expbins expire. A
+-- secondary index on it lets clean_due visit only the records that are due.
+-- Bucketing keeps the index entry unchanged while earliest moves inside its
+-- bucket.
+local EXP_DUE = "expbin_due";
+local DUE_BUCKET = 0;
+-- What put, puts, touch and touch_bins do with a bin_ttl beyond the record
+-- TTL. Every writer of a record must use the same mode.
+-- (*) TTL_REJECT: the write is rejected.
+-- (*) TTL_EXTEND: the record TTL is raised to cover the bins written.
+-- (*) TTL_SHRINK: the record TTL is set to the latest expiry of its expbins,
+--     raising or lowering it, so the server expires the record once every
+--     bin has expired. Each write visits every bin of the record to find
+--     that expiry. Records that also hold normal bins are only extended.
+local TTL_REJECT = "reject";
+local TTL_EXTEND = "extend";
+local TTL_SHRINK = "shrink";
+local TTL_MODE = TTL_REJECT;
+-- Per-bin status codes returned by touch_bins()
+local TOUCH_UPDATED = 0;
+local TOUCH_INVALID_TTL = 1;
+local TOUCH_NOT_EXPBIN = 2;
 -- Type Checking Vars
 local Map = getmetatable(map());
+local List = getmetatable(list());
 
 -- ========================================================================= 
 -- Utility functions
@@ -58,23 +110,55 @@ end
 
 -- Check if bin is an expbin
 local function is_expbin(bin)
-	if (bin ~= nil 
-		and type(bin) == 'userdata' 
-		and getmetatable(bin) == Map 
-		and bin[EXP_ID] ~= nil) then
-		return true;
+	if (bin ~= nil and type(bin) == 'userdata') then
+		local mt = getmetatable(bin);
+		if (mt == List) then
+			return list.size(bin) == 3 and bin[1] == EXP_TAG;
+		elseif (mt == Map) then
+			return bin[EXP_ID] ~= nil;
+		end
 	end
 	return false;
 end
 
--- Check if bin_ttl is valid for a given rec_ttl
+-- Get the stored expiry of an expbin
+local function bin_expiry(bin)
+	if (getmetatable(bin) == List) then
+		return bin[2];
+	end
+	return bin[EXP_ID];
+end
+
+-- Get the stored data of an expbin
+local function bin_data(bin)
+	if (getmetatable(bin) == List) then
+		return bin[3];
+	end
+	return bin[EXP_DATA];
+end
+
+-- Build an expbin from an expiry and data
+local function new_expbin(expiry, data)
+	return list{EXP_TAG, expiry, data};
+end
+
+-- Get the expiry for a bin_ttl relative to now
+local function expiry_for(bin_ttl, now)
+	if (bin_ttl ~= -1) then
+		return bin_ttl + now;
+	end
+	return 0;
+end
+
+-- Check if bin_ttl is valid for a given rec_ttl. A record that never
+-- expires reports a TTL of 0, and takes any bin_ttl.
 local function valid_time(bin_ttl, rec_ttl)
 	local meth = "valid_time";
 	if (type(bin_ttl) ~= 'number' or (bin_ttl < 0 and bin_ttl ~= -1)) then
 		GP=F and debug("<%s> bin_ttl is invalid", meth);
 		return false;
 	end
-	if (bin_ttl > rec_ttl) then
+	if (rec_ttl > 0 and bin_ttl > rec_ttl) then
 		GP=F and debug("<%s> bin_ttl is invalid", meth);
 		return false;
 	end
@@ -91,34 +175,466 @@ local function not_expired(bin_ttl)
 	return false;
 end
 
--- Get the bin value from an expbin if it hasn't expired
-local function get_bin(bin_map)
+-- Check if bin is an element bin
+local function is_elembin(bin)
+	return getmetatable(bin) == List and list.size(bin) == 2 and bin[1] == EXP_ELEM_TAG;
+end
+
+-- Check whether expiry a sorts before expiry b in an element bin
+local function expires_before(a, b)
+	return a ~= 0 and (b == 0 or a < b);
+end
+
+-- Get the number of expired entries at the head of an element bin
+local function expired_count(entries, now)
+	local lo, hi = 0, list.size(entries);
+	while (lo < hi) do
+		local mid = math.floor((lo + hi) / 2);
+		local expiry = entries[mid + 1][1];
+		if (expiry ~= 0 and expiry < now) then
+			lo = mid + 1;
+		else
+			hi = mid;
+		end
+	end
+	return lo;
+end
+
+-- Get the earliest expiry of an element bin, 0 if none of its elements
+-- expire
+local function elem_expiry(bin)
+	local entries = bin[2];
+	if (list.size(entries) == 0) then
+		return 0;
+	end
+	return entries[1][1];
+end
+
+-- Get the live elements of an element bin as a map of key to value, nil if
+-- none is live
+local function live_elems(bin, now)
+	local entries = bin[2];
+	local first = expired_count(entries, now) + 1;
+	if (first > list.size(entries)) then
+		return nil;
+	end
+	local elems = map();
+	for i=first, list.size(entries) do
+		local entry = entries[i];
+		elems[entry[2]] = entry[3];
+	end
+	return elems;
+end
+
+-- Insert entry into entries, after the entries expiring at the same time
+local function insert_entry(entries, entry)
+	local expiry = entry[1];
+	local lo, hi = 0, list.size(entries);
+	while (lo < hi) do
+		local mid = math.floor((lo + hi) / 2);
+		if (expires_before(expiry, entries[mid + 1][1])) then
+			hi = mid;
+		else
+			lo = mid + 1;
+		end
+	end
+	if (lo == list.size(entries)) then
+		list.append(entries, entry);
+	else
+		list.insert(entries, lo + 1, entry);
+	end
+end
+
+-- Get the bin value from an expbin if it hasn't expired, or the live elements
+-- of an element bin. all_live skips the expiry check of expbins when the
+-- record is known to hold no expired bins.
+local function get_bin(bin_map, all_live)
 	local meth = "get_bin";
 	GP=F and debug("<%s> Bin: %s", meth, tostring(bin_map));
 	if (is_expbin(bin_map)) then
-		if (not_expired(bin_map[EXP_ID])) then
-			return bin_map[EXP_DATA];
+		if (all_live or not_expired(bin_expiry(bin_map))) then
+			return bin_data(bin_map);
 		else
 			GP=F and debug("<%s> Bin has expired, returning nil", meth);
 			return nil;
 		end
+	elseif (is_elembin(bin_map)) then
+		GP=F and debug("<%s> Bin is an element bin, returning its live elements", meth);
+		return live_elems(bin_map, get_time());
 	else
 		GP=F and debug("<%s> Bin is not an expbin", meth);
 		return bin_map;
 	end
 end
 
--- Update or create record
-local function push_rec(rec)
-	local meth = "push_rec";
-	GP=F and debug("<%s> Rec: %s", meth, tostring(rec));
-	if aerospike:exists(rec) then
+-- Earliest of two expiries, where 0 means no expiration
+local function min_expiry(a, b)
+	if (a == 0 or (b ~= 0 and b < a)) then
+		return b;
+	end
+	return a;
+end
+
+-- Longest of two bin_ttls, where -1 means no expiration and nil no bin_ttl
+local function max_bin_ttl(a, b)
+	if (a == nil or b == -1 or (a ~= -1 and b > a)) then
+		return b;
+	end
+	return a;
+end
+
+-- Compute the expiry summary by visiting every bin of the record
+local function scan_meta(rec)
+	local earliest = 0;
+	local count = 0;
+	local names = record.bin_names(rec);
+	for i=1, #names do
+		local bin = rec[names[i]];
+		if (is_expbin(bin)) then
+			count = count + 1;
+			earliest = min_expiry(earliest, bin_expiry(bin));
+		elseif (is_elembin(bin)) then
+			count = count + 1;
+			earliest = min_expiry(earliest, elem_expiry(bin));
+		end
+	end
+	return earliest, count;
+end
+
+-- Get the expiry summary of an existing record, computing it if the record
+-- was written before the summary was kept
+local function load_meta(rec)
+	local meta = rec[EXP_META];
+	if (getmetatable(meta) == List) then
+		return meta[1], meta[2];
+	end
+	return scan_meta(rec);
+end
+
+-- Store the expiry bucket in memory. Returns true if it changed.
+local function put_due(rec, earliest, count)
+	if (DUE_BUCKET <= 0) then
+		return false;
+	end
+	local due = nil;
+	if (count > 0 and earliest ~= 0) then
+		due = earliest + (DUE_BUCKET - earliest % DUE_BUCKET) % DUE_BUCKET;
+	end
+	if (rec[EXP_DUE] == due) then
+		return false;
+	end
+	rec[EXP_DUE] = due;
+	return true;
+end
+
+-- Store the expiry summary and bucket in memory, keeping the time of the
+-- last read repair unless a new one is given. Returns true if they changed.
+local function put_meta(rec, earliest, count, repaired)
+	local meta = rec[EXP_META];
+	local due_changed = put_due(rec, earliest, count);
+	if (getmetatable(meta) == List) then
+		if (repaired == nil and list.size(meta) >= 3) then
+			repaired = meta[3];
+		end
+		if (meta[1] == earliest and meta[2] == count and meta[3] == repaired) then
+			return due_changed;
+		end
+	end
+	if (count > 0 and repaired ~= nil) then
+		rec[EXP_META] = list{earliest, count, repaired};
+	elseif (count > 0) then
+		rec[EXP_META] = list{earliest, count};
+	elseif (meta ~= nil) then
+		rec[EXP_META] = nil;
+	else
+		return due_changed;
+	end
+	return true;
+end
+
+-- Check whether the record may hold expired expbins
+local function meta_due(rec)
+	local meta = rec[EXP_META];
+	if (getmetatable(meta) == List) then
+		return not not_expired(meta[1]);
+	end
+	return true;
+end
+
+-- Get the time of the last read repair write, 0 if there was none
+local function last_repair(rec)
+	local meta = rec[EXP_META];
+	if (getmetatable(meta) == List and list.size(meta) >= 3) then
+		return meta[3];
+	end
+	return 0;
+end
+
+-- Get the latest expiry of the expbins of rec, 0 if one never expires, or
+-- nil if rec has normal bins or no expbin. written names the bins set since
+-- rec was opened, which record.bin_names() may not list yet.
+local function latest_expiry(rec, written)
+	local latest = nil;
+	local forever = false;
+	local seen = {[EXP_META] = true, [EXP_DUE] = true};
+	local function visit(name)
+		if (seen[name]) then
+			return true;
+		end
+		seen[name] = true;
+		local bin = rec[name];
+		if (bin == nil) then
+			return true;
+		elseif (not is_expbin(bin)) then
+			return false;
+		end
+		local expiry = bin_expiry(bin);
+		if (expiry == 0) then
+			forever = true;
+		elseif (latest == nil or expiry > latest) then
+			latest = expiry;
+		end
+		return true;
+	end
+	local names = record.bin_names(rec);
+	for i=1, #names do
+		if (not visit(names[i])) then
+			return nil;
+		end
+	end
+	for name in pairs(written) do
+		if (not visit(name)) then
+			return nil;
+		end
+	end
+	if forever then
+		return 0;
+	end
+	return latest;
+end
+
+-- Set the record TTL in memory as TTL_MODE asks, after writing the bins
+-- named in written, whose longest bin_ttl is longest (-1 if one never
+-- expires, nil if none is an expbin). Returns true if it was set.
+local function fit_record_ttl(rec, longest, written)
+	local meth = "fit_record_ttl";
+	if (TTL_MODE == TTL_SHRINK) then
+		local latest = latest_expiry(rec, written);
+		if (latest ~= nil) then
+			-- A TTL of 0 would mean the namespace default
+			local ttl = (latest == 0) and -1 or math.max(latest - get_time(), 1);
+			GP=F and debug("<%s> Setting record TTL to %s", meth, tostring(ttl));
+			record.set_ttl(rec, ttl);
+			return true;
+		end
+	end
+	if (TTL_MODE == TTL_REJECT or longest == nil) then
+		return false;
+	end
+	-- A record that never expires reports a TTL of 0
+	local rec_ttl = record.ttl(rec);
+	if (rec_ttl > 0 and (longest == -1 or longest > rec_ttl)) then
+		GP=F and debug("<%s> Extending record TTL from %s to %s", meth, tostring(rec_ttl), tostring(longest));
+		record.set_ttl(rec, longest);
+		return true;
+	end
+	return false;
+end
+
+-- Get the live values of the bins named in arg from an existing record
+local function get_bins(rec, arg)
+	local return_map = map();
+	local all_live = not meta_due(rec);
+	-- Iterate through every bin request 
+	for i=1, arg.n do
+		local bin_map = rec[arg[i]];
+		local ret_bin = get_bin(bin_map, all_live);
+		if ret_bin ~= nil then
+			return_map[arg[i]] = ret_bin;
+		end
+	end
+	return return_map;
+end
+
+-- Create or update rec once the bins named in written are set in memory,
+-- fitting the record TTL to longest as in fit_record_ttl(). A new record is
+-- removed again if longest turns out to be beyond its TTL.
+-- Returns 1 if so, 0 otherwise.
+local function save_record(rec, exists, longest, written)
+	local meth = "save_record";
+	if exists then
 		GP=F and debug("<%s> Record exists, updating record", meth);
-		return aerospike:update(rec);
+		fit_record_ttl(rec, longest, written);
+		aerospike:update(rec);
 	else
 		GP=F and debug("<%s> Record doesn't exist, creating record", meth);
-		return aerospike:create(rec);
+		aerospike:create(rec);
+		if (TTL_MODE ~= TTL_REJECT) then
+			if (fit_record_ttl(rec, longest, written)) then
+				aerospike:update(rec);
+			end
+		elseif (longest ~= nil and not valid_time(longest, record.ttl(rec))) then
+			GP=F and debug("<%s> Record and Bin TTL conflict Bin %s, Rec %s", meth, tostring(longest), tostring(record.ttl(rec)));
+			aerospike:remove(rec);
+			return 1;
+		end
 	end
+	return 0;
+end
+
+-- Write a batch of ops ({bin, val, bin_ttl}) to rec with a single
+-- update/create. Every bin_ttl is validated before the record is modified,
+-- so a rejected batch leaves the record untouched.
+local function put_bins(rec, ops)
+	local meth = "put_bins";
+	GP=F and debug("<%s> Rec: %s", meth, tostring(rec));
+	local exists = aerospike:exists(rec);
+	-- New records only learn the default server ttl once created, and the
+	-- other modes adjust the record ttl instead of checking it
+	local rec_ttl = (exists and TTL_MODE == TTL_REJECT) and record.ttl(rec) or math.huge;
+	local now = get_time();
+	local pending = {};
+	-- Longest bin_ttl written, -1 if one never expires
+	local longest = nil;
+	-- Expiry summary, only loaded once an op writes an expbin
+	local earliest, count;
+	for i=1, ops.n do
+		local bin = ops[i].bin;
+		local val = ops[i].val;
+		local bin_ttl = ops[i].bin_ttl;
+		local cur = pending[bin];
+		if (cur ~= nil) then
+			cur = cur[1];
+		else
+			cur = rec[bin];
+		end
+		if (bin_ttl == nil and not is_expbin(cur) and not is_elembin(cur)) then
+			-- bin creation off, creating normal bin
+			pending[bin] = {val};
+		else
+			if (not valid_time(bin_ttl, rec_ttl)) then
+				GP=F and debug("<%s> Record and Bin TTL conflict Bin %s, Rec %s", meth, tostring(bin_ttl), tostring(rec_ttl));
+				return 1;
+			end
+			local expiry = expiry_for(bin_ttl, now);
+			pending[bin] = {new_expbin(expiry, val)};
+			if (count == nil) then
+				if exists then
+					earliest, count = load_meta(rec);
+				else
+					earliest, count = 0, 0;
+				end
+			end
+			if (not is_expbin(cur) and not is_elembin(cur)) then
+				count = count + 1;
+			end
+			earliest = min_expiry(earliest, expiry);
+			longest = max_bin_ttl(longest, bin_ttl);
+		end
+	end
+	for bin, val in pairs(pending) do
+		rec[bin] = val[1];
+	end
+	if (count ~= nil) then
+		put_meta(rec, earliest, count);
+	end
+	return save_record(rec, exists, longest, pending);
+end
+
+-- Apply the bin_ttl of each touch op to rec in memory. Returns a map of
+-- bin -> touch status, the number of bins changed and whether any bin_ttl
+-- was invalid. With all_or_none set, nothing is changed in that case.
+local function touch_ops(rec, ops, all_or_none)
+	local meth = "touch_ops";
+	local rec_ttl = (TTL_MODE == TTL_REJECT) and record.ttl(rec) or math.huge;
+	local status = map();
+	local invalid = false;
+	for i=1, ops.n do
+		local bin_name = ops[i].bin;
+		if (not valid_time(ops[i].bin_ttl, rec_ttl)) then
+			GP=F and debug("<%s> Record TTL is less than Bin TTL for Bin %s", meth, bin_name);
+			status[bin_name] = TOUCH_INVALID_TTL;
+			invalid = true;
+		elseif (not is_expbin(rec[bin_name])) then
+			GP=F and debug("<%s> Bin %s is not a valid expbin", meth, bin_name);
+			status[bin_name] = TOUCH_NOT_EXPBIN;
+		else
+			status[bin_name] = TOUCH_UPDATED;
+		end
+	end
+	if (invalid and all_or_none) then
+		return status, 0, invalid;
+	end
+	local now = get_time();
+	local changed = 0;
+	local earliest, count = load_meta(rec);
+	local touched = {};
+	local longest = nil;
+	for i=1, ops.n do
+		local bin_name = ops[i].bin;
+		if (status[bin_name] == TOUCH_UPDATED) then
+			local bin_ttl = ops[i].bin_ttl;
+			local data = bin_data(rec[bin_name]);
+			local expiry = expiry_for(bin_ttl, now);
+			rec[bin_name] = new_expbin(expiry, data);
+			earliest = min_expiry(earliest, expiry);
+			changed = changed + 1;
+			touched[bin_name] = true;
+			longest = max_bin_ttl(longest, bin_ttl);
+		end
+	end
+	if (changed > 0) then
+		put_meta(rec, earliest, count);
+		fit_record_ttl(rec, longest, touched);
+	end
+	return status, changed, invalid;
+end
+
+-- Set the expired expbins of rec to nil in memory and drop the expired
+-- elements of its element bins, limited to the bin names set in only if
+-- given. Returns the number of bins and elements removed along with the
+-- earliest expiry and count of the expbins and element bins left.
+local function drop_expired(rec, only)
+	local meth = "drop_expired";
+	local removed = 0;
+	local earliest = 0;
+	local count = 0;
+	local now = get_time();
+	local names = record.bin_names(rec);
+	for i=1, #names do
+		local bin = names[i];
+		local temp_bin = rec[bin];
+		if (is_expbin(temp_bin)) then
+			local expiry = bin_expiry(temp_bin);
+			if (not not_expired(expiry) and (only == nil or only[bin])) then
+				rec[bin] = nil;
+				removed = removed + 1;
+				GP=F and debug("<%s> Bin %s expired, erasing bin", meth, bin);
+			else
+				count = count + 1;
+				earliest = min_expiry(earliest, expiry);
+			end
+		elseif (is_elembin(temp_bin)) then
+			local entries = temp_bin[2];
+			local expired = 0;
+			if (only == nil or only[bin]) then
+				expired = expired_count(entries, now);
+			end
+			if (expired > 0 and expired == list.size(entries)) then
+				rec[bin] = nil;
+			else
+				if (expired > 0) then
+					temp_bin = list{EXP_ELEM_TAG, list.drop(entries, expired)};
+					rec[bin] = temp_bin;
+				end
+				count = count + 1;
+				earliest = min_expiry(earliest, elem_expiry(temp_bin));
+			end
+			removed = removed + expired;
+			GP=F and debug("<%s> Dropped %d elements of bin %s", meth, expired, bin);
+		end
+	end
+	return removed, earliest, count;
 end
 
 -- Count the number of parameters
@@ -126,6 +642,22 @@ function table.pack(...)
   return {n = select("#", ...), ...}
 end
 
+-- Bin ops are maps, or lists [bin, val, bin_ttl] (without val for touches)
+-- as sent by the C client's *_ops calls. Turn lists into op tables in place.
+local function op_args(args, with_val)
+	for i=1, args.n do
+		local op = args[i];
+		if (getmetatable(op) == List) then
+			if with_val then
+				args[i] = {bin = op[1], val = op[2], bin_ttl = op[3]};
+			else
+				args[i] = {bin = op[1], bin_ttl = op[2]};
+			end
+		end
+	end
+	return args;
+end
+
 -- =========================================================================
 -- get(): Get bin from record
 -- =========================================================================
@@ -136,6 +668,9 @@ end
 -- (*) rec: record to retrieve bin from
 -- (*) bin: variable number of bin names to retrieve from
 --
+-- Element bins are returned as a map of their live elements, as by
+-- get_elems(), and left out if none is live.
+--
 -- Return:
 -- 1 = error
 -- map containing each respective bin value = success
@@ -145,14 +680,52 @@ function get(rec, ...)
 	GP=F and debug("[ENTER]<%s>", meth);
 	local arg = table.pack(...)
 	if aerospike:exists(rec) then
-		local return_map = map();
-		-- Iterate through every bin request 
-		for i=1, arg.n do
-			local bin_map = rec[arg[i]];
-			local ret_bin = get_bin(bin_map);
-			if ret_bin ~= nil then
-				return_map[arg[i]] = ret_bin;
+		local return_map = get_bins(rec, arg);
+		GP=F and debug("[EXIT]<%s> Returning bin map: %s", meth, tostring(return_map));
+		return return_map;
+	else
+		GP=F and debug("[EXIT]<%s> Record does not exist", meth);
+	end
+	return 1
+end
+
+-- =========================================================================
+-- get_repair(): Get bin from record, removing expired bins on the way
+-- =========================================================================
+-- 
+-- USAGE: as.execute(policy, key, "expire_bin", "get_repair", repair_interval, bin);
+--
+-- Params:
+-- (*) rec: record to retrieve bin from
+-- (*) repair_interval: minimum number of seconds between two repairs of
+--     the record
+-- (*) bin: variable number of bin names to retrieve from
+--
+-- Same as get(), but if the record's expiry summary says a bin may have
+-- expired, every expired bin of the record is removed as in clean_all().
+-- A summary that is missing or older than the bins is also rewritten, so
+-- the record isn't rescanned by every call. The record is only written if
+-- a bin was removed or the summary changed, and at most once per
+-- repair_interval, so hot keys don't turn into hot writes. A record holding
+-- no expbin has no summary, and is rescanned by every call.
+--
+-- Return:
+-- 1 = error
+-- map containing each respective bin value = success
+-- =========================================================================
+function get_repair(rec, repair_interval, ...)
+	local meth = "get_repair";
+	GP=F and debug("[ENTER]<%s> Interval: %s", meth, tostring(repair_interval));
+	local arg = table.pack(...)
+	if aerospike:exists(rec) then
+		local return_map = get_bins(rec, arg);
+		local now = get_time();
+		if (meta_due(rec) and now - last_repair(rec) >= (repair_interval or 0)) then
+			local removed, earliest, count = drop_expired(rec, nil);
+			if (put_meta(rec, earliest, count, now) or removed > 0) then
+				aerospike:update(rec);
 			end
+			GP=F and debug("<%s> Repaired, removed %d bins", meth, removed);
 		end
 		GP=F and debug("[EXIT]<%s> Returning bin map: %s", meth, tostring(return_map));
 		return return_map;
@@ -181,57 +754,11 @@ end
 function put(rec, bin, val, bin_ttl)
 	local meth = "put";
 	GP=F and debug("[ENTER]<%s> Bin: %s Value: %s TTL: %s", meth, bin, tostring(val), tostring(bin_ttl));
-	local exp_create;
-	if (bin_ttl ~= nil) then
-		exp_create = true;
-	else
-		exp_create = false;
-	end
-
-	-- If bin creation is off, don't create any new exp bins
-	if (rec[bin] == nil and not exp_create) then
-		GP=F and debug("[EXIT]<%s> Bin doesn't exist and expire bin creation disabled", meth);
-		rec[bin] = val;
-		return push_rec(rec);
-	else
-		local map_bin = rec[tostring(bin)];
-		if (not is_expbin(map_bin)) then
-			if (exp_create) then
-				map_bin = map();
-			else
-				-- bin creation off, creating normal bin
-				rec[bin] = val;
-				GP=F and debug("[EXIT]<%s>", meth);
-				return push_rec(rec);
-			end
-		end
-		-- Create rec on server to get default server ttl
-		local temp_rec = false;
-		if not aerospike:exists(rec) then
-			aerospike:create(rec);
-			temp_rec = true;
-		end
-		if (not valid_time(bin_ttl, record.ttl(rec))) then
-			if (temp_rec) then
-				aerospike:remove(rec);
-			end
-			GP=F and debug("[EXIT]<%s> Record and Bin TTL conflict Bin %s, Rec %s", meth, tostring(bin_ttl), tostring(record.ttl(rec)));
-			return 1;
-		end	
-		if (bin_ttl ~= -1) then
-			map_bin[EXP_ID] = bin_ttl + get_time();
-		else
-			map_bin[EXP_ID] = 0;
-		end
-		map_bin[EXP_DATA] = val;
-		rec[bin] = map_bin;
-		push_rec(rec);
-		GP=F and debug("[EXIT]<%s>", meth);
-		return 0;
-	end
+	local rc = put_bins(rec, {n = 1, {bin = bin, val = val, bin_ttl = bin_ttl}});
+	GP=F and debug("[EXIT]<%s>", meth);
+	return rc;
 end
 
-local put = put;
 -- =========================================================================
 -- puts(): Store bin to record
 -- =========================================================================
@@ -244,6 +771,10 @@ local put = put;
 -- 	(*) bin: bin name 
 -- 	(*) val: Value to store in bin
 -- 	(*) bin_ttl: (optional) if provided, expire_bin will be created if none exists
+-- 	or lists [bin, val, bin_ttl]
+--
+-- All bins are validated first and written with a single record update, so
+-- if any bin is rejected none of them are stored.
 --
 -- Return:
 -- 1 = error
@@ -253,16 +784,9 @@ local put = put;
 function puts(rec, ...)
 	local meth = "puts";
 	GP=F and debug("[ENTER]<%s>", meth);
-	local arg = table.pack(...)
-	for i=1, arg.n do
-		local return_val = put(rec, arg[i].bin, arg[i].val, arg[i].bin_ttl);
-		if (return_val == 1) then
-			GP=F and debug("[EXIT]<%s>", meth);
-			return 1;
-		end
-    end
-    GP=F and debug("[EXIT]<%s>", meth);
-	return 0;
+	local rc = put_bins(rec, op_args(table.pack(...), true));
+	GP=F and debug("[EXIT]<%s>", meth);
+	return rc;
 end
 
 -- =========================================================================
@@ -276,6 +800,10 @@ end
 -- (*) bin_map: variable number of maps containing the following
 -- 	(*) bin: bin names 
 -- 	(*) bin_ttl: Bin TTL given in seconds or -1 to disable expiration
+-- 	or lists [bin, bin_ttl]
+--
+-- If any bin_ttl is rejected no bin is changed. All changes are written
+-- with a single record update.
 --
 -- Return:
 -- 0 = success
@@ -284,27 +812,14 @@ end
 function touch(rec, ...)
 	local meth = "touch";
 	GP=F and debug("[ENTER]<%s>", meth);
-	local arg = table.pack(...)
 	if aerospike:exists(rec) then
-		for i=1, arg.n do
-			local bin_name = arg[i].bin
-			if (not valid_time(arg[i].bin_ttl, record.ttl(rec))) then
-				GP=F and debug("<%s>[EXIT] Record TTL is less than Bin TTL for Bin %s", meth, bin_name);
-				return 1;
-			else
-				local rec_map = rec[bin_name];
-				if (is_expbin(rec_map)) then
-					if (arg[i].bin_ttl ~= -1) then
-						rec_map[EXP_ID] = arg[i].bin_ttl + get_time();
-					else
-						rec_map[EXP_ID] = 0;
-					end
-					rec[bin_name] = rec_map;
-					aerospike:update(rec);
-				else
-					GP=F and debug("<%s> Bin %s is not a valid expbin", meth, bin_name);
-				end
-			end	
+		local status, changed, invalid = touch_ops(rec, op_args(table.pack(...), false), true);
+		if (invalid) then
+			GP=F and debug("[EXIT]<%s> Record TTL is less than Bin TTL", meth);
+			return 1;
+		end
+		if (changed > 0) then
+			aerospike:update(rec);
 		end
 	else
 		GP=F and debug("[EXIT]<%s> Record doesn't exist", meth);
@@ -315,39 +830,122 @@ function touch(rec, ...)
 end
 
 -- =========================================================================
--- clean_bin(): Rewrite expired bins to nil
+-- touch_bins(): Modify the TTL of several bins and report each outcome
 -- =========================================================================
 --
+-- USAGE: as.execute(policy, key, "expire_bin", "touch_bins", bin_maps);
+--
+-- Params:
+-- (*) rec: record to retrieve bin from
+-- (*) bin_map: variable number of maps containing the following
+-- 	(*) bin: bin names 
+-- 	(*) bin_ttl: Bin TTL given in seconds or -1 to disable expiration
+-- 	or lists [bin, bin_ttl]
+--
+-- Unlike touch(), valid bins are updated even if others are rejected. All
+-- changes are written with a single record update.
+--
+-- Return:
+-- 1 = record doesn't exist
+-- map of bin name to status = success, where status is
+-- 	0 = updated
+-- 	1 = invalid bin TTL or Record TTL is less than Bin TTL
+-- 	2 = bin is not an expbin
+-- =========================================================================
+function touch_bins(rec, ...)
+	local meth = "touch_bins";
+	GP=F and debug("[ENTER]<%s>", meth);
+	if not aerospike:exists(rec) then
+		GP=F and debug("[EXIT]<%s> Record doesn't exist", meth);
+		return 1;
+	end
+	local status, changed = touch_ops(rec, op_args(table.pack(...), false), false);
+	if (changed > 0) then
+		aerospike:update(rec);
+	end
+	GP=F and debug("[EXIT]<%s> Returning status map: %s", meth, tostring(status));
+	return status;
+end
+
+-- =========================================================================
+-- clean(): Rewrite expired bins to nil
+-- =========================================================================
+--
+-- USAGE: as.execute(policy, statement, "expire_bin", "clean", bins);
+--
 -- Params:
 -- (*) rec: record to retrieve bin from
 -- (*) bin: variable number of bins to clean 
 --
+-- Records whose expiry summary shows nothing has expired are skipped
+-- without looking at their bins. Element bins among bins have their expired
+-- elements dropped, as by trim(). The record is only written if a bin or
+-- element was removed or its expiry summary changed.
+--
 -- Return:
--- 0 = success
--- 1 = error
+-- number of expired bins and elements removed = success
+-- nil = record doesn't exist
 -- =========================================================================
 function clean(rec, ...)
 	local meth = "clean";
 	GP=F and debug("[ENTER]<%s>", meth);
-	local arg = table.pack(...)
 	if aerospike:exists(rec) then
+		if (not meta_due(rec)) then
+			GP=F and debug("[EXIT]<%s> No expired bins", meth);
+			return 0;
+		end
+		local arg = table.pack(...);
+		local only = {};
 		for i=1, arg.n do
-			local bin = arg[i];
-			local temp_bin = rec[bin];
-			GP=F and debug("<%s> Cleaning %s", meth, tostring(bin));
-			if (is_expbin(temp_bin) and not not_expired(temp_bin[EXP_ID])) then
-				rec[bin] = nil;
-				GP=F and debug("<%s> Bin %s expired, erasing bin", meth, bin);
-			else
-				GP=F and debug("<%s> Bin %s hasn't expired, skipping record", meth, bin);
-			end
+			only[arg[i]] = true;
 		end
-		aerospike:update(rec);
-		GP=F and debug("[EXIT]<%s>", meth);
-		return 0;
+		local removed, earliest, count = drop_expired(rec, only);
+		if (put_meta(rec, earliest, count) or removed > 0) then
+			aerospike:update(rec);
+		end
+		GP=F and debug("[EXIT]<%s> Removed %d bins", meth, removed);
+		return removed;
 	else
 		GP=F and debug("[EXIT]<%s> Record doesn't exist", meth);
-		return 1;
+		return nil;
+	end
+end
+
+-- =========================================================================
+-- clean_all(): Rewrite every expired bin of the record to nil
+-- =========================================================================
+--
+-- USAGE: as.execute(policy, statement, "expire_bin", "clean_all");
+--
+-- Params:
+-- (*) rec: record to clean
+--
+-- Same as clean(), but every bin of the record is checked so the expbin
+-- names don't have to be known up front, and every element bin is trimmed.
+-- The record is only written if a bin or element was removed or its expiry
+-- summary changed.
+--
+-- Return:
+-- number of expired bins and elements removed = success
+-- nil = record doesn't exist
+-- =========================================================================
+function clean_all(rec)
+	local meth = "clean_all";
+	GP=F and debug("[ENTER]<%s>", meth);
+	if aerospike:exists(rec) then
+		if (not meta_due(rec)) then
+			GP=F and debug("[EXIT]<%s> No expired bins", meth);
+			return 0;
+		end
+		local removed, earliest, count = drop_expired(rec, nil);
+		if (put_meta(rec, earliest, count) or removed > 0) then
+			aerospike:update(rec);
+		end
+		GP=F and debug("[EXIT]<%s> Removed %d bins", meth, removed);
+		return removed;
+	else
+		GP=F and debug("[EXIT]<%s> Record doesn't exist", meth);
+		return nil;
 	end
 end
 
@@ -369,7 +967,7 @@ function ttl(rec, bin)
 	if aerospike:exists(rec) then
 		local binMap = rec[bin];
 		if (is_expbin(binMap)) then
-			local bin_ttl = binMap[EXP_ID];
+			local bin_ttl = bin_expiry(binMap);
 			if not_expired(bin_ttl) then
 				GP=F and debug("[EXIT]<%s>", meth);
 				if (bin_ttl == 0) then
@@ -391,16 +989,171 @@ function ttl(rec, bin)
 	end
 end
 
+-- =========================================================================
+-- put_elem(): Store an element with its own expiry in an element bin
+-- =========================================================================
+--
+-- USAGE: as.execute(policy, key, "expire_bin", "put_elem", bin, key, val, elem_ttl);
+--
+-- Params:
+-- (*) rec: record to store the element to
+-- (*) bin: element bin name, created if it doesn't exist
+-- (*) key: element key, an integer or string. An element with the same key
+--     is replaced.
+-- (*) val: value of the element, not nil
+-- (*) elem_ttl: Element TTL given in seconds or -1 to disable expiration
+--
+-- Expired elements of the bin are dropped on the way. The elem_ttl is
+-- checked against the record TTL like a bin_ttl, following TTL_MODE.
+--
+-- Return:
+-- 1 = error, or bin is not an element bin
+-- 0 = success
+-- =========================================================================
+function put_elem(rec, bin, key, val, elem_ttl)
+	local meth = "put_elem";
+	GP=F and debug("[ENTER]<%s> Bin: %s Key: %s TTL: %s", meth, bin, tostring(key), tostring(elem_ttl));
+	local exists = aerospike:exists(rec);
+	local rec_ttl = (exists and TTL_MODE == TTL_REJECT) and record.ttl(rec) or math.huge;
+	if ((type(key) ~= 'number' and type(key) ~= 'string') or val == nil or not valid_time(elem_ttl, rec_ttl)) then
+		GP=F and debug("[EXIT]<%s> Invalid element", meth);
+		return 1;
+	end
+	local cur = nil;
+	if exists then
+		cur = rec[bin];
+	end
+	local entries;
+	if (is_elembin(cur)) then
+		entries = cur[2];
+	elseif (cur == nil) then
+		entries = list();
+	else
+		GP=F and debug("[EXIT]<%s> Bin is not an element bin", meth);
+		return 1;
+	end
+	-- Element bins are counted in the expiry summary like expbins
+	local earliest, count = 0, 0;
+	if exists then
+		earliest, count = load_meta(rec);
+	end
+	if (cur == nil) then
+		count = count + 1;
+	end
+	local now = get_time();
+	local expired = expired_count(entries, now);
+	if (expired > 0) then
+		entries = list.drop(entries, expired);
+	end
+	-- Entries are ordered by expiry, so the key can be anywhere
+	for i=1, list.size(entries) do
+		if (entries[i][2] == key) then
+			list.remove(entries, i);
+			break;
+		end
+	end
+	local expiry = expiry_for(elem_ttl, now);
+	insert_entry(entries, list{expiry, key, val});
+	rec[bin] = list{EXP_ELEM_TAG, entries};
+	put_meta(rec, min_expiry(earliest, expiry), count);
+	local rc = save_record(rec, exists, elem_ttl, {[bin] = true});
+	GP=F and debug("[EXIT]<%s> Dropped %d elements", meth, expired);
+	return rc;
+end
+
+-- =========================================================================
+-- get_elems(): Get the live elements of an element bin
+-- =========================================================================
+--
+-- USAGE: as.execute(policy, key, "expire_bin", "get_elems", bin);
+--
+-- Params:
+-- (*) rec: record to retrieve the elements from
+-- (*) bin: element bin name
+--
+-- Return:
+-- 1 = record doesn't exist
+-- map of element key to value = success, empty if the bin doesn't exist or
+-- is not an element bin
+-- =========================================================================
+function get_elems(rec, bin)
+	local meth = "get_elems";
+	GP=F and debug("[ENTER]<%s> Bin: %s", meth, bin);
+	if not aerospike:exists(rec) then
+		GP=F and debug("[EXIT]<%s> Record doesn't exist", meth);
+		return 1;
+	end
+	local cur = rec[bin];
+	local return_map = is_elembin(cur) and live_elems(cur, get_time()) or map();
+	GP=F and debug("[EXIT]<%s> Returning element map: %s", meth, tostring(return_map));
+	return return_map;
+end
+
+-- =========================================================================
+-- trim(): Drop the expired elements of element bins
+-- =========================================================================
+--
+-- USAGE: as.execute(policy, key, "expire_bin", "trim", bins);
+--
+-- Params:
+-- (*) rec: record to trim
+-- (*) bin: variable number of element bin names
+--
+-- Bins left with no element are removed. Names that are not element bins
+-- are ignored. The record is only written if an element was dropped or its
+-- expiry summary changed.
+--
+-- Return:
+-- number of elements dropped = success
+-- nil = record doesn't exist
+-- =========================================================================
+function trim(rec, ...)
+	local meth = "trim";
+	GP=F and debug("[ENTER]<%s>", meth);
+	if not aerospike:exists(rec) then
+		GP=F and debug("[EXIT]<%s> Record doesn't exist", meth);
+		return nil;
+	end
+	local arg = table.pack(...);
+	local only = {};
+	for i=1, arg.n do
+		if (is_elembin(rec[arg[i]])) then
+			only[arg[i]] = true;
+		end
+	end
+	local dropped, earliest, count = drop_expired(rec, only);
+	if (put_meta(rec, earliest, count) or dropped > 0) then
+		aerospike:update(rec);
+	end
+	GP=F and debug("[EXIT]<%s> Dropped %d elements", meth, dropped);
+	return dropped;
+end
+
+-- Turn debug logging on or off for the Lua state the module is loaded in.
+-- It is exported like the other functions, so the server may also call it
+-- through apply(), passing the record first; rec is ignored. Modules that
+-- require this one pass nil. It has no effect on the production variant.
+local function set_debug(rec, on)
+	F = on and true or false;
+end
+
 -- =========================================================================
 -- Module export
 -- =========================================================================
 return {
 	get   = get,
+	get_repair = get_repair,
 	put   = put,
 	puts  = puts,
 	touch = touch,
+	touch_bins = touch_bins,
 	clean = clean,
-	ttl   = ttl
+	clean_all = clean_all,
+	ttl   = ttl,
+	put_elem = put_elem,
+	get_elems = get_elems,
+	trim  = trim,
+	set_debug = set_debug
 	-- uncomment to test
 	-- ,is_expbin = is_expbin,
 	-- valid_time = valid_time,
@@ -0,0 +1,485 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+//==========================================================
+// Includes
+//
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <aerospike/aerospike_key.h>
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_integer.h>
+
+#include "expire_bin.h"
+
+
+//==========================================================
+// Constants
+//
+
+#define LOG(_fmt, _args...) { printf(_fmt "\n", ## _args); fflush(stdout); }
+
+#define MAX_BINS 64
+
+enum {
+	OP_GET,
+	OP_PUT,
+	OP_PUTS,
+	OP_TOUCH,
+	OP_TTL,
+	N_OPS
+};
+
+static const char* OP_NAMES[N_OPS] = { "get", "put", "puts", "touch", "ttl" };
+
+// The op each benchmark op is recorded as by the stats listener.
+static const as_expbin_op STATS_OPS[N_OPS] = {
+	AS_EXPBIN_OP_GET,
+	AS_EXPBIN_OP_PUT,
+	AS_EXPBIN_OP_PUTS,
+	AS_EXPBIN_OP_TOUCH,
+	AS_EXPBIN_OP_TTL
+};
+
+
+//==========================================================
+// Typedefs
+//
+
+typedef struct bench_config_s {
+	const char* host;
+	int port;
+	const char* ns;
+	const char* set;
+	uint32_t n_keys;
+	uint32_t n_bins;
+	uint32_t n_threads;
+	uint32_t duration;
+	int64_t bin_ttl;
+	bool prefill;
+	uint32_t weights[N_OPS];
+} bench_config;
+
+// Latencies are recorded by the stats listener, only errors per worker.
+typedef struct bench_worker_s {
+	pthread_t thread;
+	uint32_t seed;
+	uint64_t errors[N_OPS];
+} bench_worker;
+
+
+//==========================================================
+// Globals
+//
+
+static aerospike as;
+static bench_config config = {
+	.host = "127.0.0.1",
+	.port = 3000,
+	.ns = "test",
+	.set = "expireBinBench",
+	.n_keys = 10000,
+	.n_bins = 4,
+	.n_threads = 8,
+	.duration = 10,
+	.bin_ttl = 3600,
+	.prefill = true,
+	.weights = { 50, 20, 10, 10, 10 }
+};
+static char bin_names[MAX_BINS][AS_BIN_NAME_MAX_SIZE];
+static volatile bool running = true;
+
+
+//==========================================================
+// Operations
+//
+
+static uint64_t
+now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Bin ops for puts (with a value) or touch (without) of every bin.
+static void
+bench_bin_ops(as_expbin_bin_op* ops, as_val* val)
+{
+	for (uint32_t i = 0; i < config.n_bins; i++) {
+		ops[i].bin = bin_names[i];
+		ops[i].val = val;
+		ops[i].bin_ttl = config.bin_ttl;
+	}
+}
+
+static as_status
+bench_op(uint32_t op, as_error* err, const as_key* key, as_list* get_bins, uint32_t* seed)
+{
+	as_val* result = NULL;
+	as_status rc = AEROSPIKE_OK;
+	const char* bin = bin_names[rand_r(seed) % config.n_bins];
+	as_expbin_bin_op ops[MAX_BINS];
+
+	switch (op) {
+	case OP_GET:
+		rc = as_expbin_get(&as, err, NULL, key, get_bins, &result);
+		break;
+
+	case OP_PUT: {
+		as_integer val;
+		as_integer_init(&val, rand_r(seed));
+		rc = as_expbin_put(&as, err, NULL, key, bin, (as_val*)&val, config.bin_ttl, &result);
+		break;
+	}
+
+	case OP_PUTS: {
+		as_integer val;
+		as_integer_init(&val, rand_r(seed));
+		bench_bin_ops(ops, (as_val*)&val);
+		rc = as_expbin_puts_ops(&as, err, NULL, key, ops, config.n_bins, &result);
+		break;
+	}
+
+	case OP_TOUCH:
+		bench_bin_ops(ops, NULL);
+		rc = as_expbin_touch_ops(&as, err, NULL, key, ops, config.n_bins, &result);
+		break;
+
+	case OP_TTL:
+		rc = as_expbin_ttl(&as, err, NULL, key, bin, &result);
+		break;
+	}
+
+	as_val_destroy(result);
+	return rc;
+}
+
+static uint32_t
+bench_pick_op(uint32_t* seed)
+{
+	uint32_t total = 0;
+
+	for (uint32_t i = 0; i < N_OPS; i++) {
+		total += config.weights[i];
+	}
+
+	uint32_t r = rand_r(seed) % total;
+
+	for (uint32_t i = 0; i < N_OPS; i++) {
+		if (r < config.weights[i]) {
+			return i;
+		}
+		r -= config.weights[i];
+	}
+	return OP_GET;
+}
+
+static void*
+bench_worker_run(void* udata)
+{
+	bench_worker* worker = (bench_worker*)udata;
+	as_error err;
+
+	as_arraylist get_bins;
+	as_arraylist_init(&get_bins, config.n_bins, 0);
+
+	for (uint32_t i = 0; i < config.n_bins; i++) {
+		as_arraylist_append_str(&get_bins, bin_names[i]);
+	}
+
+	while (running) {
+		uint32_t op = bench_pick_op(&worker->seed);
+
+		as_key key;
+		as_key_init_int64(&key, config.ns, config.set, rand_r(&worker->seed) % config.n_keys);
+
+		as_status rc = bench_op(op, &err, &key, (as_list*)&get_bins, &worker->seed);
+
+		if (rc != AEROSPIKE_OK) {
+			worker->errors[op]++;
+		}
+
+		as_key_destroy(&key);
+	}
+
+	as_arraylist_destroy(&get_bins);
+	return NULL;
+}
+
+// Write every bin of every key once, so that reads and touches hit expire bins.
+static bool
+bench_prefill(void)
+{
+	as_error err;
+
+	for (uint32_t k = 0; k < config.n_keys; k++) {
+		as_key key;
+		as_key_init_int64(&key, config.ns, config.set, k);
+
+		as_val* result = NULL;
+		as_integer val;
+		as_expbin_bin_op ops[MAX_BINS];
+
+		as_integer_init(&val, k);
+		bench_bin_ops(ops, (as_val*)&val);
+
+		as_status rc = as_expbin_puts_ops(&as, &err, NULL, &key, ops, config.n_bins, &result);
+
+		as_val_destroy(result);
+		as_key_destroy(&key);
+
+		if (rc != AEROSPIKE_OK) {
+			LOG("Prefill failed: error(%d) %s", err.code, err.message);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+//==========================================================
+// Command line
+//
+
+static void
+usage(const char* program)
+{
+	LOG("Usage: %s [options]", program);
+	LOG("  -h host       Server host (default %s).", config.host);
+	LOG("  -p port       Server port (default %d).", config.port);
+	LOG("  -n namespace  Namespace (default %s).", config.ns);
+	LOG("  -s set        Set (default %s).", config.set);
+	LOG("  -k keys       Number of keys (default %u).", config.n_keys);
+	LOG("  -b bins       Expire bins per key, at most %d (default %u).", MAX_BINS, config.n_bins);
+	LOG("  -z threads    Concurrent workers (default %u).", config.n_threads);
+	LOG("  -d seconds    Duration (default %u).", config.duration);
+	LOG("  -t bin_ttl    Bin TTL of puts and touches (default %" PRId64 ").", config.bin_ttl);
+	LOG("  -w mix        Op weights, e.g. get=50,put=20,puts=10,touch=10,ttl=10 (the default).");
+	LOG("  -P            Skip writing every key before the run.");
+}
+
+static bool
+parse_mix(char* mix)
+{
+	char* save = NULL;
+
+	memset(config.weights, 0, sizeof(config.weights));
+
+	for (char* tok = strtok_r(mix, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		char* eq = strchr(tok, '=');
+
+		if (!eq) {
+			return false;
+		}
+
+		*eq = 0;
+
+		uint32_t op = 0;
+
+		while (op < N_OPS && strcmp(tok, OP_NAMES[op]) != 0) {
+			op++;
+		}
+
+		if (op == N_OPS) {
+			return false;
+		}
+
+		config.weights[op] = (uint32_t)strtoul(eq + 1, NULL, 10);
+	}
+
+	for (uint32_t i = 0; i < N_OPS; i++) {
+		if (config.weights[i]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool
+parse_args(int argc, char* argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "h:p:n:s:k:b:z:d:t:w:P")) != -1) {
+		switch (c) {
+		case 'h': config.host = optarg; break;
+		case 'p': config.port = atoi(optarg); break;
+		case 'n': config.ns = optarg; break;
+		case 's': config.set = optarg; break;
+		case 'k': config.n_keys = (uint32_t)strtoul(optarg, NULL, 10); break;
+		case 'b': config.n_bins = (uint32_t)strtoul(optarg, NULL, 10); break;
+		case 'z': config.n_threads = (uint32_t)strtoul(optarg, NULL, 10); break;
+		case 'd': config.duration = (uint32_t)strtoul(optarg, NULL, 10); break;
+		case 't': config.bin_ttl = strtoll(optarg, NULL, 10); break;
+		case 'w':
+			if (!parse_mix(optarg)) {
+				return false;
+			}
+			break;
+		case 'P': config.prefill = false; break;
+		default: return false;
+		}
+	}
+
+	return config.n_keys > 0 && config.n_bins > 0 && config.n_bins <= MAX_BINS && config.n_threads > 0;
+}
+
+
+//==========================================================
+// Expire Bin C Benchmark
+//
+
+int
+main(int argc, char* argv[])
+{
+	if (!parse_args(argc, argv)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < config.n_bins; i++) {
+		snprintf(bin_names[i], sizeof(bin_names[i]), "bin%u", i);
+	}
+
+	as_config as_conf;
+	as_config_init(&as_conf);
+	as_config_add_host(&as_conf, config.host, config.port);
+	as_conf.max_conns_per_node = config.n_threads * 2;
+	aerospike_init(&as, &as_conf);
+
+	as_error err;
+
+	if (aerospike_connect(&as, &err) != AEROSPIKE_OK) {
+		LOG("error(%d) %s at [%s:%d]", err.code, err.message, err.file, err.line);
+		aerospike_destroy(&as);
+		return 1;
+	}
+
+	// The expire_bin module must already be registered, see make run.
+	if (config.prefill) {
+		LOG("Writing %u keys x %u bins...", config.n_keys, config.n_bins);
+
+		if (!bench_prefill()) {
+			aerospike_close(&as, &err);
+			aerospike_destroy(&as);
+			return 1;
+		}
+	}
+
+	// Only record the run itself.
+	as_expbin_stats* stats = as_expbin_stats_create();
+	as_expbin_listener listener;
+
+	if (!stats) {
+		LOG("Failed to allocate stats");
+		aerospike_close(&as, &err);
+		aerospike_destroy(&as);
+		return 1;
+	}
+
+	as_expbin_stats_listener(stats, &listener);
+	as_expbin_set_listener(&listener);
+
+	LOG("Running %u workers for %u seconds...", config.n_threads, config.duration);
+
+	bench_worker* workers = (bench_worker*)calloc(config.n_threads, sizeof(bench_worker));
+
+	if (!workers) {
+		LOG("Failed to allocate workers");
+		as_expbin_set_listener(NULL);
+		as_expbin_stats_destroy(stats);
+		aerospike_close(&as, &err);
+		aerospike_destroy(&as);
+		return 1;
+	}
+
+	uint64_t begin = now_us();
+	uint32_t n_started = 0;
+
+	for (; n_started < config.n_threads; n_started++) {
+		workers[n_started].seed = (uint32_t)begin + n_started;
+
+		if (pthread_create(&workers[n_started].thread, NULL, bench_worker_run, &workers[n_started]) != 0) {
+			LOG("Failed to start worker %u", n_started);
+			break;
+		}
+	}
+
+	if (n_started == config.n_threads) {
+		sleep(config.duration);
+	}
+
+	running = false;
+
+	for (uint32_t i = 0; i < n_started; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	if (n_started < config.n_threads) {
+		as_expbin_set_listener(NULL);
+		as_expbin_stats_destroy(stats);
+		free(workers);
+		aerospike_close(&as, &err);
+		aerospike_destroy(&as);
+		return 1;
+	}
+
+	double elapsed = (now_us() - begin) / 1000000.0;
+
+	LOG("%-6s %10s %10s %8s %8s %8s %8s %8s", "op", "count", "ops/s", "p50 us", "p99 us", "p999 us", "max us", "errors");
+
+	for (uint32_t op = 0; op < N_OPS; op++) {
+		as_expbin_op stats_op = STATS_OPS[op];
+		uint64_t n = as_expbin_stats_count(stats, stats_op);
+		uint64_t errors = 0;
+
+		for (uint32_t i = 0; i < config.n_threads; i++) {
+			errors += workers[i].errors[op];
+		}
+
+		if (n == 0) {
+			continue;
+		}
+
+		LOG("%-6s %10" PRIu64 " %10.0f %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64,
+			OP_NAMES[op], n, n / elapsed, as_expbin_stats_percentile(stats, stats_op, 50),
+			as_expbin_stats_percentile(stats, stats_op, 99), as_expbin_stats_percentile(stats, stats_op, 99.9),
+			as_expbin_stats_max(stats, stats_op), errors);
+	}
+
+	as_expbin_set_listener(NULL);
+	as_expbin_stats_destroy(stats);
+	free(workers);
+	aerospike_close(&as, &err);
+	aerospike_destroy(&as);
+	return 0;
+}
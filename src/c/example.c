@@ -0,0 +1,811 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+//==========================================================
+// Includes
+//
+
+#include <errno.h>
+#include <inttypes.h>
+
+#include <aerospike/aerospike_key.h>
+#include <aerospike/aerospike_scan.h>
+#include <aerospike/as_arraylist.h>
+#include <aerospike/aerospike_udf.h>
+#include <aerospike/as_event.h>
+#include <aerospike/as_monitor.h>
+#include <aerospike/as_record_iterator.h>
+
+#include "expire_bin.h"
+
+
+//==========================================================
+// Constants
+//
+
+#define UDF_MODULE AS_EXPBIN_MODULE
+#define UDF_USER_PATH "../../"
+#define LOG(_fmt, _args...) { printf(_fmt "\n", ## _args); fflush(stdout); }
+
+const char UDF_FILE_PATH[] = UDF_USER_PATH UDF_MODULE ".lua";
+
+// Namespace, Set, and Key	
+const char DEFAULT_NAMESPACE[] = "test";
+const char DEFAULT_SET[]       = "expireBin";
+const char DEFAULT_KEY_STR[]   = "testKey";
+
+// Based on current server limit
+char eb_namespace[32]; 
+char eb_set[64];
+char eb_key_str[1024];
+
+aerospike as;
+as_key testKey;
+as_config config;
+as_error err;
+
+
+//==========================================================
+// Forward Declarations
+//
+
+bool register_udf(aerospike* p_as, const char* udf_file_path);
+void cleanup(aerospike* as, as_error* err, as_policy_remove* policy, as_key* key);
+void example_dump_record(const as_record* p_rec);
+void example_cleanup(aerospike* p_as);
+void example_remove_test_records(aerospike* p_as);
+void example_remove_test_record(aerospike* p_as);
+void example_check(as_status rc, const char* op);
+void example_log_result(const char* prefix, as_val* result);
+as_list* example_bin_list(uint32_t n, const char* bins[]);
+bool example_get_many_callback(const as_key* key, as_status status, as_map* bins, void* udata);
+void example_clean_progress_callback(const as_expbin_clean_progress* progress, void* udata);
+bool example_scan_live_callback(const as_record* rec, void* udata);
+void example_log_stats(const as_expbin_stats* stats);
+void example_log_expbins(const as_record* p_rec);
+
+void exp_example(void);
+void touch_example(void);
+void get_example(void);
+void elem_example(void);
+void async_example(void);
+
+
+//==========================================================
+// Expire Bin C Example
+//  
+
+int
+main(int argc, char* argv[]) 
+{
+	LOG("This is a demo of the expirable bin module for C:");
+
+	strcpy(eb_namespace, DEFAULT_NAMESPACE);
+	strcpy(eb_set, DEFAULT_SET);
+	strcpy(eb_key_str, DEFAULT_KEY_STR);
+
+	// Event loops must exist before the cluster is created to be used for
+	// async commands. The client may have been built without event loop
+	// support, in which case the async example is skipped.
+	if (!as_event_create_loops(1)) {
+		LOG("Event loops not available, async example disabled");
+	}
+
+	as_config_init(&config);
+	as_config_add_host(&config, "127.0.0.1", 3000);
+	aerospike_init(&as, &config);
+
+	LOG("Connecting to Aerospike server...");
+	
+	if (aerospike_connect(&as, &err) != AEROSPIKE_OK) {
+		LOG("error(%d) %s at [%s:%d]", err.code, err.message, err.file, err.line);
+		exit(1);
+	}
+
+	LOG("Connected!");
+
+	// Record the latency and outcome of every call.
+	as_expbin_stats* stats = as_expbin_stats_create();
+	as_expbin_listener listener;
+	as_expbin_stats_listener(stats, &listener);
+	as_expbin_set_listener(&listener);
+	
+	// Start clean.
+	if (as_key_init_str(&testKey, eb_namespace, eb_set, eb_key_str) == NULL) {
+		LOG("Key was not initiated");
+		exit(1);
+	}
+	
+	aerospike_key_remove(&as, &err, NULL, &testKey);
+
+	LOG("Registering UDF...");
+
+	if (!register_udf(&as, UDF_FILE_PATH)) {
+		LOG("Error registering UDF!")
+		cleanup(&as, &err, NULL, &testKey);
+		exit(-1);
+	}
+
+	LOG("UDF registered!");
+
+	// Example 1: validates the basic bin expiration.
+	exp_example();
+
+	// Example 2: validates the basic bin expiration after using 'touch'.
+	touch_example();
+
+	// Example 3: shows the difference between normal 'get' and 'eb.get'.
+	get_example();
+
+	// Example 4: elements expiring on their own inside a bin.
+	elem_example();
+
+	// Example 5: many puts in flight on an event loop.
+	async_example();
+
+	example_log_stats(stats);
+	as_expbin_set_listener(NULL);
+	as_expbin_stats_destroy(stats);
+
+	aerospike_close(&as, &err);
+	aerospike_destroy(&as);
+	as_event_close_loops();
+
+	LOG("Demo of the expirable bin module for C successfully completed");
+
+	return 0;
+}
+
+//==========================================================
+// Helpers
+//
+
+// Register a UDF function in the database.
+bool
+register_udf(aerospike* p_as, const char* udf_file_path)
+{
+	FILE* file = fopen(udf_file_path, "r");
+
+	if (!file) {
+		// If we get here it's likely that we're not running the example from
+		// the right directory - the specific example directory.
+		LOG("cannot open script file %s : %s", udf_file_path, strerror(errno));
+		return false;
+	}
+
+	// Read the file's content into a local buffer.
+
+	uint8_t* content = (uint8_t*)malloc(1024 * 1024);
+
+	if (!content) {
+		LOG("script content allocation failed");
+		return false;
+	}
+
+	uint8_t* p_write = content;
+	int read = (int)fread(p_write, 1, 512, file);
+	int size = 0;
+
+	while (read) {
+		size += read;
+		p_write += read;
+		read = (int)fread(p_write, 1, 512, file);
+	}
+
+	fclose(file);
+
+	// Wrap the local buffer as an as_bytes object.
+	as_bytes udf_content;
+	as_bytes_init_wrap(&udf_content, content, size, true);
+
+	as_error err;
+	as_string base_string;
+	const char* base = as_basename(&base_string, udf_file_path);
+
+	// Register the UDF file in the database cluster.
+	if (aerospike_udf_put(p_as, &err, NULL, base, AS_UDF_TYPE_LUA,
+			&udf_content) == AEROSPIKE_OK) {
+		// Wait for the system metadata to spread to all nodes.
+		aerospike_udf_put_wait(p_as, &err, NULL, base, 100);
+	}
+	else {
+		LOG("aerospike_udf_put() returned %d - %s", err.code, err.message);
+	}
+
+	as_string_destroy(&base_string);
+
+	// This frees the local buffer.
+	as_bytes_destroy(&udf_content);
+
+	return err.code == AEROSPIKE_OK;
+}
+
+// Remove the record from database, and disconnect from cluster.
+void
+cleanup(aerospike* as, as_error* err, as_policy_remove* policy, as_key* testKey)
+{
+	// Clean up the database. Note that with database "storage-engine device"
+	// configurations, this record may come back to life if the server is re-
+	// started. That's why this example that want to start clean removes the 
+	// record at the beginning.
+	
+	// Remove the record from the database.
+	aerospike_key_remove(as, err, NULL, testKey);
+
+	// Disconnect from the database cluster and clean up the aerospike object.
+	aerospike_close(as, err);
+	aerospike_destroy(as);
+}
+
+static void
+example_dump_bin(const as_bin* p_bin)
+{
+	if (!p_bin) {
+		LOG("Null as_bin object");
+		return;
+	}
+
+	char* val_as_str = as_val_tostring(as_bin_get_value(p_bin));
+
+	LOG("%s: %s", as_bin_get_name(p_bin), val_as_str);
+
+	free(val_as_str);
+}
+
+void
+example_dump_record(const as_record* p_rec)
+{
+	if (!p_rec) {
+		LOG("Null as_record object");
+		return;
+	}
+
+	if (p_rec->key.valuep) {
+		char* key_val_as_str = as_val_tostring(p_rec->key.valuep);
+		free(key_val_as_str);
+	}
+
+	as_record_iterator it;
+	as_record_iterator_init(&it, p_rec);
+
+	while (as_record_iterator_has_next(&it)) {
+		example_dump_bin(as_record_iterator_next(&it));
+	}
+
+	as_record_iterator_destroy(&it);
+}
+
+//------------------------------------------------
+// Remove the test record from database, and
+// disconnect from cluster.
+//
+void
+example_cleanup(aerospike* p_as)
+{
+	// Clean up the database. Note that with database "storage-engine device"
+	// configurations, this record may come back to life if the server is re-
+	// started. That's why examples that want to start clean remove the test
+	// record at the beginning.
+	example_remove_test_record(p_as);
+
+	// Note also example_remove_test_records() is not called here - examples
+	// using multiple records call that from their own cleanup utilities.
+
+	as_error err;
+
+	// Disconnect from the database cluster and clean up the aerospike object.
+	aerospike_close(p_as, &err);
+	aerospike_destroy(p_as);
+}
+
+//------------------------------------------------
+// Remove the test record from the database.
+//
+void
+example_remove_test_record(aerospike* p_as)
+{
+	as_error err;
+
+	// Try to remove the test record from the database. If the example has not
+	// inserted the record, or it has already been removed, this call will
+	// return as_status AEROSPIKE_ERR_RECORD_NOT_FOUND - which we just ignore.
+	aerospike_key_remove(p_as, &err, NULL, &testKey);
+}
+
+//------------------------------------------------
+// Remove multiple-record examples' test records
+// from the database.
+//
+void
+example_remove_test_records(aerospike* p_as)
+{
+	as_error err;
+
+	if (as_key_init_str(&testKey, eb_namespace, eb_set, eb_key_str) == NULL) {
+		LOG("Key was not initiated");
+		exit(1);
+	}
+
+	aerospike_key_remove(p_as, &err, NULL, &testKey);
+}
+
+//------------------------------------------------
+// Exit the example if an expire bin call failed.
+//
+void
+example_check(as_status rc, const char* op)
+{
+	if (rc != AEROSPIKE_OK) {
+		LOG("%s() returned %d - %s", op, err.code, err.message);
+		example_cleanup(&as);
+		exit(1);
+	}
+}
+
+//------------------------------------------------
+// Log and destroy the value returned by an expire
+// bin call.
+//
+void
+example_log_result(const char* prefix, as_val* result)
+{
+	char* str = as_val_tostring(result);
+	LOG("%s%s", prefix, str);
+	free(str);
+	as_val_destroy(result);
+}
+
+//------------------------------------------------
+// Build a list of bin names.
+//
+as_list*
+example_bin_list(uint32_t n, const char* bins[])
+{
+	as_arraylist* list = as_arraylist_new(n, 0);
+
+	for (uint32_t i = 0; i < n; i++) {
+		as_arraylist_append_str(list, bins[i]);
+	}
+
+	return (as_list*)list;
+}
+
+//------------------------------------------------
+// Log the result of one key of a batch get.
+//
+bool
+example_get_many_callback(const as_key* key, as_status status, as_map* bins, void* udata)
+{
+	char* name = as_val_tostring(key->valuep);
+
+	if (status == AEROSPIKE_OK) {
+		char* str = as_val_tostring(bins);
+		LOG("  %s: %s", name, str);
+		free(str);
+	}
+	else {
+		LOG("  %s: status %d", name, status);
+	}
+
+	free(name);
+	return true;
+}
+
+//------------------------------------------------
+// Log the progress of a partition clean now and then.
+//
+void
+example_clean_progress_callback(const as_expbin_clean_progress* progress, void* udata)
+{
+	if (progress->partitions_done % 1024 == 0) {
+		LOG("  %u/%u partitions, %" PRIu64 " records, %" PRIu64 " bins removed, %" PRIu64 " failed",
+			progress->partitions_done, progress->partitions_total, progress->records, progress->bins_removed,
+			progress->failed);
+	}
+}
+
+bool
+example_scan_live_callback(const as_record* rec, void* udata)
+{
+	(*(uint32_t*)udata)++;
+	example_dump_record(rec);
+	return true;
+}
+
+void
+example_log_stats(const as_expbin_stats* stats)
+{
+	LOG("Call statistics:");
+
+	for (uint32_t op = 0; op < AS_EXPBIN_OP_COUNT; op++) {
+		uint64_t count = as_expbin_stats_count(stats, op);
+
+		if (count == 0) {
+			continue;
+		}
+
+		LOG("  %-12s %6" PRIu64 " calls, p50 %" PRIu64 " us, p99 %" PRIu64 " us, max %" PRIu64 " us", as_expbin_op_name(op),
+			count, as_expbin_stats_percentile(stats, op, 50), as_expbin_stats_percentile(stats, op, 99), as_expbin_stats_max(stats, op));
+
+		for (uint32_t o = 0; o < AS_EXPBIN_OUTCOME_COUNT; o++) {
+			uint64_t n = as_expbin_stats_outcomes(stats, op, o);
+
+			if (n) {
+				LOG("    %s: %" PRIu64, as_expbin_outcome_name(o), n);
+			}
+		}
+	}
+}
+
+void
+example_log_expbins(const as_record* p_rec)
+{
+	as_expbin_batch batch;
+
+	if (!as_expbin_batch_init(&batch, 0) || !as_expbin_batch_add(&batch, p_rec)) {
+		LOG("as_expbin_batch_add() failed");
+		as_expbin_batch_destroy(&batch);
+		return;
+	}
+
+	as_expbin_batch_eval(&batch, as_expbin_now());
+
+	for (uint32_t i = 0; i < batch.size; i++) {
+		LOG("  %s is %s", batch.bins[i], batch.live[i] ? "live" : "expired");
+	}
+
+	as_expbin_batch_destroy(&batch);
+}
+
+void 
+exp_example(void) {
+	as_val* result = NULL;
+	as_string val;
+
+	LOG("Inserting expire bins...");
+	as_string_init(&val, "Hello World.", false);
+	example_check(as_expbin_put(&as, &err, NULL, &testKey, "TestBin1", (as_val*)&val, -1, &result), "as_expbin_put");
+	as_val_destroy(result);
+	LOG("TestBin 1 inserted");
+	
+	as_string_init(&val, "I don't expire.", false);
+	example_check(as_expbin_put(&as, &err, NULL, &testKey, "TestBin2", (as_val*)&val, 8, &result), "as_expbin_put");
+	as_val_destroy(result);
+	LOG("TestBin 2 inserted");
+
+	as_string_init(&val, "I will expire soon.", false);
+	example_check(as_expbin_put(&as, &err, NULL, &testKey, "TestBin3", (as_val*)&val, 5, &result), "as_expbin_put");
+	as_val_destroy(result);
+	LOG("TestBin 3 inserted");
+
+	as_string_init(&val, "Written without the UDF.", false);
+	example_check(as_expbin_put_exp(&as, &err, NULL, &testKey, "TestBin6", (as_val*)&val, 5, AS_RECORD_DEFAULT_TTL), "as_expbin_put_exp");
+	LOG("TestBin 6 inserted");
+
+	const char* bins[] = {"TestBin1", "TestBin2", "TestBin3", "TestBin6"};
+	as_list* arglist = example_bin_list(4, bins);
+
+	LOG("Getting expire bins...");
+	example_check(as_expbin_get(&as, &err, NULL, &testKey, arglist, &result), "as_expbin_get");
+	example_log_result("", result);
+
+	LOG("Getting bins TTL...");
+	example_check(as_expbin_ttl(&as, &err, NULL, &testKey, "TestBin1", &result), "as_expbin_ttl");
+	example_log_result("TestBin 1 TTL: ", result);
+	example_check(as_expbin_ttl(&as, &err, NULL, &testKey, "TestBin2", &result), "as_expbin_ttl");
+	example_log_result("TestBin 2 TTL: ", result);
+	example_check(as_expbin_ttl(&as, &err, NULL, &testKey, "TestBin3", &result), "as_expbin_ttl");
+	example_log_result("TestBin 3 TTL: ", result);
+	example_check(as_expbin_ttl(&as, &err, NULL, &testKey, "TestBin6", &result), "as_expbin_ttl");
+	example_log_result("TestBin 6 TTL: ", result);
+
+	LOG("Waiting for TestBin 3 & 6 to expire...");
+	sleep(6);
+
+	LOG("Getting expire bins again...");
+	example_check(as_expbin_get(&as, &err, NULL, &testKey, arglist, &result), "as_expbin_get");
+	example_log_result("", result);
+
+	LOG("Getting expire bins again, removing the expired ones...");
+	example_check(as_expbin_get_repair(&as, &err, NULL, &testKey, 60, arglist, &result), "as_expbin_get_repair");
+	example_log_result("", result);
+
+	as_list_destroy(arglist);
+}
+
+void
+touch_example(void) {
+	as_val* result = NULL;
+
+	LOG("Changing expiration time for TestBin 1 and TestBin 2...");
+
+	as_arraylist touchlist;
+	as_arraylist_inita(&touchlist, 2);
+	as_arraylist_append_map(&touchlist, as_expbin_bin_map("TestBin1", NULL, 3));
+	as_arraylist_append_map(&touchlist, as_expbin_bin_map("TestBin2", NULL, -1));
+
+	example_check(as_expbin_touch(&as, &err, NULL, &testKey, (as_list*)&touchlist, &result), "as_expbin_touch");
+	as_val_destroy(result);
+	as_arraylist_destroy(&touchlist);
+
+	LOG("Getting bins TTL...");
+	example_check(as_expbin_ttl(&as, &err, NULL, &testKey, "TestBin1", &result), "as_expbin_ttl");
+	example_log_result("TestBin 1 TTL: ", result);
+	example_check(as_expbin_ttl(&as, &err, NULL, &testKey, "TestBin2", &result), "as_expbin_ttl");
+	example_log_result("TestBin 2 TTL: ", result);
+
+	LOG("Waiting for TestBin 1 to expire...");
+	sleep(4);
+
+	LOG("Getting expire bins again...");
+	const char* bins[] = {"TestBin1", "TestBin2", "TestBin3"};
+	as_list* arglist = example_bin_list(3, bins);
+	example_check(as_expbin_get(&as, &err, NULL, &testKey, arglist, &result), "as_expbin_get");
+	example_log_result("", result);
+	as_list_destroy(arglist);
+}
+
+void
+get_example(void) {
+	as_val* result = NULL;
+
+	LOG("Inserting expire bins...");
+	as_string morning;
+	as_string night;
+	as_string_init(&morning, "Good Morning.", false);
+	as_string_init(&night, "Good Night.", false);
+
+	as_expbin_bin_op ops[] = {
+		{ "TestBin4", (as_val*)&morning, 5 },
+		{ "TestBin5", (as_val*)&night, 5 }
+	};
+
+	example_check(as_expbin_puts_ops(&as, &err, NULL, &testKey, ops, 2, &result), "as_expbin_puts_ops");
+	as_val_destroy(result);
+	LOG("TestBin 4 & 5 inserted");
+
+	LOG("Sleeping for 6 seconds (TestBin 4 & 5 will expire)...");
+	sleep(6);
+
+	// Read the record using 'eb.get' after it expires, showing it's gone
+	LOG("Getting TestBin 4 & 5 using 'eb interface'...");
+	const char* two_bins[] = {"TestBin4", "TestBin5", NULL};
+	as_list* arglist = example_bin_list(2, two_bins);
+	example_check(as_expbin_get(&as, &err, NULL, &testKey, arglist, &result), "as_expbin_get");
+	example_log_result("", result);
+	as_list_destroy(arglist);
+		
+	// Read the record using normal 'get' after it expires, showing it's persistent
+	LOG("Getting TestBin 4 & 5 using 'normal get'...");
+
+	as_record* p_rec = NULL;
+
+	// Read only these two bins of the test record from the database.
+	if (aerospike_key_select(&as, &err, NULL, &testKey, two_bins, &p_rec) != AEROSPIKE_OK) {
+		LOG("aerospike_key_select() returned %d - %s", err.code, err.message);
+		example_cleanup(&as);
+		exit(-1);
+	}
+
+	// Log the result, tell the expired bins apart on the client, and recycle
+	// the as_record object.
+	example_dump_record(p_rec);
+	example_log_expbins(p_rec);
+	as_record_destroy(p_rec);
+	p_rec = NULL;
+
+	LOG("Cleaning bins...");
+	const char* all_bins[] = {"TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5", NULL};
+
+	as_scan scan;
+	as_scan_init(&scan, eb_namespace, eb_set);
+	LOG("Scan in progress...");
+	example_check(as_expbin_clean(&as, &err, NULL, &scan, example_bin_list(5, all_bins)), "as_expbin_clean");
+	as_scan_destroy(&scan);
+	LOG("Scan completed!");
+
+	LOG("Cleaning bins partition by partition, 4 workers at up to 1000 records per second...");
+	as_expbin_clean_config clean_config = {
+		.ns = eb_namespace,
+		.set = eb_set,
+		.binlist = example_bin_list(5, all_bins),
+		.n_threads = 4,
+		.records_per_second = 1000,
+		.progress_callback = example_clean_progress_callback
+	};
+	as_expbin_clean_progress clean_progress;
+	example_check(as_expbin_clean_partitions(&as, &err, NULL, NULL, &clean_config, &clean_progress), "as_expbin_clean_partitions");
+	as_list_destroy(clean_config.binlist);
+	LOG("Partition clean completed, %" PRIu64 " bins removed.", clean_progress.bins_removed);
+
+	LOG("Reading the live bins of the set with a client-side scan...");
+	uint32_t n_scanned = 0;
+	as_expbin_scan_config scan_config = {
+		.ns = eb_namespace,
+		.set = eb_set,
+		.n_threads = 4,
+		.callback = example_scan_live_callback,
+		.udata = &n_scanned
+	};
+	example_check(as_expbin_scan_live(&as, &err, NULL, &scan_config), "as_expbin_scan_live");
+	LOG("%u records read", n_scanned);
+
+	LOG("Checking expire bins again using 'eb interface'...");
+	arglist = example_bin_list(5, all_bins);
+	example_check(as_expbin_get(&as, &err, NULL, &testKey, arglist, &result), "as_expbin_get");
+	example_log_result("", result);
+	as_list_destroy(arglist);
+
+	LOG("Checking expire bins again using 'normal get'...");
+
+	// Read all these bins of the test record from the database.
+	if (aerospike_key_select(&as, &err, NULL, &testKey, all_bins, &p_rec) != AEROSPIKE_OK) {
+		LOG("aerospike_key_select() returned %d - %s", err.code, err.message);
+		example_cleanup(&as);
+		exit(-1);
+	}
+
+	// Log the result and recycle the as_record object.
+	example_dump_record(p_rec);
+	as_record_destroy(p_rec);
+	p_rec = NULL;
+
+	LOG("Checking expire bins again using 'eb interface' without the UDF...");
+	example_check(as_expbin_get_exp(&as, &err, NULL, &testKey, all_bins, 5, &result), "as_expbin_get_exp");
+	example_log_result("", result);
+
+	// The second read is served from the client-side cache.
+	LOG("Checking expire bins twice through the client-side cache...");
+	as_expbin_cache* cache = as_expbin_cache_create(1024, 1000);
+	example_check(as_expbin_cache_get(cache, &as, &err, NULL, &testKey, all_bins, 5, &result), "as_expbin_cache_get");
+	example_log_result("", result);
+	example_check(as_expbin_cache_get(cache, &as, &err, NULL, &testKey, all_bins, 5, &result), "as_expbin_cache_get");
+	example_log_result("", result);
+	as_expbin_cache_destroy(cache);
+
+	// Read the test record and one that doesn't exist in a single batch call.
+	LOG("Getting expire bins of two records using 'batch get'...");
+	as_batch batch;
+	as_batch_inita(&batch, 2);
+	as_key_init_str(as_batch_keyat(&batch, 0), eb_namespace, eb_set, eb_key_str);
+	as_key_init_str(as_batch_keyat(&batch, 1), eb_namespace, eb_set, "missingKey");
+
+	arglist = example_bin_list(5, all_bins);
+	example_check(as_expbin_get_many(&as, &err, NULL, &batch, arglist, example_get_many_callback, NULL), "as_expbin_get_many");
+	as_list_destroy(arglist);
+	as_batch_destroy(&batch);
+}
+
+//------------------------------------------------
+// Per-request state of the async example. Each
+// in-flight put owns its key, freed by the
+// listener once the put completes.
+//
+typedef struct {
+	as_key key;
+	uint32_t id;
+} async_put_req;
+
+#define ASYNC_PUTS 100
+
+static as_monitor async_monitor;
+static uint32_t async_pending;
+static uint32_t async_failed;
+
+static void
+async_put_listener(as_error* err, as_val* val, void* udata, as_event_loop* event_loop)
+{
+	async_put_req* req = (async_put_req*)udata;
+
+	if (err) {
+		LOG("async put %u returned %d - %s", req->id, err->code, err->message);
+		__sync_add_and_fetch(&async_failed, 1);
+	}
+
+	as_key_destroy(&req->key);
+	free(req);
+
+	if (__sync_sub_and_fetch(&async_pending, 1) == 0) {
+		as_monitor_notify(&async_monitor);
+	}
+}
+
+void
+elem_example(void) {
+	as_val* result = NULL;
+
+	LOG("Inserting elements into ElemBin...");
+	const char* names[] = {"short", "long", "forever"};
+	int64_t ttls[] = {2, 60, -1};
+
+	for (uint32_t i = 0; i < 3; i++) {
+		as_string elem_key;
+		as_integer val;
+		as_string_init(&elem_key, (char*)names[i], false);
+		as_integer_init(&val, i);
+
+		example_check(as_expbin_put_elem(&as, &err, NULL, &testKey, "ElemBin", (as_val*)&elem_key, (as_val*)&val, ttls[i], &result), "as_expbin_put_elem");
+		as_val_destroy(result);
+	}
+
+	example_check(as_expbin_get_elems(&as, &err, NULL, &testKey, "ElemBin", &result), "as_expbin_get_elems");
+	example_log_result("Elements: ", result);
+
+	LOG("Waiting for the short element to expire...");
+	sleep(3);
+
+	example_check(as_expbin_get_elems(&as, &err, NULL, &testKey, "ElemBin", &result), "as_expbin_get_elems");
+	example_log_result("Elements: ", result);
+
+	const char* bins[] = {"ElemBin"};
+	as_list* arglist = example_bin_list(1, bins);
+	example_check(as_expbin_trim(&as, &err, NULL, &testKey, arglist, &result), "as_expbin_trim");
+	example_log_result("Elements dropped: ", result);
+	as_list_destroy(arglist);
+}
+
+void
+async_example(void) {
+	if (as_event_loop_size == 0) {
+		return;
+	}
+
+	LOG("Inserting %d expire bins asynchronously...", ASYNC_PUTS);
+	as_monitor_init(&async_monitor);
+	async_pending = ASYNC_PUTS;
+	async_failed = 0;
+
+	char key_str[64];
+
+	for (uint32_t i = 0; i < ASYNC_PUTS; i++) {
+		async_put_req* req = (async_put_req*)malloc(sizeof(async_put_req));
+		req->id = i;
+		snprintf(key_str, sizeof(key_str), "%s%u", eb_key_str, i);
+		as_key_init_strp(&req->key, eb_namespace, eb_set, strdup(key_str), true);
+
+		as_integer ival;
+		as_integer_init(&ival, i);
+
+		if (as_expbin_put_async(&as, &err, NULL, &req->key, "AsyncBin", (as_val*)&ival, 60, async_put_listener, req, NULL) != AEROSPIKE_OK) {
+			LOG("as_expbin_put_async() returned %d - %s", err.code, err.message);
+			as_key_destroy(&req->key);
+			free(req);
+			__sync_add_and_fetch(&async_failed, 1);
+
+			if (__sync_sub_and_fetch(&async_pending, 1) == 0) {
+				as_monitor_notify(&async_monitor);
+			}
+		}
+	}
+
+	as_monitor_wait(&async_monitor);
+	as_monitor_destroy(&async_monitor);
+	LOG("%d async puts completed, %u failed", ASYNC_PUTS, async_failed);
+
+	for (uint32_t i = 0; i < ASYNC_PUTS; i++) {
+		as_key key;
+		snprintf(key_str, sizeof(key_str), "%s%u", eb_key_str, i);
+		as_key_init_str(&key, eb_namespace, eb_set, key_str);
+		aerospike_key_remove(&as, &err, NULL, &key);
+	}
+}
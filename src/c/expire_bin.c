@@ -25,653 +25,1914 @@
 // Includes
 //
 
-#include <errno.h>
-
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <aerospike/aerospike_batch.h>
+#include <aerospike/aerospike_index.h>
 #include <aerospike/aerospike_key.h>
+#include <aerospike/aerospike_query.h>
 #include <aerospike/aerospike_scan.h>
 #include <aerospike/as_arraylist.h>
-#include <aerospike/aerospike_udf.h>
+#include <aerospike/as_exp.h>
 #include <aerospike/as_hashmap.h>
+#include <aerospike/as_nil.h>
+#include <aerospike/as_operations.h>
+#include <aerospike/as_partition_filter.h>
+#include <aerospike/as_record.h>
 #include <aerospike/as_stringmap.h>
-#include <aerospike/as_record_iterator.h>
+
+#include "expire_bin.h"
 
 
 //==========================================================
 // Constants
 //
 
-#define UDF_MODULE "expire_bin"
-#define UDF_USER_PATH "../../"
-#define LOG(_fmt, _args...) { printf(_fmt "\n", ## _args); fflush(stdout); }
+// Stored expbin format, see expire_bin.lua.
+#define EXPBIN_TAG -25
+#define EXPBIN_ELEM_TAG -26
+#define EXPBIN_ID "expbin_ttl"
+#define EXPBIN_DATA "data"
+#define EXPBIN_META "expbin_meta"
+#define EXPBIN_DUE "expbin_due"
+
+// Server time in seconds since the Citrusleaf epoch.
+#define EXPBIN_EXP_NOW \
+	as_exp_sub( \
+		as_exp_div( \
+			as_exp_add(as_exp_div(as_exp_last_update(), as_exp_int(1000000)), as_exp_since_update()), \
+			as_exp_int(1000)), \
+		as_exp_int(AS_EXPBIN_CITRUSLEAF_EPOCH))
+
+// True if the expiry is 0 (no expiration) or not yet reached.
+#define EXPBIN_EXP_LIVE(__expiry) \
+	as_exp_or( \
+		as_exp_cmp_eq(__expiry, as_exp_int(0)), \
+		as_exp_cmp_le(EXPBIN_EXP_NOW, __expiry))
+
+// Earliest of two expiries, where 0 means no expiration.
+#define EXPBIN_EXP_MIN_EXPIRY(__a, __b) \
+	as_exp_cond( \
+		as_exp_cmp_eq(__a, as_exp_int(0)), __b, \
+		as_exp_cmp_eq(__b, as_exp_int(0)), __a, \
+		as_exp_min(__a, __b))
+
+// True if the bin is an expbin in either format. Never evaluates to unknown.
+#define EXPBIN_EXP_IS_EXPBIN(__bin) \
+	as_exp_cond( \
+		as_exp_cmp_eq(as_exp_bin_type(__bin), as_exp_int(AS_BYTES_LIST)), \
+		as_exp_and( \
+			as_exp_cmp_eq(as_exp_list_size(NULL, as_exp_bin_list(__bin)), as_exp_int(3)), \
+			as_exp_cmp_eq( \
+				as_exp_list_get_by_value(NULL, AS_LIST_RETURN_COUNT, as_exp_int(EXPBIN_TAG), \
+					as_exp_list_get_by_index_range(NULL, AS_LIST_RETURN_VALUE, as_exp_int(0), as_exp_int(1), as_exp_bin_list(__bin))), \
+				as_exp_int(1))), \
+		as_exp_cmp_eq(as_exp_bin_type(__bin), as_exp_int(AS_BYTES_MAP)), \
+		as_exp_cmp_gt( \
+			as_exp_map_get_by_key(NULL, AS_MAP_RETURN_COUNT, AS_EXP_TYPE_INT, as_exp_str(EXPBIN_ID), as_exp_bin_map(__bin)), \
+			as_exp_int(0)), \
+		as_exp_bool(false))
+
+// True if the bin is an element bin. Never evaluates to unknown.
+#define EXPBIN_EXP_IS_ELEMBIN(__bin) \
+	as_exp_cond( \
+		as_exp_cmp_eq(as_exp_bin_type(__bin), as_exp_int(AS_BYTES_LIST)), \
+		as_exp_and( \
+			as_exp_cmp_eq(as_exp_list_size(NULL, as_exp_bin_list(__bin)), as_exp_int(2)), \
+			as_exp_cmp_eq( \
+				as_exp_list_get_by_value(NULL, AS_LIST_RETURN_COUNT, as_exp_int(EXPBIN_ELEM_TAG), \
+					as_exp_list_get_by_index_range(NULL, AS_LIST_RETURN_VALUE, as_exp_int(0), as_exp_int(1), as_exp_bin_list(__bin))), \
+				as_exp_int(1))), \
+		as_exp_bool(false))
 
-const char UDF_FILE_PATH[] = UDF_USER_PATH UDF_MODULE ".lua";
 
-// Namespace, Set, and Key	
-const char DEFAULT_NAMESPACE[] = "test";
-const char DEFAULT_SET[]       = "expireBin";
-const char DEFAULT_KEY_STR[]   = "testKey";
+//==========================================================
+// Typedefs
+//
 
-// Based on current server limit
-char eb_namespace[32]; 
-char eb_set[64];
-char eb_key_str[1024];
+typedef struct expbin_get_many_data_s {
+	as_expbin_get_many_callback callback;
+	void* udata;
+
+	// Instrumentation of the batch, see expbin_op_begin().
+	uint64_t begin;
+	uint32_t n_bins;
+	uint32_t outcomes[AS_EXPBIN_OUTCOME_COUNT];
+} expbin_get_many_data;
+
+// The user listener of an instrumented async call, see expbin_apply_async().
+typedef struct expbin_async_data_s {
+	as_async_value_listener listener;
+	void* udata;
+	as_expbin_op op;
+	uint64_t begin;
+	uint32_t n_bins;
+} expbin_async_data;
+
+// UDF arguments of one bin op, [bin, val, bin_ttl] or [bin, bin_ttl].
+typedef struct expbin_op_args_s {
+	as_arraylist list;
+	as_val* elements[3];
+	as_string bin;
+	as_integer bin_ttl;
+} expbin_op_args;
+
+// Per-thread space for the arguments of the bin op calls. It is reused by
+// every call, so only a thread's first call and calls with more ops than
+// before allocate.
+typedef struct expbin_scratch_s {
+	uint32_t capacity;
+	as_val** ops;
+	expbin_op_args args[];
+} expbin_scratch;
+
+// State shared by the workers of as_expbin_clean_partitions().
+typedef struct expbin_cleaner_s {
+	aerospike* as;
+	as_policy_scan scan_policy;
+	const as_policy_apply* apply_policy;
+	const as_expbin_clean_config* config;
+	const char* function;
+
+	// Partitions to clean, handed out in order.
+	uint16_t pending[AS_PARTITIONS];
+	uint32_t n_pending;
+
+	// Everything below is protected by lock. rc is also read without it,
+	// atomically, by the scan callbacks.
+	pthread_mutex_t lock;
+	uint32_t next;
+	FILE* checkpoint;
+	as_expbin_clean_progress progress;
+	as_status rc;
+	as_error err;
+} expbin_cleaner;
+
+// State shared by the workers of as_expbin_scan_live() and the calling thread.
+typedef struct expbin_scanner_s {
+	aerospike* as;
+	const as_policy_scan* scan_policy;
+	const as_expbin_scan_config* config;
+
+	// Everything below is protected by lock. stopped is also read without it,
+	// atomically, by the scan callbacks.
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	uint32_t next;
+	uint32_t n_running;
+	bool stopped;
+	as_status rc;
+	as_error err;
 
-aerospike as;
-as_key testKey;
-as_config config;
-as_error err;
-as_val* result;
-as_string val;
-as_arraylist arglist;
-as_hashmap map1, map2; 
+	// Ring buffer of decoded records, waiting for the callback.
+	as_record** queue;
+	uint32_t capacity;
+	uint32_t head;
+	uint32_t size;
+} expbin_scanner;
 
 
 //==========================================================
-// Forward Declarations
+// Globals
 //
 
-as_val* as_expbin_get(aerospike* as, as_error* err, as_policy_apply* policy, as_key* key, as_list* arglist, as_val* result);
-void as_expbin_put(aerospike* as, as_error* err, as_policy_apply* policy, as_key* key, char* bin, as_val* val, uint64_t bin_ttl, as_val* result);
-void as_expbin_puts(aerospike* as, as_error* err, as_policy_apply* policy, as_key* key, as_list* arglist, as_val* result);
-void as_expbin_touch(aerospike* as, as_error* err, as_policy_apply* policy, as_key* key, as_list* arglist, as_val* result);
-as_val* as_expbin_ttl(aerospike* as, as_error* err, as_policy_apply* policy, as_key* key, char* bin_name, as_val* result);
-void as_expbin_clean(aerospike* as, as_error* err, as_policy_scan* policy, as_scan* scan, as_list* binlist);
-as_hashmap create_bin_map(char* bin_name, char* val, int64_t bin_ttl);
+// See as_expbin_set_listener().
+static const as_expbin_listener* expbin_listener = NULL;
 
-bool register_udf(aerospike* p_as, const char* udf_file_path);
-void cleanup(aerospike* as, as_error* err, as_policy_remove* policy, as_key* key);
-void example_dump_record(const as_record* p_rec);
-void example_cleanup(aerospike* p_as);
-void example_remove_test_records(aerospike* p_as);
-void example_remove_test_record(aerospike* p_as);
-
-void exp_example(void);
-void touch_example(void);
-void get_example(void);
+// Holds each thread's expbin_scratch, freed when the thread exits.
+static pthread_key_t expbin_scratch_key;
+static pthread_once_t expbin_scratch_once = PTHREAD_ONCE_INIT;
 
 
 //==========================================================
-// Expire Bin C Example
-//  
+// Local helpers
+//
 
-int
-main(int argc, char* argv[]) 
+static uint64_t
+expbin_now_ns(void)
 {
-	LOG("This is a demo of the expirable bin module for C:");
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Start timing a call, 0 if there is no listener to report to.
+static uint64_t
+expbin_op_begin(void)
+{
+	return __atomic_load_n(&expbin_listener, __ATOMIC_ACQUIRE) ? expbin_now_ns() : 0;
+}
 
-	strcpy(eb_namespace, DEFAULT_NAMESPACE);
-	strcpy(eb_set, DEFAULT_SET);
-	strcpy(eb_key_str, DEFAULT_KEY_STR);
+static uint32_t
+expbin_list_size(as_list* list)
+{
+	return list ? as_list_size(list) : 0;
+}
 
-	as_config_init(&config);
-	as_config_add_host(&config, "127.0.0.1", 3000);
-	aerospike_init(&as, &config);
+static bool
+expbin_count_rejected(const as_val* key, const as_val* val, void* udata)
+{
+	as_integer* status = as_integer_fromval(val);
 
-	LOG("Connecting to Aerospike server...");
-	
-	if (aerospike_connect(&as, &err) != AEROSPIKE_OK) {
-		LOG("error(%d) %s at [%s:%d]", err.code, err.message, err.file, err.line);
-		exit(1);
+	if (status && as_integer_get(status) == AS_EXPBIN_TOUCH_INVALID_TTL) {
+		(*(uint32_t*)udata)++;
 	}
+	return true;
+}
 
-	LOG("Connected!");
-	
-	// Start clean.
-	if (as_key_init_str(&testKey, eb_namespace, eb_set, eb_key_str) == NULL) {
-		LOG("Key was not initiated");
-		exit(1);
+// Add the outcomes of one call, from its status and UDF result. n_bins is the
+// number of bins a get asked for.
+static void
+expbin_classify(as_expbin_op op, as_status rc, as_val* result, uint32_t n_bins, uint32_t* outcomes)
+{
+	if (rc == AEROSPIKE_ERR_RECORD_NOT_FOUND) {
+		outcomes[AS_EXPBIN_OUTCOME_MISSING]++;
+		return;
+	}
+
+	// put_exp fails the command when the server refuses the bin TTL.
+	if (rc == AEROSPIKE_ERR_OP_NOT_APPLICABLE && op == AS_EXPBIN_OP_PUT_EXP) {
+		outcomes[AS_EXPBIN_OUTCOME_REJECTED]++;
+		return;
 	}
-	
-	aerospike_key_remove(&as, &err, NULL, &testKey);
 
-	LOG("Registering UDF...");
+	if (rc != AEROSPIKE_OK) {
+		outcomes[AS_EXPBIN_OUTCOME_ERROR]++;
+		return;
+	}
+
+	as_integer* i = as_integer_fromval(result);
+	as_map* map = as_map_fromval(result);
+
+	switch (op) {
+	case AS_EXPBIN_OP_GET:
+	case AS_EXPBIN_OP_GET_REPAIR:
+	case AS_EXPBIN_OP_GET_EXP:
+	case AS_EXPBIN_OP_GET_MANY:
+		// get returns 1 if the record doesn't exist.
+		if (map) {
+			uint32_t hits = as_map_size(map);
+			outcomes[AS_EXPBIN_OUTCOME_HIT] += hits;
+			outcomes[AS_EXPBIN_OUTCOME_EXPIRED] += n_bins > hits ? n_bins - hits : 0;
+		}
+		else {
+			outcomes[AS_EXPBIN_OUTCOME_MISSING]++;
+		}
+		break;
+
+	case AS_EXPBIN_OP_PUT:
+	case AS_EXPBIN_OP_PUTS:
+	case AS_EXPBIN_OP_TOUCH:
+	case AS_EXPBIN_OP_PUT_ELEM:
+		if (i && as_integer_get(i) != 0) {
+			outcomes[AS_EXPBIN_OUTCOME_REJECTED]++;
+		}
+		break;
+
+	case AS_EXPBIN_OP_TOUCH_BINS:
+		if (map) {
+			as_map_foreach(map, expbin_count_rejected, &outcomes[AS_EXPBIN_OUTCOME_REJECTED]);
+		}
+		else {
+			outcomes[AS_EXPBIN_OUTCOME_MISSING]++;
+		}
+		break;
+
+	case AS_EXPBIN_OP_TTL:
+		outcomes[i ? AS_EXPBIN_OUTCOME_HIT : AS_EXPBIN_OUTCOME_EXPIRED]++;
+		break;
+
+	case AS_EXPBIN_OP_GET_ELEMS:
+		if (map) {
+			outcomes[AS_EXPBIN_OUTCOME_HIT] += as_map_size(map);
+		}
+		else {
+			outcomes[AS_EXPBIN_OUTCOME_MISSING]++;
+		}
+		break;
+
+	case AS_EXPBIN_OP_CLEAN_RECORD:
+	case AS_EXPBIN_OP_TRIM:
+		if (i) {
+			outcomes[AS_EXPBIN_OUTCOME_RECLAIMED] += (uint32_t)as_integer_get(i);
+		}
+		else {
+			outcomes[AS_EXPBIN_OUTCOME_MISSING]++;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+// Report a call started by expbin_op_begin() to the listener.
+static void
+expbin_op_report(as_expbin_op op, uint64_t begin, const uint32_t* outcomes)
+{
+	const as_expbin_listener* listener = __atomic_load_n(&expbin_listener, __ATOMIC_ACQUIRE);
 
-	if (!register_udf(&as, UDF_FILE_PATH)) {
-		LOG("Error registering UDF!")
-		cleanup(&as, &err, NULL, &testKey);
-		exit(-1);
+	if (!listener) {
+		return;
 	}
 
-	LOG("UDF registered!");
+	listener->on_latency(op, expbin_now_ns() - begin, listener->udata);
 
-	// Example 1: validates the basic bin expiration.
-	exp_example();
+	for (uint32_t o = 0; o < AS_EXPBIN_OUTCOME_COUNT; o++) {
+		if (outcomes[o]) {
+			listener->on_outcome(op, (as_expbin_outcome)o, outcomes[o], listener->udata);
+		}
+	}
+}
 
-	// Example 2: validates the basic bin expiration after using 'touch'.
-	touch_example();
+// Classify and report a key call started by expbin_op_begin(). The result is
+// only looked at if the call succeeded.
+static void
+expbin_op_end(as_expbin_op op, uint64_t begin, as_status rc, as_val** result, uint32_t n_bins)
+{
+	if (begin == 0) {
+		return;
+	}
 
-	// Example 3: shows the difference between normal 'get' and 'eb.get'.
-	get_example();
+	uint32_t outcomes[AS_EXPBIN_OUTCOME_COUNT] = { 0 };
 
-	aerospike_close(&as, &err);
-	aerospike_destroy(&as);
+	expbin_classify(op, rc, (rc == AEROSPIKE_OK && result) ? *result : NULL, n_bins, outcomes);
+	expbin_op_report(op, begin, outcomes);
+}
 
-	LOG("Demo of the expirable bin module for C successfully completed");
+// Report an async call, then hand its result to the user listener.
+static void
+expbin_async_listener(as_error* err, as_val* val, void* udata, as_event_loop* event_loop)
+{
+	expbin_async_data* data = (expbin_async_data*)udata;
 
-	return 0;
+	expbin_op_end(data->op, data->begin, err ? err->code : AEROSPIKE_OK, &val, data->n_bins);
+	data->listener(err, val, data->udata, event_loop);
+	free(data);
 }
 
-/*
- * Attempt to retrieve values from list of bins. The bins
- * can be expire bins or normal bins.
- *
- * \param as      - The aerospike instance to use for this operation.
- * \param err     - The as_error to be populated if an error occurs.
- * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
- * \param key     - The key of the record.
- * \param arglist - The list of bin names to retrieve values from.
- * \param result  - A list of bin values respective to the list of bin names passed in. 
- *                  If a bin is expired or empty, the corresponding index in the list will be NULL.
- * \return        - result if successful, an error otherwise.
- */
-as_val* 
-as_expbin_get(aerospike* as, as_error* err, as_policy_apply* policy, as_key* key, as_list* arglist, as_val* result)
-{
-	as_status rc = aerospike_key_apply(as, err, policy, key, UDF_MODULE, "get", arglist, &result);
-	
+// Queue a UDF apply, wrapping listener to report the call when a listener is
+// set. Without one, or if the wrapper can't be allocated, the call goes out
+// unreported.
+static as_status
+expbin_apply_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_expbin_op op, const char* function, as_list* arglist, uint32_t n_bins, as_async_value_listener listener, void* udata, as_event_loop* event_loop)
+{
+	uint64_t begin = expbin_op_begin();
+	expbin_async_data* data = begin ? (expbin_async_data*)malloc(sizeof(expbin_async_data)) : NULL;
+
+	if (!data) {
+		return aerospike_key_apply_async(as, err, policy, key, AS_EXPBIN_MODULE, function, arglist, listener, udata, event_loop, NULL);
+	}
+
+	data->listener = listener;
+	data->udata = udata;
+	data->op = op;
+	data->begin = begin;
+	data->n_bins = n_bins;
+
+	as_status rc = aerospike_key_apply_async(as, err, policy, key, AS_EXPBIN_MODULE, function, arglist, expbin_async_listener, data, event_loop, NULL);
+
+	// The listener is only called once the command was queued.
 	if (rc != AEROSPIKE_OK) {
-		LOG("as_expbin_get() returned %d - %s", err->code, err->message);
-		exit(1);
+		expbin_op_end(op, begin, rc, NULL, n_bins);
+		free(data);
 	}
+	return rc;
+}
+
+// Unwrap the UDF result of each key and hand it to the user callback.
+static bool
+expbin_get_many_listener(const as_batch_result* results, uint32_t n, void* udata)
+{
+	expbin_get_many_data* data = (expbin_get_many_data*)udata;
+
+	for (uint32_t i = 0; i < n; i++) {
+		const as_batch_result* res = &results[i];
+		as_status status = res->result;
+		as_map* bins = NULL;
+
+		if (status == AEROSPIKE_OK) {
+			// get returns the bin map, or 1 if the record doesn't exist.
+			bins = as_map_fromval((as_val*)as_record_get(&res->record, "SUCCESS"));
+
+			if (!bins) {
+				status = AEROSPIKE_ERR_RECORD_NOT_FOUND;
+			}
+		}
+
+		if (data->begin) {
+			expbin_classify(AS_EXPBIN_OP_GET_MANY, status, (as_val*)bins, data->n_bins, data->outcomes);
+		}
 
-	return result;
+		if (!data->callback(res->key, status, bins, data->udata)) {
+			return false;
+		}
+	}
+	return true;
 }
 
-/*
- * Create or update expire bins. If bin_ttl is not NULL, all newly created bins
- * will be expire bins, otherwise, only normal bins will be created and existing 
- * expire bins will be updated. Note: existing expire bins will not be converted
- * into normal bins if bin_ttl is NULL.
- *
- * \param as      - The aerospike instance to use for this operation.
- * \param err     - The as_error to be populated if an error occurs.
- * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
- * \param key     - The key of the record.
- * \param bin     - Bin name.
- * \param val     - Bin value.
- * \param bin_ttl - Expiration time in seconds or -1 for no expiration.
- * \param result  - 0 if successfully written, 1 otherwise.
- * \return        - void if successful, an error otherwise.
- */
-void
-as_expbin_put(aerospike* as, as_error* err, as_policy_apply* policy, as_key* key, char* bin, as_val* val, uint64_t bin_ttl, as_val* result)
+
+// The whole bin if it is a live expbin [EXPBIN_TAG, expiry, data], unknown
+// otherwise.
+static as_exp*
+expbin_live_list_exp(const char* bin)
 {
-	as_arraylist arglist;
-	as_arraylist_inita(&arglist, 4);
-	as_arraylist_append_str(&arglist, bin);
-	as_arraylist_append(&arglist, val);
-	as_arraylist_append_int64(&arglist, bin_ttl);
+	as_exp_build(exp,
+		as_exp_cond(
+			as_exp_cmp_eq(as_exp_bin_type(bin), as_exp_int(AS_BYTES_LIST)),
+			as_exp_cond(
+				as_exp_and(
+					as_exp_cmp_eq(as_exp_list_size(NULL, as_exp_bin_list(bin)), as_exp_int(3)),
+					as_exp_cmp_eq(
+						as_exp_list_get_by_index(NULL, AS_LIST_RETURN_VALUE, AS_EXP_TYPE_INT, as_exp_int(0), as_exp_bin_list(bin)),
+						as_exp_int(EXPBIN_TAG)),
+					EXPBIN_EXP_LIVE(
+						as_exp_list_get_by_index(NULL, AS_LIST_RETURN_VALUE, AS_EXP_TYPE_INT, as_exp_int(1), as_exp_bin_list(bin)))),
+				as_exp_bin_list(bin),
+				as_exp_unknown()),
+			as_exp_unknown()));
+
+	return exp;
+}
 
-	as_status rc = aerospike_key_apply(as, err, policy, key, UDF_MODULE, "put", (as_list*)&arglist, &result);
-	
-	if (rc != AEROSPIKE_OK) {
-		LOG("as_expbin_put() returned %d - %s", err->code, err->message);
-		exit(1);
+// The whole bin if it is a live expbin in the older map format, unknown
+// otherwise.
+static as_exp*
+expbin_live_map_exp(const char* bin)
+{
+	as_exp_build(exp,
+		as_exp_cond(
+			as_exp_cmp_eq(as_exp_bin_type(bin), as_exp_int(AS_BYTES_MAP)),
+			as_exp_cond(
+				EXPBIN_EXP_LIVE(
+					as_exp_map_get_by_key(NULL, AS_MAP_RETURN_VALUE, AS_EXP_TYPE_INT, as_exp_str(EXPBIN_ID), as_exp_bin_map(bin))),
+				as_exp_bin_map(bin),
+				as_exp_unknown()),
+			as_exp_unknown()));
+
+	return exp;
+}
+
+
+// Expiry of a bin written now with bin_ttl.
+#define EXPBIN_EXP_EXPIRY(__bin_ttl) \
+	as_exp_cond(as_exp_bool(__bin_ttl == -1), as_exp_int(0), as_exp_add(EXPBIN_EXP_NOW, as_exp_int(__bin_ttl)))
+
+// The expiry summary with bin about to be written with bin_ttl, or nil if
+// the record has no summary yet. The summary must be updated before the bin
+// so that the bin still holds its old value. An expbin or element bin being
+// overwritten is already counted.
+static as_exp*
+expbin_put_meta_exp(const char* bin, int64_t bin_ttl)
+{
+	as_exp_build(exp,
+		as_exp_cond(
+			as_exp_cmp_eq(as_exp_bin_type(EXPBIN_META), as_exp_int(AS_BYTES_LIST)),
+			as_exp_list_set(NULL, NULL, as_exp_int(1),
+				as_exp_add(
+					as_exp_list_get_by_index(NULL, AS_LIST_RETURN_VALUE, AS_EXP_TYPE_INT, as_exp_int(1), as_exp_bin_list(EXPBIN_META)),
+					as_exp_cond(
+						as_exp_or(EXPBIN_EXP_IS_EXPBIN(bin), EXPBIN_EXP_IS_ELEMBIN(bin)), as_exp_int(0),
+						as_exp_int(1))),
+				as_exp_list_set(NULL, NULL, as_exp_int(0),
+					EXPBIN_EXP_MIN_EXPIRY(
+						as_exp_list_get_by_index(NULL, AS_LIST_RETURN_VALUE, AS_EXP_TYPE_INT, as_exp_int(0), as_exp_bin_list(EXPBIN_META)),
+						EXPBIN_EXP_EXPIRY(bin_ttl)),
+					as_exp_bin_list(EXPBIN_META))),
+			as_exp_nil()));
+
+	return exp;
+}
+
+// True if ttl is a record TTL in seconds rather than one of the special
+// values.
+static inline bool
+expbin_explicit_ttl(uint32_t ttl)
+{
+	return ttl != AS_RECORD_DEFAULT_TTL && ttl != AS_RECORD_NO_EXPIRE_TTL &&
+		ttl != AS_RECORD_NO_CHANGE_TTL && ttl != AS_RECORD_CLIENT_DEFAULT_TTL;
+}
+
+// The new expbin holding the value of the literal list [EXPBIN_TAG, 0, val],
+// written with the record TTL ttl, or unknown if the bin_ttl check fails.
+// ttl_ok skips the check on the server. It is also unknown, so that the put
+// UDF writes the bin instead, if:
+// - the bin expires before the expiry bucket of the record, or the record
+//   has no bucket because its summary says none of its bins expire: only
+//   the UDF knows the bucket size to move the bucket to, and a bucket moved
+//   to the exact expiry would rewrite the index entry on every such write.
+// - the bin never expires but the record would: what to do about it depends
+//   on the TTL_MODE of the UDF.
+static as_exp*
+expbin_put_bin_exp(as_list* literal, int64_t bin_ttl, uint32_t ttl, bool ttl_ok)
+{
+	// A record that never expires reports a TTL <= 0.
+	as_exp_build(exp,
+		as_exp_cond(
+			as_exp_and(
+				as_exp_bool(bin_ttl == -1 && ttl != AS_RECORD_NO_EXPIRE_TTL),
+				as_exp_or(
+					as_exp_bool(expbin_explicit_ttl(ttl)),
+					as_exp_cmp_gt(as_exp_ttl(), as_exp_int(0)))),
+			as_exp_unknown(),
+			as_exp_and(
+				as_exp_bool(bin_ttl != -1),
+				as_exp_cond(
+					as_exp_cmp_eq(as_exp_bin_type(EXPBIN_DUE), as_exp_int(AS_BYTES_INTEGER)),
+					as_exp_cmp_lt(EXPBIN_EXP_EXPIRY(bin_ttl), as_exp_bin_int(EXPBIN_DUE)),
+					as_exp_cmp_eq(as_exp_bin_type(EXPBIN_META), as_exp_int(AS_BYTES_LIST)),
+					as_exp_cmp_eq(
+						as_exp_list_get_by_index(NULL, AS_LIST_RETURN_VALUE, AS_EXP_TYPE_INT, as_exp_int(0), as_exp_bin_list(EXPBIN_META)),
+						as_exp_int(0)),
+					as_exp_bool(false))),
+			as_exp_unknown(),
+			as_exp_or(
+				as_exp_bool(ttl_ok),
+				as_exp_cmp_le(as_exp_ttl(), as_exp_int(0)),
+				as_exp_cmp_le(as_exp_int(bin_ttl), as_exp_ttl())),
+			as_exp_list_set(NULL, NULL, as_exp_int(1), EXPBIN_EXP_EXPIRY(bin_ttl), as_exp_val(literal)),
+			as_exp_unknown()));
+
+	return exp;
+}
+
+
+// Read the live expbins of a record with one operate command. The result of
+// bins[i] is in the record bins "l<i>" (list format) and "m<i>" (map format).
+static as_status
+expbin_operate_exp(aerospike* as, as_error* err, const as_policy_operate* policy, const as_key* key, const char* bins[], uint32_t n_bins, as_record** rec)
+{
+	// The operations only point at the packed expressions, so keep them until
+	// the command is done.
+	as_exp** exps = (as_exp**)malloc(sizeof(as_exp*) * n_bins * 2);
+
+	if (!exps) {
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to allocate bin expressions");
+	}
+
+	char name[AS_BIN_NAME_MAX_SIZE];
+
+	as_operations ops;
+	as_operations_inita(&ops, n_bins * 2);
+
+	// The result names are indexes into bins, so they never clash with each other.
+	for (uint32_t i = 0; i < n_bins; i++) {
+		exps[i * 2] = expbin_live_list_exp(bins[i]);
+		snprintf(name, sizeof(name), "l%u", i);
+		as_operations_exp_read(&ops, name, exps[i * 2], AS_EXP_READ_EVAL_NO_FAIL);
+
+		exps[i * 2 + 1] = expbin_live_map_exp(bins[i]);
+		snprintf(name, sizeof(name), "m%u", i);
+		as_operations_exp_read(&ops, name, exps[i * 2 + 1], AS_EXP_READ_EVAL_NO_FAIL);
 	}
+
+	as_status rc = aerospike_key_operate(as, err, policy, key, &ops, rec);
+
+	as_operations_destroy(&ops);
+
+	for (uint32_t i = 0; i < n_bins * 2; i++) {
+		as_exp_destroy(exps[i]);
+	}
+
+	free(exps);
+	return rc;
 }
 
-/* Batch create or update expire bins for a given key. Use the as_map:
- * {'bin' : bin_name, 'val' : bin_value, 'bin_ttl' : ttl} to store each put operation.
- * Omit the bin_ttl to turn bin creation off.
- *
- * \param as      - The aerospike instance to use for this operation.
- * \param err     - The as_error to be populated if an error occurs.
- * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
- * \param key     - The key of the record.
- * \param arglist - The list of as_maps in the following form: {'bin' : bin_name, 'val' : bin_value, 'bin_ttl' : ttl}.
- * \param result  - 0 if all ops succeed, 1 otherwise.
- * \return        - void if successful, an error otherwise.
- */
-void 
-as_expbin_puts(aerospike* as, as_error* err, as_policy_apply* policy, as_key* key, as_list* arglist, as_val* result) 
-{
-	as_status rc = aerospike_key_apply(as, err, policy, key, UDF_MODULE, "puts", arglist, &result);
-	
-	if (rc != AEROSPIKE_OK) {
-		LOG("as_expbin_puts() returned %d - %s", err->code, err->message);
-		exit(1);
+// Get the data and expiry of bins[i] from a record read by
+// expbin_operate_exp(). Returns false if the bin is not a live expbin. The
+// data is owned by rec.
+static bool
+expbin_live_entry(as_record* rec, uint32_t i, as_val** data, int64_t* expiry)
+{
+	char name[AS_BIN_NAME_MAX_SIZE];
+
+	snprintf(name, sizeof(name), "l%u", i);
+	as_list* list = as_record_get_list(rec, name);
+
+	if (list) {
+		*data = as_list_get(list, 2);
+
+		if (expiry) {
+			*expiry = as_list_get_int64(list, 1);
+		}
+		return *data != NULL;
+	}
+
+	snprintf(name, sizeof(name), "m%u", i);
+	as_map* legacy = as_record_get_map(rec, name);
+
+	if (legacy) {
+		*data = as_stringmap_get(legacy, EXPBIN_DATA);
+
+		if (expiry) {
+			*expiry = as_stringmap_get_int64(legacy, EXPBIN_ID);
+		}
+		return *data != NULL;
 	}
+	return false;
 }
 
-/*
- * Batch update the bin TTLs. Us this method to change or reset the bin TTL of
- * multiple bins in a record. 
- *
- * \param as      - The aerospike instance to use for this operation.
- * \param err     - The as_error to be populated if an error occurs.
- * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
- * \param key     - The key of the record.
- * \param arglist - The list of bin names.
- * \param result  - 0 if all ops succeed, 1 otherwise.
- * \return        - void if successful, an error otherwise.
- */
-void 
-as_expbin_touch(aerospike* as, as_error* err, as_policy_apply* policy, as_key* key, as_list* arglist, as_val* result) 
-{
-	as_status rc = aerospike_key_apply(as, err, policy, key, UDF_MODULE, "touch", arglist, &result);
-	
-	if (rc != AEROSPIKE_OK) {
-		LOG("as_expbin_touch() returned %d - %s", err->code, err->message);	
-		exit(1);
+// Arguments of get_repair: the repair interval followed by the bin names.
+// args must have room for them, and interval must live as long as args.
+static void
+expbin_repair_args(as_arraylist* args, as_integer* interval, uint32_t repair_interval, as_list* arglist)
+{
+	uint32_t n_bins = expbin_list_size(arglist);
+
+	as_integer_init(interval, repair_interval);
+	as_arraylist_append(args, (as_val*)interval);
+
+	for (uint32_t i = 0; i < n_bins; i++) {
+		as_val* bin = as_list_get(arglist, i);
+		as_val_reserve(bin);
+		as_arraylist_append(args, bin);
 	}
 }
 
-/*
- * Get bin TTL in seconds.
- *
- * \param as      - The aerospike instance to use for this operation.
- * \param err     - The as_error to be populated if an error occurs.
- * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
- * \param key     - The key of the record.
- * \param arglist - The bin name to check.
- * \param result  - Bin time to expire in seconds.
- * \return        - result if successful, an error otherwise.
- */
-as_val*
-as_expbin_ttl(aerospike* as, as_error* err, as_policy_apply* policy, as_key* key, char* bin_name, as_val* result) 
+//----------------------------------------------------------
+// Bin op arguments
+//
+
+static void
+expbin_scratch_init_key(void)
+{
+	pthread_key_create(&expbin_scratch_key, free);
+}
+
+// The calling thread's scratch space, with room for at least n ops.
+static expbin_scratch*
+expbin_scratch_get(uint32_t n)
+{
+	pthread_once(&expbin_scratch_once, expbin_scratch_init_key);
+
+	expbin_scratch* scratch = (expbin_scratch*)pthread_getspecific(expbin_scratch_key);
+
+	if (scratch && scratch->capacity >= n) {
+		return scratch;
+	}
+
+	uint32_t capacity = scratch ? scratch->capacity : 16;
+
+	while (capacity < n) {
+		capacity *= 2;
+	}
+
+	expbin_scratch* grown = (expbin_scratch*)malloc(sizeof(expbin_scratch) +
+		capacity * (sizeof(expbin_op_args) + sizeof(as_val*)));
+
+	if (!grown) {
+		return NULL;
+	}
+
+	free(scratch);
+	grown->capacity = capacity;
+	grown->ops = (as_val**)&grown->args[capacity];
+	pthread_setspecific(expbin_scratch_key, grown);
+	return grown;
+}
+
+// as_arraylist_inita() over storage that outlives the calling frame.
+static void
+expbin_arraylist_wrap(as_arraylist* list, as_val** elements, uint32_t capacity)
+{
+	as_arraylist_init(list, 0, 0);
+	list->free = false;
+	list->capacity = capacity;
+	list->size = 0;
+	list->elements = elements;
+}
+
+// Build the UDF argument list of bin ops, [[bin, val, bin_ttl], ...] or
+// [[bin, bin_ttl], ...] without values, in the calling thread's scratch
+// space. Nothing is allocated apart from growing the scratch space, and the
+// list is only valid until the thread's next bin op call.
+static as_status
+expbin_op_arglist(as_error* err, const as_expbin_bin_op* ops, uint32_t n_ops, bool with_val, as_arraylist* arglist)
 {
+	expbin_scratch* scratch = expbin_scratch_get(n_ops);
+
+	if (!scratch) {
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to allocate bin op arguments");
+	}
+
+	expbin_arraylist_wrap(arglist, scratch->ops, n_ops);
+
+	for (uint32_t i = 0; i < n_ops; i++) {
+		expbin_op_args* args = &scratch->args[i];
+
+		as_string_init(&args->bin, (char*)ops[i].bin, false);
+		as_integer_init(&args->bin_ttl, ops[i].bin_ttl);
+
+		expbin_arraylist_wrap(&args->list, args->elements, 3);
+		as_arraylist_append(&args->list, (as_val*)&args->bin);
+
+		// as_nil is never reference counted.
+		if (with_val) {
+			as_arraylist_append(&args->list, ops[i].val ? as_val_reserve(ops[i].val) : (as_val*)&as_nil);
+		}
+
+		as_arraylist_append(&args->list, (as_val*)&args->bin_ttl);
+		as_arraylist_append(arglist, (as_val*)&args->list);
+	}
+	return AEROSPIKE_OK;
+}
+
+// Apply a bin op UDF function to a record.
+static as_status
+expbin_apply_ops(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_expbin_op op,
+	const char* function, const as_expbin_bin_op* ops, uint32_t n_ops, bool with_val, as_val** result)
+{
+	uint64_t begin = expbin_op_begin();
 	as_arraylist arglist;
-	as_arraylist_inita(&arglist, 1);
-	as_arraylist_append_str(&arglist, bin_name);
+	as_status rc = expbin_op_arglist(err, ops, n_ops, with_val, &arglist);
 
-	as_status rc = aerospike_key_apply(as, err, policy, key, UDF_MODULE, "ttl", (as_list*) &arglist, &result);
-	
 	if (rc != AEROSPIKE_OK) {
-		LOG("as_expbin_ttl() returned %d - %s", err->code, err->message);
-		exit(1);	
+		expbin_op_end(op, begin, rc, NULL, 0);
+		return rc;
 	}
 
-	return result;
+	rc = aerospike_key_apply(as, err, policy, key, AS_EXPBIN_MODULE, function, (as_list*)&arglist, result);
+
+	as_arraylist_destroy(&arglist);
+	expbin_op_end(op, begin, rc, result, 0);
+	return rc;
 }
 
-/* 
- * Perform a background scan and remove all expired bins.
- * 
- * \param as      - The aerospike instance to use for this operation.
- * \param err     - The as_error to be populated if an error occurs.
- * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
- * \param scan    - as_scan to execute scan on.
- * \param binlist - List of bins to clean.
- * \return        - void if successful, an error otherwise.
- */
-void
-as_expbin_clean(aerospike* as, as_error* err, as_policy_scan* policy, as_scan* scan, as_list* binlist)
+//----------------------------------------------------------
+// Partition clean
+//
+
+// Mark the partitions listed in the checkpoint file as done. A last line cut
+// short by a crash has no newline and is ignored.
+static void
+expbin_load_checkpoint(const char* path, bool* done)
 {
-	uint64_t scan_id = 0;
-	as_scan_init(scan, eb_namespace, eb_set);
+	FILE* f = fopen(path, "r");
 
-	if (as_scan_apply_each(scan, UDF_MODULE, "clean", binlist) != true) {
-		LOG("UDF apply failed");
-		exit(1);
+	if (!f) {
+		return;
 	}
 
-	as_status rc = aerospike_scan_background(as, err, policy, scan, &scan_id);
-	aerospike_scan_wait(as, err, NULL, scan_id, 0);
+	char line[32];
 
-	if (rc != AEROSPIKE_OK) {
-		LOG("as_expbin_clean() returned %d - %s", err->code, err->message);
-		exit(1);
-	} 
+	while (fgets(line, sizeof(line), f)) {
+		char* end;
+		unsigned long id = strtoul(line, &end, 10);
+
+		if (end != line && *end == '\n' && id < AS_PARTITIONS) {
+			done[id] = true;
+		}
+	}
+
+	fclose(f);
 }
 
-/*
- * Generate maps for use with batch put and touch operations.
- *
- * \param bin_name - name of bin to perform op on.
- * \param val      - value of bin.
- * \param bin_ttl  - bin_ttl for bin (-1 for no expiration, 0 to create normal bin).
- * \return         - as_hashmap.
- */
-as_hashmap 
-create_bin_map(char* bin_name, char* val, int64_t bin_ttl) 
+// Record the first error and stop handing out partitions.
+static void
+expbin_cleaner_fail(expbin_cleaner* cleaner, as_error* err)
 {
-	as_hashmap map;
-	as_hashmap_init(&map, 1);
-	as_stringmap_set_str((as_map *) &map, "bin", bin_name);
-	as_stringmap_set_str((as_map *) &map, "val", val);
-	as_stringmap_set_int64((as_map *) &map, "bin_ttl", bin_ttl);
+	pthread_mutex_lock(&cleaner->lock);
 
-	return map;
+	if (cleaner->rc == AEROSPIKE_OK) {
+		as_error_copy(&cleaner->err, err);
+		__atomic_store_n(&cleaner->rc, err->code, __ATOMIC_RELEASE);
+	}
+
+	cleaner->next = cleaner->n_pending;
+	pthread_mutex_unlock(&cleaner->lock);
 }
 
-//==========================================================
-// Helpers
+// Clean each record found by a partition scan.
+static bool
+expbin_cleaner_scan_callback(const as_val* val, void* udata)
+{
+	expbin_cleaner* cleaner = (expbin_cleaner*)udata;
+
+	if (!val) {
+		return true;
+	}
+
+	// Stop the scan once another worker has failed.
+	if (__atomic_load_n(&cleaner->rc, __ATOMIC_ACQUIRE) != AEROSPIKE_OK) {
+		return false;
+	}
+
+	as_record* rec = as_record_fromval(val);
+
+	as_error err;
+	as_val* result = NULL;
+	uint64_t begin = expbin_op_begin();
+	as_status rc = aerospike_key_apply(cleaner->as, &err, cleaner->apply_policy, &rec->key, AS_EXPBIN_MODULE,
+		cleaner->function, cleaner->config->binlist, &result);
+
+	expbin_op_end(AS_EXPBIN_OP_CLEAN_RECORD, begin, rc, &result, 0);
+
+	as_integer* removed = as_integer_fromval(result);
+
+	pthread_mutex_lock(&cleaner->lock);
+
+	// The record may have been removed since the scan saw it. Any other
+	// failure, such as a timeout, only skips the record.
+	if (rc == AEROSPIKE_OK) {
+		cleaner->progress.records++;
+	}
+	else if (rc != AEROSPIKE_ERR_RECORD_NOT_FOUND) {
+		cleaner->progress.failed++;
+	}
+
+	if (removed) {
+		cleaner->progress.bins_removed += as_integer_get(removed);
+	}
+
+	pthread_mutex_unlock(&cleaner->lock);
+
+	as_val_destroy(result);
+	return true;
+}
+
+static void*
+expbin_cleaner_worker(void* udata)
+{
+	expbin_cleaner* cleaner = (expbin_cleaner*)udata;
+	const as_expbin_clean_config* config = cleaner->config;
+
+	while (true) {
+		pthread_mutex_lock(&cleaner->lock);
+
+		if (cleaner->next >= cleaner->n_pending) {
+			pthread_mutex_unlock(&cleaner->lock);
+			break;
+		}
+
+		uint16_t id = cleaner->pending[cleaner->next++];
+		pthread_mutex_unlock(&cleaner->lock);
+
+		as_scan scan;
+		as_scan_init(&scan, config->ns, config->set ? config->set : "");
+		as_scan_set_nobins(&scan, true);
+
+		as_partition_filter pf;
+		as_partition_filter_set_id(&pf, id);
+
+		as_error err;
+		as_status rc = aerospike_scan_partitions(cleaner->as, &err, &cleaner->scan_policy, &scan, &pf,
+			expbin_cleaner_scan_callback, cleaner);
+
+		as_scan_destroy(&scan);
+
+		if (rc != AEROSPIKE_OK) {
+			// An aborted scan has already recorded the error that stopped it.
+			if (rc != AEROSPIKE_ERR_CLIENT_ABORT) {
+				expbin_cleaner_fail(cleaner, &err);
+			}
+			break;
+		}
+
+		pthread_mutex_lock(&cleaner->lock);
+
+		if (cleaner->checkpoint) {
+			fprintf(cleaner->checkpoint, "%u\n", id);
+			fflush(cleaner->checkpoint);
+		}
+
+		cleaner->progress.partitions_done++;
+
+		if (config->progress_callback) {
+			config->progress_callback(&cleaner->progress, config->udata);
+		}
+
+		pthread_mutex_unlock(&cleaner->lock);
+	}
+	return NULL;
+}
+
+//----------------------------------------------------------
+// Live scan
 //
 
-// Register a UDF function in the database.
-bool
-register_udf(aerospike* p_as, const char* udf_file_path)
+// Copy the key of a scanned record: namespace, set, digest, and the user key
+// if it was stored with the record. Returns false if the user key couldn't
+// be copied.
+static bool
+expbin_copy_key(as_key* dst, const as_key* src)
 {
-	FILE* file = fopen(udf_file_path, "r");
+	as_key_value* value = src->valuep;
+
+	switch (value ? as_val_type(value) : AS_UNDEF) {
+	case AS_INTEGER:
+		as_key_init_int64(dst, src->ns, src->set, value->integer.value);
+		break;
+
+	case AS_STRING: {
+		char* str = strdup(value->string.value);
 
-	if (!file) {
-		// If we get here it's likely that we're not running the example from
-		// the right directory - the specific example directory.
-		LOG("cannot open script file %s : %s", udf_file_path, strerror(errno));
+		if (!str) {
+			return false;
+		}
+
+		as_key_init_strp(dst, src->ns, src->set, str, true);
+		break;
+	}
+
+	case AS_BYTES: {
+		uint8_t* bytes = (uint8_t*)malloc(value->bytes.size);
+
+		if (!bytes) {
+			return false;
+		}
+
+		memcpy(bytes, value->bytes.value, value->bytes.size);
+		as_key_init_rawp(dst, src->ns, src->set, bytes, value->bytes.size, true);
+		break;
+	}
+
+	default:
+		as_key_init_digest(dst, src->ns, src->set, src->digest.value);
+		return true;
+	}
+
+	dst->digest = src->digest;
+	return true;
+}
+
+// Copy of a scanned record holding its live bins, with expire bins unwrapped,
+// element bins turned into maps of their live elements and the module's own
+// bins left out, or NULL if no bin is left. Other bin values are shared with
+// rec, not copied. Returns false if memory couldn't be allocated.
+static bool
+expbin_live_record(const as_record* rec, uint32_t now, as_record** result)
+{
+	as_record* live = NULL;
+	bool failed = false;
+
+	for (uint16_t i = 0; i < rec->bins.size; i++) {
+		const as_bin* bin = &rec->bins.entries[i];
+		const char* name = as_bin_get_name(bin);
+		as_val* val = (as_val*)as_bin_get_value(bin);
+		uint32_t expiry;
+		as_val* data;
+		as_map* elems = NULL;
+
+		if (strcmp(name, EXPBIN_META) == 0 || strcmp(name, EXPBIN_DUE) == 0) {
+			continue;
+		}
+
+		if (as_expbin_decode(val, &expiry, &data)) {
+			if (!as_expbin_live(expiry, now)) {
+				continue;
+			}
+			val = data;
+		}
+		else if (as_expbin_decode_elems(val, now, &elems, &failed)) {
+			if (failed) {
+				break;
+			}
+
+			if (!elems) {
+				continue;
+			}
+			val = (as_val*)elems;
+		}
+
+		if (!val || as_val_type(val) == AS_NIL) {
+			continue;
+		}
+
+		if (val != (as_val*)elems) {
+			as_val_reserve(val);
+		}
+
+		if (!live) {
+			live = as_record_new(rec->bins.size);
+
+			if (!live) {
+				as_val_destroy(val);
+				failed = true;
+				break;
+			}
+		}
+
+		as_record_set(live, name, (as_bin_value*)val);
+	}
+
+	if (live && !failed) {
+		failed = !expbin_copy_key(&live->key, &rec->key);
+		live->gen = rec->gen;
+		live->ttl = rec->ttl;
+	}
+
+	if (failed) {
+		as_record_destroy(live);
+		live = NULL;
+	}
+
+	*result = live;
+	return !failed;
+}
+
+// Record the first error and stop the workers.
+static void
+expbin_scanner_fail(expbin_scanner* scanner, as_error* err)
+{
+	pthread_mutex_lock(&scanner->lock);
+
+	if (scanner->rc == AEROSPIKE_OK) {
+		scanner->rc = err->code;
+		as_error_copy(&scanner->err, err);
+	}
+
+	__atomic_store_n(&scanner->stopped, true, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&scanner->not_full);
+	pthread_cond_signal(&scanner->not_empty);
+	pthread_mutex_unlock(&scanner->lock);
+}
+
+// Decode each record found by a partition scan and queue it for the callback,
+// waiting while the queue is full.
+static bool
+expbin_scanner_scan_callback(const as_val* val, void* udata)
+{
+	expbin_scanner* scanner = (expbin_scanner*)udata;
+
+	if (!val) {
+		return true;
+	}
+
+	as_record* rec;
+
+	if (!expbin_live_record(as_record_fromval(val), as_expbin_now(), &rec)) {
+		as_error err;
+		as_error_init(&err);
+		as_error_update(&err, AEROSPIKE_ERR_CLIENT, "Failed to allocate a scanned record");
+		expbin_scanner_fail(scanner, &err);
 		return false;
 	}
 
-	// Read the file's content into a local buffer.
+	if (!rec) {
+		return !__atomic_load_n(&scanner->stopped, __ATOMIC_ACQUIRE);
+	}
+
+	pthread_mutex_lock(&scanner->lock);
 
-	uint8_t* content = (uint8_t*)malloc(1024 * 1024);
+	while (scanner->size == scanner->capacity && !scanner->stopped) {
+		pthread_cond_wait(&scanner->not_full, &scanner->lock);
+	}
 
-	if (!content) {
-		LOG("script content allocation failed");
+	if (scanner->stopped) {
+		pthread_mutex_unlock(&scanner->lock);
+		as_record_destroy(rec);
 		return false;
 	}
 
-	uint8_t* p_write = content;
-	int read = (int)fread(p_write, 1, 512, file);
-	int size = 0;
+	scanner->queue[(scanner->head + scanner->size) % scanner->capacity] = rec;
+	scanner->size++;
+	pthread_cond_signal(&scanner->not_empty);
+	pthread_mutex_unlock(&scanner->lock);
+	return true;
+}
+
+static void*
+expbin_scanner_worker(void* udata)
+{
+	expbin_scanner* scanner = (expbin_scanner*)udata;
+	const as_expbin_scan_config* config = scanner->config;
+
+	while (true) {
+		pthread_mutex_lock(&scanner->lock);
+
+		if (scanner->stopped || scanner->next >= AS_PARTITIONS) {
+			pthread_mutex_unlock(&scanner->lock);
+			break;
+		}
+
+		uint16_t id = (uint16_t)scanner->next++;
+		pthread_mutex_unlock(&scanner->lock);
+
+		as_scan scan;
+		as_scan_init(&scan, config->ns, config->set ? config->set : "");
+
+		if (config->bins) {
+			as_scan_select_init(&scan, (uint16_t)config->n_bins);
+
+			for (uint32_t i = 0; i < config->n_bins; i++) {
+				as_scan_select(&scan, config->bins[i]);
+			}
+		}
+
+		as_partition_filter pf;
+		as_partition_filter_set_id(&pf, id);
 
-	while (read) {
-		size += read;
-		p_write += read;
-		read = (int)fread(p_write, 1, 512, file);
+		as_error err;
+		as_status rc = aerospike_scan_partitions(scanner->as, &err, scanner->scan_policy, &scan, &pf,
+			expbin_scanner_scan_callback, scanner);
+
+		as_scan_destroy(&scan);
+
+		if (rc != AEROSPIKE_OK) {
+			// Scans are only aborted once the scanner has stopped.
+			if (rc != AEROSPIKE_ERR_CLIENT_ABORT) {
+				expbin_scanner_fail(scanner, &err);
+			}
+			break;
+		}
 	}
 
-	fclose(file);
+	pthread_mutex_lock(&scanner->lock);
+	scanner->n_running--;
+	pthread_cond_signal(&scanner->not_empty);
+	pthread_mutex_unlock(&scanner->lock);
+	return NULL;
+}
 
-	// Wrap the local buffer as an as_bytes object.
-	as_bytes udf_content;
-	as_bytes_init_wrap(&udf_content, content, size, true);
 
-	as_error err;
-	as_string base_string;
-	const char* base = as_basename(&base_string, udf_file_path);
+//==========================================================
+// Public API
+//
+
+as_status
+as_expbin_get(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_val** result)
+{
+	uint64_t begin = expbin_op_begin();
+	as_status rc = aerospike_key_apply(as, err, policy, key, AS_EXPBIN_MODULE, "get", arglist, result);
+
+	expbin_op_end(AS_EXPBIN_OP_GET, begin, rc, result, expbin_list_size(arglist));
+	return rc;
+}
+
+as_status
+as_expbin_get_repair(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, uint32_t repair_interval, as_list* arglist, as_val** result)
+{
+	uint64_t begin = expbin_op_begin();
+
+	as_integer interval;
+	as_arraylist args;
+	as_arraylist_inita(&args, expbin_list_size(arglist) + 1);
+	expbin_repair_args(&args, &interval, repair_interval, arglist);
+
+	as_status rc = aerospike_key_apply(as, err, policy, key, AS_EXPBIN_MODULE, "get_repair", (as_list*)&args, result);
+
+	expbin_op_end(AS_EXPBIN_OP_GET_REPAIR, begin, rc, result, expbin_list_size(arglist));
+	as_arraylist_destroy(&args);
+	return rc;
+}
 
-	// Register the UDF file in the database cluster.
-	if (aerospike_udf_put(p_as, &err, NULL, base, AS_UDF_TYPE_LUA,
-			&udf_content) == AEROSPIKE_OK) {
-		// Wait for the system metadata to spread to all nodes.
-		aerospike_udf_put_wait(p_as, &err, NULL, base, 100);
+as_status
+as_expbin_get_exp(aerospike* as, as_error* err, const as_policy_operate* policy, const as_key* key, const char* bins[], uint32_t n_bins, as_val** result)
+{
+	uint64_t begin = expbin_op_begin();
+	as_record* rec = NULL;
+	as_status rc = expbin_operate_exp(as, err, policy, key, bins, n_bins, &rec);
+
+	if (rc != AEROSPIKE_OK) {
+		expbin_op_end(AS_EXPBIN_OP_GET_EXP, begin, rc, NULL, n_bins);
+		return rc;
 	}
-	else {
-		LOG("aerospike_udf_put() returned %d - %s", err.code, err.message);
+
+	as_hashmap* map = as_hashmap_new(n_bins);
+
+	for (uint32_t i = 0; i < n_bins; i++) {
+		as_val* data = NULL;
+
+		if (expbin_live_entry(rec, i, &data, NULL)) {
+			as_val_reserve(data);
+			as_stringmap_set((as_map*)map, bins[i], data);
+		}
 	}
 
-	as_string_destroy(&base_string);
+	as_record_destroy(rec);
+	*result = (as_val*)map;
+	expbin_op_end(AS_EXPBIN_OP_GET_EXP, begin, AEROSPIKE_OK, result, n_bins);
+	return AEROSPIKE_OK;
+}
+
+as_status
+as_expbin_get_exp_entries(aerospike* as, as_error* err, const as_policy_operate* policy, const as_key* key, const char* bins[], uint32_t n_bins, as_val** result)
+{
+	uint64_t begin = expbin_op_begin();
+	as_record* rec = NULL;
+	as_status rc = expbin_operate_exp(as, err, policy, key, bins, n_bins, &rec);
+
+	if (rc != AEROSPIKE_OK) {
+		expbin_op_end(AS_EXPBIN_OP_GET_EXP, begin, rc, NULL, n_bins);
+		return rc;
+	}
+
+	as_hashmap* map = as_hashmap_new(n_bins);
+
+	for (uint32_t i = 0; i < n_bins; i++) {
+		as_val* data = NULL;
+		int64_t expiry = 0;
+
+		if (expbin_live_entry(rec, i, &data, &expiry)) {
+			as_arraylist* entry = as_arraylist_new(2, 0);
+			as_arraylist_append_int64(entry, expiry);
+			as_val_reserve(data);
+			as_arraylist_append(entry, data);
+			as_stringmap_set((as_map*)map, bins[i], (as_val*)entry);
+		}
+	}
 
-	// This frees the local buffer.
-	as_bytes_destroy(&udf_content);
+	as_record_destroy(rec);
+	*result = (as_val*)map;
+	expbin_op_end(AS_EXPBIN_OP_GET_EXP, begin, AEROSPIKE_OK, result, n_bins);
+	return AEROSPIKE_OK;
+}
 
-	return err.code == AEROSPIKE_OK;
+as_status
+as_expbin_get_many(aerospike* as, as_error* err, const as_policy_batch* policy, const as_batch* batch, as_list* binlist, as_expbin_get_many_callback callback, void* udata)
+{
+	expbin_get_many_data data = { callback, udata, expbin_op_begin(), expbin_list_size(binlist), { 0 } };
+	as_status rc = aerospike_batch_apply(as, err, policy, NULL, batch, AS_EXPBIN_MODULE, "get", binlist, expbin_get_many_listener, &data);
+
+	// The batch is reported as one call with the outcomes of all its keys.
+	if (data.begin) {
+		if (rc != AEROSPIKE_OK) {
+			data.outcomes[AS_EXPBIN_OUTCOME_ERROR]++;
+		}
+		expbin_op_report(AS_EXPBIN_OP_GET_MANY, data.begin, data.outcomes);
+	}
+	return rc;
 }
 
-// Remove the record from database, and disconnect from cluster.
-void
-cleanup(aerospike* as, as_error* err, as_policy_remove* policy, as_key* testKey)
+as_status
+as_expbin_put(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_val* val, int64_t bin_ttl, as_val** result)
 {
-	// Clean up the database. Note that with database "storage-engine device"
-	// configurations, this record may come back to life if the server is re-
-	// started. That's why this example that want to start clean removes the 
-	// record at the beginning.
-	
-	// Remove the record from the database.
-	aerospike_key_remove(as, err, NULL, testKey);
+	uint64_t begin = expbin_op_begin();
+
+	as_string bin_str;
+	as_string_init(&bin_str, (char*)bin, false);
+
+	as_integer ttl_int;
+	as_integer_init(&ttl_int, bin_ttl);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 3);
+	as_arraylist_append_string(&arglist, &bin_str);
+	as_val_reserve(val);
+	as_arraylist_append(&arglist, val);
+	as_arraylist_append(&arglist, (as_val*)&ttl_int);
+
+	as_status rc = aerospike_key_apply(as, err, policy, key, AS_EXPBIN_MODULE, "put", (as_list*)&arglist, result);
 
-	// Disconnect from the database cluster and clean up the aerospike object.
-	aerospike_close(as, err);
-	aerospike_destroy(as);
+	expbin_op_end(AS_EXPBIN_OP_PUT, begin, rc, result, 0);
+	as_arraylist_destroy(&arglist);
+	return rc;
 }
 
-static void
-example_dump_bin(const as_bin* p_bin)
+// Write the bin of as_expbin_put_exp() with the put UDF instead, which checks
+// bin_ttl against the TTL of the record, removing a record it created again
+// if it doesn't fit, and writes the expiry summary and bucket.
+static as_status
+expbin_put_exp_udf(aerospike* as, as_error* err, const as_policy_operate* policy, const as_key* key, const char* bin, as_val* val, int64_t bin_ttl, uint32_t ttl)
 {
-	if (!p_bin) {
-		LOG("Null as_bin object");
-		return;
+	as_policy_apply apply_policy = as->config.policies.apply;
+
+	if (policy) {
+		apply_policy.base = policy->base;
+		apply_policy.key = policy->key;
+		apply_policy.replica = policy->replica;
+		apply_policy.commit_level = policy->commit_level;
+		apply_policy.durable_delete = policy->durable_delete;
 	}
 
-	char* val_as_str = as_val_tostring(as_bin_get_value(p_bin));
+	apply_policy.ttl = ttl;
 
-	LOG("%s: %s", as_bin_get_name(p_bin), val_as_str);
+	as_string bin_str;
+	as_string_init(&bin_str, (char*)bin, false);
 
-	free(val_as_str);
+	as_integer ttl_int;
+	as_integer_init(&ttl_int, bin_ttl);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 3);
+	as_arraylist_append_string(&arglist, &bin_str);
+	as_val_reserve(val);
+	as_arraylist_append(&arglist, val);
+	as_arraylist_append(&arglist, (as_val*)&ttl_int);
+
+	as_val* result = NULL;
+	as_status rc = aerospike_key_apply(as, err, &apply_policy, key, AS_EXPBIN_MODULE, "put", (as_list*)&arglist, &result);
+	as_integer* i = as_integer_fromval(result);
+
+	if (rc == AEROSPIKE_OK && (!i || as_integer_get(i) != 0)) {
+		rc = as_error_update(err, AEROSPIKE_ERR_OP_NOT_APPLICABLE, "Bin TTL %" PRId64 " exceeds the record TTL", bin_ttl);
+	}
+
+	as_val_destroy(result);
+	as_arraylist_destroy(&arglist);
+	return rc;
 }
 
-void
-example_dump_record(const as_record* p_rec)
+as_status
+as_expbin_put_exp(aerospike* as, as_error* err, const as_policy_operate* policy, const as_key* key, const char* bin, as_val* val, int64_t bin_ttl, uint32_t ttl)
 {
-	if (!p_rec) {
-		LOG("Null as_record object");
-		return;
+	// An explicit record TTL is checked here, otherwise the server checks
+	// against the TTL of the existing record, or the put UDF against the TTL
+	// of the record it creates.
+	uint64_t begin = expbin_op_begin();
+	bool explicit_ttl = expbin_explicit_ttl(ttl);
+
+	if (bin_ttl < -1 || (explicit_ttl && bin_ttl != -1 && bin_ttl > ttl)) {
+		expbin_op_end(AS_EXPBIN_OP_PUT_EXP, begin, AEROSPIKE_ERR_OP_NOT_APPLICABLE, NULL, 0);
+		return as_error_update(err, AEROSPIKE_ERR_OP_NOT_APPLICABLE, "Invalid bin TTL %" PRId64, bin_ttl);
 	}
 
-	if (p_rec->key.valuep) {
-		char* key_val_as_str = as_val_tostring(p_rec->key.valuep);
-		free(key_val_as_str);
+	bool ttl_ok = explicit_ttl || bin_ttl == -1 || ttl == AS_RECORD_NO_EXPIRE_TTL;
+
+	// Without an explicit TTL the record keeps the TTL bin_ttl was checked
+	// against, instead of being reset to the namespace default.
+	uint32_t update_ttl = (ttl == AS_RECORD_DEFAULT_TTL || ttl == AS_RECORD_CLIENT_DEFAULT_TTL) ?
+		AS_RECORD_NO_CHANGE_TTL : ttl;
+
+	as_integer tag;
+	as_integer_init(&tag, EXPBIN_TAG);
+
+	as_integer expiry;
+	as_integer_init(&expiry, 0);
+
+	as_arraylist literal;
+	as_arraylist_inita(&literal, 3);
+	as_arraylist_append(&literal, (as_val*)&tag);
+	as_arraylist_append(&literal, (as_val*)&expiry);
+	as_val_reserve(val);
+	as_arraylist_append(&literal, val);
+
+	as_exp* meta_exp = expbin_put_meta_exp(bin, bin_ttl);
+	as_exp* bin_exp = expbin_put_bin_exp((as_list*)&literal, bin_ttl, update_ttl, ttl_ok);
+
+	as_operations ops;
+	as_operations_inita(&ops, 2);
+	ops.ttl = update_ttl;
+	as_operations_exp_write(&ops, EXPBIN_META, meta_exp, AS_EXP_WRITE_ALLOW_DELETE);
+	as_operations_exp_write(&ops, bin, bin_exp, AS_EXP_WRITE_DEFAULT);
+
+	// Only update, so the bin_ttl is never written to a record whose TTL is
+	// yet unknown.
+	as_policy_operate update_policy = policy ? *policy : as->config.policies.operate;
+	update_policy.exists = AS_POLICY_EXISTS_UPDATE;
+
+	as_record* rec = NULL;
+	as_status rc = aerospike_key_operate(as, err, &update_policy, key, &ops, &rec);
+
+	if (rc == AEROSPIKE_ERR_RECORD_NOT_FOUND) {
+		rc = expbin_put_exp_udf(as, err, policy, key, bin, val, bin_ttl, ttl);
+	}
+	else if (rc == AEROSPIKE_ERR_OP_NOT_APPLICABLE) {
+		// Nothing was written. Either bin_ttl doesn't fit, which the UDF
+		// reports again, or the UDF has to write the bin.
+		rc = expbin_put_exp_udf(as, err, policy, key, bin, val, bin_ttl, update_ttl);
+	}
+
+	expbin_op_end(AS_EXPBIN_OP_PUT_EXP, begin, rc, NULL, 0);
+	as_record_destroy(rec);
+	as_operations_destroy(&ops);
+	as_exp_destroy(meta_exp);
+	as_exp_destroy(bin_exp);
+	as_arraylist_destroy(&literal);
+	return rc;
+}
+
+as_status
+as_expbin_puts(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_val** result)
+{
+	uint64_t begin = expbin_op_begin();
+	as_status rc = aerospike_key_apply(as, err, policy, key, AS_EXPBIN_MODULE, "puts", arglist, result);
+
+	expbin_op_end(AS_EXPBIN_OP_PUTS, begin, rc, result, 0);
+	return rc;
+}
+
+as_status
+as_expbin_touch(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_val** result)
+{
+	uint64_t begin = expbin_op_begin();
+	as_status rc = aerospike_key_apply(as, err, policy, key, AS_EXPBIN_MODULE, "touch", arglist, result);
+
+	expbin_op_end(AS_EXPBIN_OP_TOUCH, begin, rc, result, 0);
+	return rc;
+}
+
+as_status
+as_expbin_touch_bins(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_val** result)
+{
+	uint64_t begin = expbin_op_begin();
+	as_status rc = aerospike_key_apply(as, err, policy, key, AS_EXPBIN_MODULE, "touch_bins", arglist, result);
+
+	expbin_op_end(AS_EXPBIN_OP_TOUCH_BINS, begin, rc, result, 0);
+	return rc;
+}
+
+as_status
+as_expbin_puts_ops(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const as_expbin_bin_op* ops, uint32_t n_ops, as_val** result)
+{
+	return expbin_apply_ops(as, err, policy, key, AS_EXPBIN_OP_PUTS, "puts", ops, n_ops, true, result);
+}
+
+as_status
+as_expbin_touch_ops(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const as_expbin_bin_op* ops, uint32_t n_ops, as_val** result)
+{
+	return expbin_apply_ops(as, err, policy, key, AS_EXPBIN_OP_TOUCH, "touch", ops, n_ops, false, result);
+}
+
+as_status
+as_expbin_touch_bins_ops(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const as_expbin_bin_op* ops, uint32_t n_ops, as_val** result)
+{
+	return expbin_apply_ops(as, err, policy, key, AS_EXPBIN_OP_TOUCH_BINS, "touch_bins", ops, n_ops, false, result);
+}
+
+as_status
+as_expbin_ttl(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin_name, as_val** result)
+{
+	uint64_t begin = expbin_op_begin();
+
+	as_string bin_str;
+	as_string_init(&bin_str, (char*)bin_name, false);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append_string(&arglist, &bin_str);
+
+	as_status rc = aerospike_key_apply(as, err, policy, key, AS_EXPBIN_MODULE, "ttl", (as_list*)&arglist, result);
+
+	expbin_op_end(AS_EXPBIN_OP_TTL, begin, rc, result, 1);
+	as_arraylist_destroy(&arglist);
+	return rc;
+}
+
+as_status
+as_expbin_put_elem(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin_name, as_val* elem_key, as_val* val, int64_t elem_ttl, as_val** result)
+{
+	uint64_t begin = expbin_op_begin();
+
+	as_string bin_str;
+	as_string_init(&bin_str, (char*)bin_name, false);
+
+	as_integer ttl_int;
+	as_integer_init(&ttl_int, elem_ttl);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 4);
+	as_arraylist_append_string(&arglist, &bin_str);
+	as_val_reserve(elem_key);
+	as_arraylist_append(&arglist, elem_key);
+	as_val_reserve(val);
+	as_arraylist_append(&arglist, val);
+	as_arraylist_append(&arglist, (as_val*)&ttl_int);
+
+	as_status rc = aerospike_key_apply(as, err, policy, key, AS_EXPBIN_MODULE, "put_elem", (as_list*)&arglist, result);
+
+	expbin_op_end(AS_EXPBIN_OP_PUT_ELEM, begin, rc, result, 0);
+	as_arraylist_destroy(&arglist);
+	return rc;
+}
+
+as_status
+as_expbin_get_elems(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin_name, as_val** result)
+{
+	uint64_t begin = expbin_op_begin();
+
+	as_string bin_str;
+	as_string_init(&bin_str, (char*)bin_name, false);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append_string(&arglist, &bin_str);
+
+	as_status rc = aerospike_key_apply(as, err, policy, key, AS_EXPBIN_MODULE, "get_elems", (as_list*)&arglist, result);
+
+	expbin_op_end(AS_EXPBIN_OP_GET_ELEMS, begin, rc, result, 0);
+	as_arraylist_destroy(&arglist);
+	return rc;
+}
+
+as_status
+as_expbin_trim(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* binlist, as_val** result)
+{
+	uint64_t begin = expbin_op_begin();
+	as_status rc = aerospike_key_apply(as, err, policy, key, AS_EXPBIN_MODULE, "trim", binlist, result);
+
+	expbin_op_end(AS_EXPBIN_OP_TRIM, begin, rc, result, 0);
+	return rc;
+}
+
+// Run a background scan UDF and wait for it to complete.
+static as_status
+expbin_scan_apply(aerospike* as, as_error* err, const as_policy_scan* policy, as_scan* scan, const char* function, as_list* arglist)
+{
+	uint64_t scan_id = 0;
+
+	if (!as_scan_apply_each(scan, AS_EXPBIN_MODULE, function, arglist)) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "Failed to set scan UDF %s", function);
 	}
 
-	as_record_iterator it;
-	as_record_iterator_init(&it, p_rec);
+	as_status rc = aerospike_scan_background(as, err, policy, scan, &scan_id);
 
-	while (as_record_iterator_has_next(&it)) {
-		example_dump_bin(as_record_iterator_next(&it));
+	if (rc != AEROSPIKE_OK) {
+		return rc;
 	}
 
-	as_record_iterator_destroy(&it);
+	return aerospike_scan_wait(as, err, NULL, scan_id, 0);
 }
 
-//------------------------------------------------
-// Remove the test record from database, and
-// disconnect from cluster.
-//
-void
-example_cleanup(aerospike* p_as)
+as_status
+as_expbin_clean(aerospike* as, as_error* err, const as_policy_scan* policy, as_scan* scan, as_list* binlist)
+{
+	return expbin_scan_apply(as, err, policy, scan, "clean", binlist);
+}
+
+as_status
+as_expbin_clean_all(aerospike* as, as_error* err, const as_policy_scan* policy, as_scan* scan)
 {
-	// Clean up the database. Note that with database "storage-engine device"
-	// configurations, this record may come back to life if the server is re-
-	// started. That's why examples that want to start clean remove the test
-	// record at the beginning.
-	example_remove_test_record(p_as);
+	return expbin_scan_apply(as, err, policy, scan, "clean_all", NULL);
+}
 
-	// Note also example_remove_test_records() is not called here - examples
-	// using multiple records call that from their own cleanup utilities.
+as_status
+as_expbin_create_due_index(aerospike* as, as_error* err, const as_policy_info* policy, const char* ns, const char* set)
+{
+	as_index_task task;
+	as_status rc = aerospike_index_create(as, err, &task, policy, ns, set, EXPBIN_DUE, AS_EXPBIN_DUE_INDEX, AS_INDEX_NUMERIC);
 
-	as_error err;
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
 
-	// Disconnect from the database cluster and clean up the aerospike object.
-	aerospike_close(p_as, &err);
-	aerospike_destroy(p_as);
+	return aerospike_index_create_wait(err, &task, 0);
 }
 
-//------------------------------------------------
-// Remove the test record from the database.
-//
-void
-example_remove_test_record(aerospike* p_as)
+as_status
+as_expbin_clean_due(aerospike* as, as_error* err, const as_policy_write* policy, as_query* query, int64_t before_time, as_list* binlist)
 {
-	as_error err;
+	uint64_t query_id = 0;
+	const char* function = binlist ? "clean" : "clean_all";
+
+	// The predicates live on the heap and are freed by as_query_destroy().
+	if (!query->where.entries && !as_query_where_init(query, 1)) {
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to allocate query predicate");
+	}
+
+	if (!as_query_where(query, EXPBIN_DUE, as_integer_range(1, before_time - AS_EXPBIN_CITRUSLEAF_EPOCH))) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "Failed to set query predicate, query already has a where clause");
+	}
+
+	if (!as_query_apply(query, AS_EXPBIN_MODULE, function, binlist)) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "Failed to set query UDF %s", function);
+	}
 
-	// Try to remove the test record from the database. If the example has not
-	// inserted the record, or it has already been removed, this call will
-	// return as_status AEROSPIKE_ERR_RECORD_NOT_FOUND - which we just ignore.
-	aerospike_key_remove(p_as, &err, NULL, &testKey);
+	as_status rc = aerospike_query_background(as, err, policy, query, &query_id);
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	return aerospike_query_wait(as, err, NULL, query, query_id, 0);
 }
 
-//------------------------------------------------
-// Remove multiple-record examples' test records
-// from the database.
-//
-void
-example_remove_test_records(aerospike* p_as)
+as_status
+as_expbin_clean_partitions(aerospike* as, as_error* err, const as_policy_scan* scan_policy, const as_policy_apply* apply_policy, const as_expbin_clean_config* config, as_expbin_clean_progress* progress)
 {
-	as_error err;
+	as_error_reset(err);
 
-	if (as_key_init_str(&testKey, eb_namespace, eb_set, eb_key_str) == NULL) {
-		LOG("Key was not initiated");
-		exit(1);
+	expbin_cleaner* cleaner = (expbin_cleaner*)calloc(1, sizeof(expbin_cleaner));
+
+	if (!cleaner) {
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to allocate cleaner");
+	}
+
+	bool done[AS_PARTITIONS] = { false };
+
+	if (config->checkpoint_path) {
+		expbin_load_checkpoint(config->checkpoint_path, done);
+
+		cleaner->checkpoint = fopen(config->checkpoint_path, "a+");
+
+		if (!cleaner->checkpoint) {
+			free(cleaner);
+			return as_error_update(err, AEROSPIKE_ERR_PARAM, "Failed to open checkpoint file %s", config->checkpoint_path);
+		}
+
+		// End a line cut short by a crash before appending to it. Writing
+		// after the read needs a seek in between.
+		bool cut_short = fseek(cleaner->checkpoint, -1, SEEK_END) == 0 && fgetc(cleaner->checkpoint) != '\n';
+		fseek(cleaner->checkpoint, 0, SEEK_END);
+
+		if (cut_short) {
+			fputc('\n', cleaner->checkpoint);
+		}
+	}
+
+	for (uint32_t id = 0; id < AS_PARTITIONS; id++) {
+		if (!done[id]) {
+			cleaner->pending[cleaner->n_pending++] = (uint16_t)id;
+		}
+	}
+
+	// Only visit records whose summary says something may have expired.
+	// Records without a summary are always visited.
+	as_exp_build(filter,
+		as_exp_cond(
+			as_exp_cmp_eq(as_exp_bin_type(EXPBIN_META), as_exp_int(AS_BYTES_LIST)),
+			as_exp_and(
+				as_exp_cmp_ne(
+					as_exp_list_get_by_index(NULL, AS_LIST_RETURN_VALUE, AS_EXP_TYPE_INT, as_exp_int(0), as_exp_bin_list(EXPBIN_META)),
+					as_exp_int(0)),
+				as_exp_cmp_lt(
+					as_exp_list_get_by_index(NULL, AS_LIST_RETURN_VALUE, AS_EXP_TYPE_INT, as_exp_int(0), as_exp_bin_list(EXPBIN_META)),
+					EXPBIN_EXP_NOW)),
+			as_exp_bool(true)));
+
+	uint32_t n_threads = config->n_threads ? config->n_threads : 1;
+
+	as_policy_scan_copy(scan_policy ? scan_policy : &as->config.policies.scan, &cleaner->scan_policy);
+	cleaner->scan_policy.base.filter_exp = filter;
+
+	// The server paces each partition scan, so the workers never stall a scan
+	// by not reading it. A partition is on a single node, so splitting the
+	// cap over the workers caps the whole run.
+	if (config->records_per_second) {
+		uint32_t per_scan = config->records_per_second / n_threads;
+		cleaner->scan_policy.records_per_second = per_scan ? per_scan : 1;
+	}
+
+	cleaner->as = as;
+	cleaner->apply_policy = apply_policy;
+	cleaner->config = config;
+	cleaner->function = config->binlist ? "clean" : "clean_all";
+	cleaner->progress.partitions_done = AS_PARTITIONS - cleaner->n_pending;
+	cleaner->progress.partitions_total = AS_PARTITIONS;
+	pthread_mutex_init(&cleaner->lock, NULL);
+
+	pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * n_threads);
+	uint32_t n_started = 0;
+
+	if (!threads) {
+		as_error err_alloc;
+		as_error_init(&err_alloc);
+		as_error_update(&err_alloc, AEROSPIKE_ERR_CLIENT, "Failed to allocate clean workers");
+		expbin_cleaner_fail(cleaner, &err_alloc);
+		n_threads = 0;
+	}
+
+	for (; n_started < n_threads; n_started++) {
+		if (pthread_create(&threads[n_started], NULL, expbin_cleaner_worker, cleaner) != 0) {
+			as_error err_thread;
+			as_error_init(&err_thread);
+			as_error_update(&err_thread, AEROSPIKE_ERR_CLIENT, "Failed to start clean worker");
+			expbin_cleaner_fail(cleaner, &err_thread);
+			break;
+		}
 	}
 
-	aerospike_key_remove(p_as, &err, NULL, &testKey);
+	for (uint32_t i = 0; i < n_started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	as_status rc = cleaner->rc;
+
+	if (rc != AEROSPIKE_OK) {
+		as_error_copy(err, &cleaner->err);
+	}
+
+	if (progress) {
+		*progress = cleaner->progress;
+	}
+
+	if (cleaner->checkpoint) {
+		fclose(cleaner->checkpoint);
+
+		// Start the next run over once every partition is done.
+		if (cleaner->progress.partitions_done == AS_PARTITIONS) {
+			remove(config->checkpoint_path);
+		}
+	}
+
+	pthread_mutex_destroy(&cleaner->lock);
+	as_exp_destroy(filter);
+	free(threads);
+	free(cleaner);
+	return rc;
 }
 
-void 
-exp_example(void) {
-	LOG("Inserting expire bins...");
-	as_string_init(&val, "Hello World.", false);
-	as_expbin_put(&as, &err, NULL, &testKey, "TestBin1", (as_val*)&val, -1, result);
-	LOG("TestBin 1 inserted");
-	
-	as_string_init(&val, "I don't expire.", false);
-	as_expbin_put(&as, &err, NULL, &testKey, "TestBin2", (as_val*)&val, 8, result);
-	LOG("TestBin 2 inserted");
+as_status
+as_expbin_scan_live(aerospike* as, as_error* err, const as_policy_scan* policy, const as_expbin_scan_config* config)
+{
+	as_error_reset(err);
 
-	as_string_init(&val, "I will expire soon.", false);
-	as_expbin_put(&as, &err, NULL, &testKey, "TestBin3", (as_val*)&val, 5, result);
-	LOG("TestBin 3 inserted");
+	expbin_scanner scanner;
+	memset(&scanner, 0, sizeof(expbin_scanner));
 
-	LOG("Getting expire bins...");
-	as_arraylist_inita(&arglist, 5);
-	as_arraylist_append_str(&arglist, "TestBin1");
-	as_arraylist_append_str(&arglist, "TestBin2");
-	as_arraylist_append_str(&arglist, "TestBin3");
+	scanner.capacity = config->queue_size ? config->queue_size : 1024;
+	scanner.queue = (as_record**)malloc(sizeof(as_record*) * scanner.capacity);
 
-	result = as_expbin_get(&as, &err, NULL, &testKey, (as_list*)&arglist, result);
-	LOG("%s", as_val_tostring(result));
+	if (!scanner.queue) {
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to allocate scan queue");
+	}
 
-	LOG("Getting bins TTL...");
-	result = as_expbin_ttl(&as, &err, NULL, &testKey, "TestBin1", result); 
-	LOG("TestBin 1 TTL: %s", as_val_tostring(result));
-	result = as_expbin_ttl(&as, &err, NULL, &testKey, "TestBin2", result); 
-	LOG("TestBin 2 TTL: %s", as_val_tostring(result));
-	result = as_expbin_ttl(&as, &err, NULL, &testKey, "TestBin3", result); 
-	LOG("TestBin 3 TTL: %s", as_val_tostring(result));
+	uint32_t n_threads = config->n_threads ? config->n_threads : 1;
+	pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * n_threads);
 
-	LOG("Waiting for TestBin 3 to expire...");
-	sleep(6);
+	if (!threads) {
+		free(scanner.queue);
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to allocate scan workers");
+	}
 
-	LOG("Getting expire bins again...");
-	as_arraylist_inita(&arglist, 3);
-	as_arraylist_append_str(&arglist, "TestBin1");
-	as_arraylist_append_str(&arglist, "TestBin2");
-	as_arraylist_append_str(&arglist, "TestBin3");
+	scanner.as = as;
+	scanner.scan_policy = policy;
+	scanner.config = config;
+	pthread_mutex_init(&scanner.lock, NULL);
+	pthread_cond_init(&scanner.not_empty, NULL);
+	pthread_cond_init(&scanner.not_full, NULL);
+
+	uint32_t n_started = 0;
+
+	scanner.n_running = n_threads;
+
+	for (; n_started < n_threads; n_started++) {
+		if (pthread_create(&threads[n_started], NULL, expbin_scanner_worker, &scanner) != 0) {
+			as_error err_thread;
+			as_error_init(&err_thread);
+			as_error_update(&err_thread, AEROSPIKE_ERR_CLIENT, "Failed to start scan worker");
+			expbin_scanner_fail(&scanner, &err_thread);
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&scanner.lock);
+	scanner.n_running -= n_threads - n_started;
+
+	// Hand the records to the callback until every worker is done, a worker
+	// fails or the callback stops the scan.
+	while (true) {
+		while (scanner.size == 0 && scanner.n_running > 0) {
+			pthread_cond_wait(&scanner.not_empty, &scanner.lock);
+		}
+
+		if (scanner.size == 0 || scanner.rc != AEROSPIKE_OK) {
+			break;
+		}
+
+		as_record* rec = scanner.queue[scanner.head];
+
+		scanner.head = (scanner.head + 1) % scanner.capacity;
+		scanner.size--;
+		pthread_cond_signal(&scanner.not_full);
+		pthread_mutex_unlock(&scanner.lock);
+
+		bool more = config->callback(rec, config->udata);
+
+		as_record_destroy(rec);
+		pthread_mutex_lock(&scanner.lock);
+
+		if (!more) {
+			__atomic_store_n(&scanner.stopped, true, __ATOMIC_RELEASE);
+			pthread_cond_broadcast(&scanner.not_full);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&scanner.lock);
+
+	for (uint32_t i = 0; i < n_started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	// Records decoded after the scan stopped.
+	for (; scanner.size > 0; scanner.size--) {
+		as_record_destroy(scanner.queue[scanner.head]);
+		scanner.head = (scanner.head + 1) % scanner.capacity;
+	}
+
+	as_status rc = scanner.rc;
 
-	result = as_expbin_get(&as, &err, NULL, &testKey, (as_list*)&arglist, result);
-	LOG("%s", as_val_tostring(result));
+	if (rc != AEROSPIKE_OK) {
+		as_error_copy(err, &scanner.err);
+	}
+
+	pthread_cond_destroy(&scanner.not_full);
+	pthread_cond_destroy(&scanner.not_empty);
+	pthread_mutex_destroy(&scanner.lock);
+	free(threads);
+	free(scanner.queue);
+	return rc;
+}
+
+as_status
+as_expbin_clean_record(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* binlist, as_val** result)
+{
+	uint64_t begin = expbin_op_begin();
+	as_status rc = aerospike_key_apply(as, err, policy, key, AS_EXPBIN_MODULE, "clean", binlist, result);
+
+	expbin_op_end(AS_EXPBIN_OP_CLEAN_RECORD, begin, rc, result, 0);
+	return rc;
 }
 
 void
-touch_example(void) {
-	LOG("Changing expiration time for TestBin 1 and TestBin 2...");
+as_expbin_set_listener(const as_expbin_listener* listener)
+{
+	__atomic_store_n(&expbin_listener, listener, __ATOMIC_RELEASE);
+}
 
-	as_arraylist_inita(&arglist, 2);
+as_map*
+as_expbin_bin_map(const char* bin_name, as_val* val, int64_t bin_ttl)
+{
+	as_hashmap* map = as_hashmap_new(3);
+	as_stringmap_set_str((as_map*)map, "bin", bin_name);
 
-	map1 = create_bin_map("TestBin1", "Hello World.", 3); 
-	as_val_reserve((as_map *)&map1);
-	as_arraylist_append(&arglist, (as_val *)((as_map *)&map1));
+	if (val) {
+		as_stringmap_set((as_map*)map, "val", val);
+	}
 
-	map2 = create_bin_map("TestBin2", "I don't expire.", -1); 
-	as_val_reserve((as_map *)&map2);
-	as_arraylist_append(&arglist, (as_val *)((as_map *)&map2));
+	as_stringmap_set_int64((as_map*)map, "bin_ttl", bin_ttl);
+	return (as_map*)map;
+}
 
-	as_expbin_touch(&as, &err, NULL, &testKey, (as_list*)&arglist, result);
+//----------------------------------------------------------
+// Async API
+//
 
-	LOG("Getting bins TTL...");
-	result = as_expbin_ttl(&as, &err, NULL, &testKey, "TestBin1", result); 
-	LOG("TestBin 1 TTL: %s", as_val_tostring(result));
-	result = as_expbin_ttl(&as, &err, NULL, &testKey, "TestBin2", result); 
-	LOG("TestBin 2 TTL: %s", as_val_tostring(result));
+as_status
+as_expbin_get_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_async_value_listener listener, void* udata, as_event_loop* event_loop)
+{
+	return expbin_apply_async(as, err, policy, key, AS_EXPBIN_OP_GET, "get", arglist, expbin_list_size(arglist), listener, udata, event_loop);
+}
 
-	LOG("Waiting for TestBin 1 to expire...");
-	sleep(4);
+as_status
+as_expbin_get_repair_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, uint32_t repair_interval, as_list* arglist, as_async_value_listener listener, void* udata, as_event_loop* event_loop)
+{
+	as_integer interval;
+	as_arraylist args;
+	as_arraylist_inita(&args, expbin_list_size(arglist) + 1);
+	expbin_repair_args(&args, &interval, repair_interval, arglist);
+
+	as_status rc = expbin_apply_async(as, err, policy, key, AS_EXPBIN_OP_GET_REPAIR, "get_repair", (as_list*)&args, expbin_list_size(arglist), listener, udata, event_loop);
+
+	as_arraylist_destroy(&args);
+	return rc;
+}
 
-	LOG("Getting expire bins again...");
+as_status
+as_expbin_put_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_val* val, int64_t bin_ttl, as_async_value_listener listener, void* udata, as_event_loop* event_loop)
+{
+	as_string bin_str;
+	as_string_init(&bin_str, (char*)bin, false);
+
+	as_integer ttl_int;
+	as_integer_init(&ttl_int, bin_ttl);
+
+	as_arraylist arglist;
 	as_arraylist_inita(&arglist, 3);
-	as_arraylist_append_str(&arglist, "TestBin1");
-	as_arraylist_append_str(&arglist, "TestBin2");
-	as_arraylist_append_str(&arglist, "TestBin3");
+	as_arraylist_append_string(&arglist, &bin_str);
+	as_val_reserve(val);
+	as_arraylist_append(&arglist, val);
+	as_arraylist_append(&arglist, (as_val*)&ttl_int);
+
+	as_status rc = expbin_apply_async(as, err, policy, key, AS_EXPBIN_OP_PUT, "put", (as_list*)&arglist, 0, listener, udata, event_loop);
 
-	result = as_expbin_get(&as, &err, NULL, &testKey, (as_list*)&arglist, result);
-	LOG("%s", as_val_tostring(result));
+	as_arraylist_destroy(&arglist);
+	return rc;
 }
 
-void
-get_example(void) {
-	LOG("Inserting expire bins...");
-	as_arraylist_inita(&arglist, 2);
-
-	map1 = create_bin_map("TestBin4", "Good Morning.", 5); 
-	as_val_reserve((as_map *)&map1);
-	as_arraylist_append(&arglist, (as_val *)((as_map *)&map1));
-
-	map2 = create_bin_map("TestBin5", "Good Night.", 5); 
-	as_val_reserve((as_map *)&map2);
-	as_arraylist_append(&arglist, (as_val *)((as_map *)&map2));
-
-	as_expbin_puts(&as, &err, NULL, &testKey, (as_list*)&arglist, result);
-	LOG("TestBin 4 & 5 inserted");
-
-	LOG("Sleeping for 6 seconds (TestBin 4 & 5 will expire)...");
-	sleep(6);
-
-	// Read the record using 'eb.get' after it expires, showing it's gone
-	LOG("Getting TestBin 4 & 5 using 'eb interface'...");
-	as_arraylist_inita(&arglist, 2);
-	as_arraylist_append_str(&arglist, "TestBin4");
-	as_arraylist_append_str(&arglist, "TestBin5");
-
-	result = as_expbin_get(&as, &err, NULL, &testKey, (as_list*)&arglist, result);
-	LOG("%s", as_val_tostring(result));
-		
-	// Read the record using normal 'get' after it expires, showing it's persistent
-	LOG("Getting TestBin 4 & 5 using 'normal get'...");
-
-	// Select bins 4 and 5 to read.
-	const char* two_bins[] = {"TestBin4", "TestBin5", NULL};
-
-	as_record* p_rec = NULL;
-
-	// Read only these two bins of the test record from the database.
-	if (aerospike_key_select(&as, &err, NULL, &testKey, two_bins, &p_rec) != AEROSPIKE_OK) {
-		LOG("aerospike_key_select() returned %d - %s", err.code, err.message);
-		example_cleanup(&as);
-		exit(-1);
-	}
-
-	// Log the result and recycle the as_record object.
-	example_dump_record(p_rec);
-	as_record_destroy(p_rec);
-	p_rec = NULL;
-
-	LOG("Cleaning bins...");
-	as_arraylist_inita(&arglist, 5);
-	as_arraylist_append_str(&arglist, "TestBin1");
-	as_arraylist_append_str(&arglist, "TestBin2");
-	as_arraylist_append_str(&arglist, "TestBin3");
-	as_arraylist_append_str(&arglist, "TestBin4");
-	as_arraylist_append_str(&arglist, "TestBin5");
-
-	as_scan scan;
-	LOG("Scan in progress...");
-	as_expbin_clean(&as, &err, NULL, &scan, (as_list*) &arglist);
-	LOG("Scan completed!");
-
-	LOG("Checking expire bins again using 'eb interface'...");
-	as_arraylist_inita(&arglist, 5);
-	as_arraylist_append_str(&arglist, "TestBin1");
-	as_arraylist_append_str(&arglist, "TestBin2");
-	as_arraylist_append_str(&arglist, "TestBin3");
-	as_arraylist_append_str(&arglist, "TestBin4");
-	as_arraylist_append_str(&arglist, "TestBin5");
-
-	result = as_expbin_get(&as, &err, NULL, &testKey, (as_list*) &arglist, result);
-	LOG("%s", as_val_tostring(result));
-
-	LOG("Checking expire bins again using 'normal get'...");
-	// Select all previously created bins to read.
-	const char* all_bins[] = {"TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5", NULL};
-
-	// Read all these bins of the test record from the database.
-	if (aerospike_key_select(&as, &err, NULL, &testKey, all_bins, &p_rec) != AEROSPIKE_OK) {
-		LOG("aerospike_key_select() returned %d - %s", err.code, err.message);
-		example_cleanup(&as);
-		exit(-1);
-	}
-
-	// Log the result and recycle the as_record object.
-	example_dump_record(p_rec);
-	as_record_destroy(p_rec);
-	p_rec = NULL;
-}
\ No newline at end of file
+as_status
+as_expbin_puts_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_async_value_listener listener, void* udata, as_event_loop* event_loop)
+{
+	return expbin_apply_async(as, err, policy, key, AS_EXPBIN_OP_PUTS, "puts", arglist, 0, listener, udata, event_loop);
+}
+
+as_status
+as_expbin_touch_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_async_value_listener listener, void* udata, as_event_loop* event_loop)
+{
+	return expbin_apply_async(as, err, policy, key, AS_EXPBIN_OP_TOUCH, "touch", arglist, 0, listener, udata, event_loop);
+}
+
+as_status
+as_expbin_touch_bins_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_async_value_listener listener, void* udata, as_event_loop* event_loop)
+{
+	return expbin_apply_async(as, err, policy, key, AS_EXPBIN_OP_TOUCH_BINS, "touch_bins", arglist, 0, listener, udata, event_loop);
+}
+
+as_status
+as_expbin_ttl_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin_name, as_async_value_listener listener, void* udata, as_event_loop* event_loop)
+{
+	as_string bin_str;
+	as_string_init(&bin_str, (char*)bin_name, false);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append_string(&arglist, &bin_str);
+
+	as_status rc = expbin_apply_async(as, err, policy, key, AS_EXPBIN_OP_TTL, "ttl", (as_list*)&arglist, 1, listener, udata, event_loop);
+
+	as_arraylist_destroy(&arglist);
+	return rc;
+}
+
+as_status
+as_expbin_clean_record_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* binlist, as_async_value_listener listener, void* udata, as_event_loop* event_loop)
+{
+	return expbin_apply_async(as, err, policy, key, AS_EXPBIN_OP_CLEAN_RECORD, "clean", binlist, 0, listener, udata, event_loop);
+}
@@ -0,0 +1,995 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+//==========================================================
+// Expire Bin C Library
+//
+// Wrappers around the expire_bin UDF module. Apart from the optional
+// instrumentation listener, the library keeps no state of its own: every call
+// works only on its arguments, so the functions can be used from any number
+// of threads sharing one aerospike instance.
+//
+// Synchronous calls return the status of the command and hand the UDF
+// return value back through result, which the caller must destroy with
+// as_val_destroy().
+//
+
+#include <aerospike/aerospike.h>
+#include <aerospike/as_batch.h>
+#include <aerospike/as_error.h>
+#include <aerospike/as_event.h>
+#include <aerospike/as_key.h>
+#include <aerospike/as_list.h>
+#include <aerospike/as_map.h>
+#include <aerospike/as_policy.h>
+#include <aerospike/as_query.h>
+#include <aerospike/as_record.h>
+#include <aerospike/as_scan.h>
+#include <aerospike/as_val.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//==========================================================
+// Constants
+//
+
+#define AS_EXPBIN_MODULE "expire_bin"
+
+// Expire bin expiries are in seconds since this Unix time.
+#define AS_EXPBIN_CITRUSLEAF_EPOCH 1262304000
+
+// Name of the secondary index created by as_expbin_create_due_index.
+#define AS_EXPBIN_DUE_INDEX "expbin_due_idx"
+
+// Per-bin status returned by as_expbin_touch_bins.
+#define AS_EXPBIN_TOUCH_UPDATED     0
+#define AS_EXPBIN_TOUCH_INVALID_TTL 1
+#define AS_EXPBIN_TOUCH_NOT_EXPBIN  2
+
+
+//==========================================================
+// Types
+//
+
+/*
+ * Called by as_expbin_get_many once for each key of the batch.
+ *
+ * \param key    - The key of the record.
+ * \param status - AEROSPIKE_OK if bins holds the record's bins, AEROSPIKE_ERR_RECORD_NOT_FOUND
+ *                 if the record doesn't exist, or the error of the UDF call for this key.
+ * \param bins   - Map of the non-expired bin values, NULL unless status is AEROSPIKE_OK.
+ *                 Only valid during the callback; reserve it to keep it.
+ * \param udata  - User data passed to as_expbin_get_many.
+ * \return       - true to continue with the remaining keys, false to stop.
+ */
+typedef bool (*as_expbin_get_many_callback)(const as_key* key, as_status status, as_map* bins, void* udata);
+
+/*
+ * One bin of as_expbin_puts_ops, as_expbin_touch_ops and as_expbin_touch_bins_ops.
+ */
+typedef struct as_expbin_bin_op_s {
+	const char* bin;
+
+	// Value to write, NULL to write nil. Not consumed, and ignored by touches.
+	as_val* val;
+
+	// Bin TTL in seconds, -1 for no expiration.
+	int64_t bin_ttl;
+} as_expbin_bin_op;
+
+/*
+ * Progress of as_expbin_clean_partitions.
+ */
+typedef struct as_expbin_clean_progress_s {
+	// Partitions cleaned, including those skipped by the checkpoint file.
+	uint32_t partitions_done;
+	uint32_t partitions_total;
+
+	// Records cleaned and expired bins removed in this run.
+	uint64_t records;
+	uint64_t bins_removed;
+
+	// Records whose clean failed, for example on a timeout. They are skipped
+	// and left to a later run.
+	uint64_t failed;
+} as_expbin_clean_progress;
+
+/*
+ * Called by as_expbin_clean_partitions after each partition is cleaned, from the
+ * worker thread that cleaned it. Calls are serialized.
+ *
+ * \param progress - Progress so far.
+ * \param udata    - User data from the config.
+ */
+typedef void (*as_expbin_clean_progress_callback)(const as_expbin_clean_progress* progress, void* udata);
+
+/*
+ * Configuration of as_expbin_clean_partitions.
+ */
+typedef struct as_expbin_clean_config_s {
+	// Namespace and set to clean. An empty set cleans the whole namespace.
+	const char* ns;
+	const char* set;
+
+	// Bins to clean, or NULL to clean every expire bin.
+	as_list* binlist;
+
+	// Number of worker threads, each cleaning one partition at a time. 0 means 1.
+	uint32_t n_threads;
+
+	// Maximum records cleaned per second over all workers, 0 for no limit.
+	// Enforced by the server, which paces each partition scan.
+	uint32_t records_per_second;
+
+	// File recording finished partitions, NULL to always clean every partition.
+	// It is removed once every partition is done.
+	const char* checkpoint_path;
+
+	as_expbin_clean_progress_callback progress_callback;
+	void* udata;
+} as_expbin_clean_config;
+
+/*
+ * Called by as_expbin_scan_live with each record, from the thread that called
+ * as_expbin_scan_live.
+ *
+ * \param rec   - The record with its live bins. Owned by the scan, reserve it to keep it.
+ * \param udata - User data from the config.
+ * \return      - false to stop the scan.
+ */
+typedef bool (*as_expbin_scan_callback)(const as_record* rec, void* udata);
+
+/*
+ * Configuration of as_expbin_scan_live.
+ */
+typedef struct as_expbin_scan_config_s {
+	// Namespace and set to read. An empty set reads the whole namespace.
+	const char* ns;
+	const char* set;
+
+	// Bins to read, or NULL to read every bin.
+	const char** bins;
+	uint32_t n_bins;
+
+	// Number of worker threads, each scanning one partition at a time. 0 means 1.
+	uint32_t n_threads;
+
+	// Records decoded ahead of the callback at most. 0 means 1024.
+	uint32_t queue_size;
+
+	as_expbin_scan_callback callback;
+	void* udata;
+} as_expbin_scan_config;
+
+
+//==========================================================
+// Public API
+//
+
+/*
+ * Attempt to retrieve values from list of bins. The bins
+ * can be expire bins, element bins or normal bins. Element bins are
+ * returned as a map of their live elements.
+ *
+ * \param as      - The aerospike instance to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param arglist - The list of bin names to retrieve values from.
+ * \param result  - A map of bin values respective to the list of bin names passed in.
+ *                  If a bin is expired or empty, it is not in the map. 1 if the record doesn't exist.
+ * \return        - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_get(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_val** result);
+
+/*
+ * Same as as_expbin_get, but if the record may hold expired bins, every expired
+ * bin of the record is removed on the way. The record is only written if a bin
+ * was removed or its expiry summary was stale, and at most once per
+ * repair_interval seconds.
+ *
+ * \param as              - The aerospike instance to use for this operation.
+ * \param err             - The as_error to be populated if an error occurs.
+ * \param policy          - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key             - The key of the record.
+ * \param repair_interval - Minimum number of seconds between two repairs of the record.
+ * \param arglist         - The list of bin names to retrieve values from.
+ * \param result          - A map of bin values respective to the list of bin names passed in.
+ *                          If a bin is expired or empty, it is not in the map. 1 if the record doesn't exist.
+ * \return                - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_get_repair(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, uint32_t repair_interval, as_list* arglist, as_val** result);
+
+/*
+ * Attempt to retrieve values from list of expire bins without running the UDF.
+ * The expiry of each bin is checked by an expression on the server, against
+ * the server clock, and only live values are sent back. Bins written by any
+ * version of the module are read. Unlike as_expbin_get, bins that are not
+ * expire bins are not returned.
+ *
+ * \param as      - The aerospike instance to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param bins    - The names of the bins to retrieve values from.
+ * \param n_bins  - The number of bin names.
+ * \param result  - A map of bin values respective to the bin names passed in.
+ *                  If a bin is expired or empty, it is not in the map.
+ * \return        - AEROSPIKE_OK if successful, AEROSPIKE_ERR_RECORD_NOT_FOUND if the record
+ *                  doesn't exist, an error otherwise.
+ */
+as_status as_expbin_get_exp(aerospike* as, as_error* err, const as_policy_operate* policy, const as_key* key, const char* bins[], uint32_t n_bins, as_val** result);
+
+/*
+ * Same as as_expbin_get_exp(), but each bin also carries its expiry, so the
+ * caller can tell how long the value stays live.
+ *
+ * \param as      - The aerospike instance to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param bins    - The names of the bins to retrieve values from.
+ * \param n_bins  - The number of bin names.
+ * \param result  - A map of bin name to the list [expiry, value], where expiry is in seconds since
+ *                  the Citrusleaf epoch (AS_EXPBIN_CITRUSLEAF_EPOCH) or 0 if the bin doesn't expire.
+ *                  If a bin is expired or empty, it is not in the map.
+ * \return        - AEROSPIKE_OK if successful, AEROSPIKE_ERR_RECORD_NOT_FOUND if the record
+ *                  doesn't exist, an error otherwise.
+ */
+as_status as_expbin_get_exp_entries(aerospike* as, as_error* err, const as_policy_operate* policy, const as_key* key, const char* bins[], uint32_t n_bins, as_val** result);
+
+/*
+ * Retrieve the non-expired bins of many records with a single batch UDF
+ * call, sending one request per server node.
+ *
+ * \param as       - The aerospike instance to use for this operation.
+ * \param err      - The as_error to be populated if an error occurs.
+ * \param policy   - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param batch    - The keys of the records, initialized with as_batch_inita() or as_batch_init().
+ * \param binlist  - The list of bin names to retrieve values from.
+ * \param callback - Called with the result of each key.
+ * \param udata    - User data passed to callback.
+ * \return         - AEROSPIKE_OK if the batch completed, an error otherwise. Errors of single keys
+ *                   are reported to callback and don't fail the batch.
+ */
+as_status as_expbin_get_many(aerospike* as, as_error* err, const as_policy_batch* policy, const as_batch* batch, as_list* binlist, as_expbin_get_many_callback callback, void* udata);
+
+/*
+ * Create or update expire bins. If bin_ttl is not NULL, all newly created bins
+ * will be expire bins, otherwise, only normal bins will be created and existing
+ * expire bins will be updated. Note: existing expire bins and element bins will
+ * not be converted into normal bins if bin_ttl is NULL.
+ *
+ * \param as      - The aerospike instance to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param bin     - Bin name.
+ * \param val     - Bin value. The caller keeps its reference.
+ * \param bin_ttl - Expiration time in seconds or -1 for no expiration.
+ * \param result  - 0 if successfully written, 1 otherwise.
+ * \return        - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_put(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_val* val, int64_t bin_ttl, as_val** result);
+
+/*
+ * Create or update an expire bin without running the UDF. The bin and the
+ * record's expiry summary are written by expressions in a single operate
+ * command, so either both change or neither does. The stored format is the
+ * same as as_expbin_put's.
+ *
+ * bin_ttl must not exceed the record TTL. If ttl is set, bin_ttl is checked
+ * against it. Otherwise it is checked on the server against the TTL of the
+ * existing record, which the write then leaves unchanged. The expressions
+ * only update existing records: a record that doesn't exist yet is created
+ * through the put UDF instead, which checks bin_ttl against the TTL the
+ * record is created with and writes its expiry summary. The put UDF also
+ * writes a bin that expires before the expiry bucket of as_expbin_clean_due,
+ * or on a record whose summary says none of its bins expire, as only the UDF
+ * knows the bucket size, and a bin with bin_ttl -1 to a record that expires,
+ * as the TTL_MODE of the UDF decides what happens to the record TTL then.
+ * The exists field of policy is ignored.
+ *
+ * \param as      - The aerospike instance to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param bin     - Bin name.
+ * \param val     - Bin value. The caller keeps its reference.
+ * \param bin_ttl - Expiration time in seconds or -1 for no expiration.
+ * \param ttl     - Record TTL to write, AS_RECORD_DEFAULT_TTL, AS_RECORD_NO_EXPIRE_TTL or
+ *                  AS_RECORD_NO_CHANGE_TTL. The default TTL only applies to a record being
+ *                  created.
+ * \return        - AEROSPIKE_OK if successful, AEROSPIKE_ERR_OP_NOT_APPLICABLE if bin_ttl is
+ *                  invalid or exceeds the record TTL, an error otherwise.
+ */
+as_status as_expbin_put_exp(aerospike* as, as_error* err, const as_policy_operate* policy, const as_key* key, const char* bin, as_val* val, int64_t bin_ttl, uint32_t ttl);
+
+/* Batch create or update expire bins for a given key. Use the as_map:
+ * {'bin' : bin_name, 'val' : bin_value, 'bin_ttl' : ttl} to store each put operation.
+ * Omit the bin_ttl to turn bin creation off.
+ *
+ * \param as      - The aerospike instance to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param arglist - The list of as_maps in the following form: {'bin' : bin_name, 'val' : bin_value, 'bin_ttl' : ttl}.
+ * \param result  - 0 if all ops succeed, 1 otherwise.
+ * \return        - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_puts(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_val** result);
+
+/*
+ * Batch update the bin TTLs. Us this method to change or reset the bin TTL of
+ * multiple bins in a record.
+ *
+ * \param as      - The aerospike instance to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param arglist - The list of as_maps in the following form: {'bin' : bin_name, 'bin_ttl' : ttl}.
+ * \param result  - 0 if all ops succeed, 1 otherwise.
+ * \return        - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_touch(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_val** result);
+
+/*
+ * Batch update the bin TTLs and report the outcome of each bin. Unlike
+ * as_expbin_touch, valid bins are updated even if others are rejected. All
+ * changes are written to the record once.
+ *
+ * \param as      - The aerospike instance to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param arglist - The list of as_maps in the following form: {'bin' : bin_name, 'bin_ttl' : ttl}.
+ * \param result  - Map of bin name to AS_EXPBIN_TOUCH_UPDATED, AS_EXPBIN_TOUCH_INVALID_TTL or
+ *                  AS_EXPBIN_TOUCH_NOT_EXPBIN. 1 if the record doesn't exist.
+ * \return        - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_touch_bins(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_val** result);
+
+/*
+ * Same as as_expbin_puts, with the bins given as a plain array. The UDF
+ * arguments are built in space kept by the calling thread and reused by its
+ * next calls, so apart from that space growing, no memory is allocated.
+ *
+ * \param as     - The aerospike instance to use for this operation.
+ * \param err    - The as_error to be populated if an error occurs.
+ * \param policy - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key    - The key of the record.
+ * \param ops    - The bins to write.
+ * \param n_ops  - The number of bins.
+ * \param result - 0 if all ops succeed, 1 otherwise.
+ * \return       - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_puts_ops(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const as_expbin_bin_op* ops, uint32_t n_ops, as_val** result);
+
+/*
+ * Same as as_expbin_touch, with the bins given as a plain array like
+ * as_expbin_puts_ops. The val of each op is ignored.
+ */
+as_status as_expbin_touch_ops(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const as_expbin_bin_op* ops, uint32_t n_ops, as_val** result);
+
+/*
+ * Same as as_expbin_touch_bins, with the bins given as a plain array like
+ * as_expbin_puts_ops. The val of each op is ignored.
+ */
+as_status as_expbin_touch_bins_ops(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const as_expbin_bin_op* ops, uint32_t n_ops, as_val** result);
+
+/*
+ * Get bin TTL in seconds.
+ *
+ * \param as       - The aerospike instance to use for this operation.
+ * \param err      - The as_error to be populated if an error occurs.
+ * \param policy   - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key      - The key of the record.
+ * \param bin_name - The bin name to check.
+ * \param result   - Bin time to expire in seconds, -1 if it doesn't expire, nil if expired or missing.
+ * \return         - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_ttl(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin_name, as_val** result);
+
+/*
+ * Store an element with its own expiration in an element bin, replacing the
+ * element with the same key. Elements are kept ordered by expiry, and the
+ * expired ones are dropped on the way.
+ *
+ * \param as       - The aerospike instance to use for this operation.
+ * \param err      - The as_error to be populated if an error occurs.
+ * \param policy   - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key      - The key of the record.
+ * \param bin_name - Element bin name, created if it doesn't exist.
+ * \param elem_key - Element key, an as_integer or as_string. Ownership stays with the caller.
+ * \param val      - Element value. Ownership stays with the caller.
+ * \param elem_ttl - Expiration time of the element in seconds, -1 for no expiration.
+ * \param result   - 0 if success, 1 if error or the bin is not an element bin.
+ * \return         - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_put_elem(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin_name, as_val* elem_key, as_val* val, int64_t elem_ttl, as_val** result);
+
+/*
+ * Get the elements of an element bin that haven't expired.
+ *
+ * \param as       - The aerospike instance to use for this operation.
+ * \param err      - The as_error to be populated if an error occurs.
+ * \param policy   - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key      - The key of the record.
+ * \param bin_name - Element bin name.
+ * \param result   - Map of element key to value, empty if the bin doesn't exist or is not an
+ *                   element bin, 1 if the record doesn't exist.
+ * \return         - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_get_elems(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin_name, as_val** result);
+
+/*
+ * Drop the expired elements of element bins. Bins left with no element are
+ * removed. The record is only rewritten if an element was dropped.
+ *
+ * \param as      - The aerospike instance to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param binlist - List of element bins to trim.
+ * \param result  - Number of elements dropped, nil if the record doesn't exist.
+ * \return        - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_trim(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* binlist, as_val** result);
+
+/*
+ * Perform a background scan and remove all expired bins and the expired
+ * elements of element bins, then wait for the scan to complete.
+ *
+ * \param as      - The aerospike instance to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param scan    - as_scan initialized with the namespace and set to clean.
+ * \param binlist - List of bins to clean. It is attached to scan and destroyed with it.
+ * \return        - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_clean(aerospike* as, as_error* err, const as_policy_scan* policy, as_scan* scan, as_list* binlist);
+
+/*
+ * Perform a background scan and remove every expired bin and expired element,
+ * then wait for the scan to complete. The bins of each record are discovered on the server, so
+ * expire bin names don't have to be known up front.
+ *
+ * \param as      - The aerospike instance to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param scan    - as_scan initialized with the namespace and set to clean.
+ * \return        - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_clean_all(aerospike* as, as_error* err, const as_policy_scan* policy, as_scan* scan);
+
+/*
+ * Create the secondary index used by as_expbin_clean_due, then wait for it to
+ * be built. The expiry bucket it indexes is only kept if DUE_BUCKET is set in
+ * expire_bin.lua.
+ *
+ * \param as     - The aerospike instance to use for this operation.
+ * \param err    - The as_error to be populated if an error occurs.
+ * \param policy - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param ns     - Namespace to index.
+ * \param set    - Set to index, or NULL for the whole namespace.
+ * \return       - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_create_due_index(aerospike* as, as_error* err, const as_policy_info* policy, const char* ns, const char* set);
+
+/*
+ * Remove the expired bins of the records whose expiry bucket is at or before
+ * before_time, found through the index created by as_expbin_create_due_index
+ * instead of a full scan, then wait for the background query to complete.
+ * Records without a bucket, written before DUE_BUCKET was set or by
+ * as_expbin_put_exp on a record without expbin_meta, are only cleaned by
+ * as_expbin_clean and as_expbin_clean_all.
+ *
+ * \param as          - The aerospike instance to use for this operation.
+ * \param err         - The as_error to be populated if an error occurs.
+ * \param policy      - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param query       - as_query initialized with the namespace and set to clean, without a where clause.
+ * \param before_time - Unix time in seconds, usually now.
+ * \param binlist     - List of bins to clean, or NULL for every expire bin. It is attached to query
+ *                      and destroyed with it.
+ * \return            - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_clean_due(aerospike* as, as_error* err, const as_policy_write* policy, as_query* query, int64_t before_time, as_list* binlist);
+
+/*
+ * Remove expired bins partition by partition, as an alternative to the single
+ * background scan of as_expbin_clean. Each partition is scanned for the keys of
+ * records that may hold expired bins, going by their expbin_meta summary, and
+ * those records are cleaned one by one.
+ *
+ * Partitions are shared out to config->n_threads workers and the cleaning rate
+ * is capped at config->records_per_second by the server's scan throttle. A
+ * record whose clean fails is counted in progress->failed and skipped; only a
+ * failed partition scan stops the run. With a checkpoint file, finished
+ * partitions are appended to it and skipped by a later run, so a run that
+ * failed or was killed resumes where it stopped. The file is removed once every
+ * partition is done, so the next run starts over.
+ *
+ * \param as           - The aerospike instance to use for this operation.
+ * \param err          - The as_error to be populated if an error occurs.
+ * \param scan_policy  - The policy for the partition scans. If NULL, then the default policy will be used.
+ *                      Its filter expression is replaced.
+ * \param apply_policy - The policy for cleaning each record. If NULL, then the default policy will be used.
+ * \param config       - What to clean and how.
+ * \param progress     - Progress at the end of the run, may be NULL.
+ * \return             - AEROSPIKE_OK if every partition was scanned, the first scan
+ *                       error otherwise.
+ */
+as_status as_expbin_clean_partitions(aerospike* as, as_error* err, const as_policy_scan* scan_policy, const as_policy_apply* apply_policy, const as_expbin_clean_config* config, as_expbin_clean_progress* progress);
+
+/*
+ * Read every record of a namespace or set with the expiry of its bins applied,
+ * without running the UDF. Partitions are scanned by config->n_threads
+ * workers, and each record is decoded as it arrives: live expire bins are
+ * replaced by their value, element bins by a map of their live elements,
+ * while expired ones and the module's own bins are left out. Records left
+ * with no bin are skipped. Expiries are tested against the client clock.
+ *
+ * The records are handed to config->callback one at a time, on the calling
+ * thread, through a queue of config->queue_size records. Once the queue is
+ * full the workers wait, so a slow callback slows the scans down instead of
+ * buffering the result set.
+ *
+ * \param as     - The aerospike instance to use for this operation.
+ * \param err    - The as_error to be populated if an error occurs.
+ * \param policy - The policy to use for the partition scans. If NULL, then the default policy will be used.
+ * \param config - What to read and how.
+ * \return       - AEROSPIKE_OK if successful or stopped by the callback, an error otherwise.
+ */
+as_status as_expbin_scan_live(aerospike* as, as_error* err, const as_policy_scan* policy, const as_expbin_scan_config* config);
+
+/*
+ * Remove the expired bins of a single record. The record is only rewritten
+ * if a bin was removed.
+ *
+ * \param as      - The aerospike instance to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param binlist - List of bins to clean.
+ * \param result  - Number of bins removed, nil if the record doesn't exist.
+ * \return        - AEROSPIKE_OK if successful, an error otherwise.
+ */
+as_status as_expbin_clean_record(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* binlist, as_val** result);
+
+/*
+ * Generate a map for use with batch put and touch operations.
+ *
+ * \param bin_name - Name of bin to perform op on.
+ * \param val      - Value of bin (put only), or NULL. Ownership passes to the map.
+ * \param bin_ttl  - Bin TTL (-1 for no expiration).
+ * \return         - New as_map, to be appended to the arglist or destroyed by the caller.
+ */
+as_map* as_expbin_bin_map(const char* bin_name, as_val* val, int64_t bin_ttl);
+
+//----------------------------------------------------------
+// Async API
+//
+// Each call queues one UDF apply on an event loop and returns as soon as the
+// command is sent. The argument list is serialized before returning, so it
+// may live on the caller's stack. The UDF return value is delivered to
+// listener, as described by as_async_value_listener, together with the
+// caller's udata, which is the place to keep any per-request state.
+//
+// event_loop selects the loop to run the command on. If NULL, one is picked
+// round-robin. The return value is AEROSPIKE_OK if the command was queued.
+//
+
+/*
+ * Async as_expbin_get(). listener is called with the map of bin values, or 1
+ * if the record doesn't exist.
+ */
+as_status as_expbin_get_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_async_value_listener listener, void* udata, as_event_loop* event_loop);
+
+/*
+ * Async as_expbin_get_repair(). listener is called with the map of bin values,
+ * or 1 if the record doesn't exist.
+ */
+as_status as_expbin_get_repair_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, uint32_t repair_interval, as_list* arglist, as_async_value_listener listener, void* udata, as_event_loop* event_loop);
+
+/*
+ * Async as_expbin_put(). listener is called with 0 if successfully written,
+ * 1 otherwise.
+ */
+as_status as_expbin_put_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_val* val, int64_t bin_ttl, as_async_value_listener listener, void* udata, as_event_loop* event_loop);
+
+/*
+ * Async as_expbin_puts(). listener is called with 0 if all ops succeed, 1
+ * otherwise.
+ */
+as_status as_expbin_puts_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_async_value_listener listener, void* udata, as_event_loop* event_loop);
+
+/*
+ * Async as_expbin_touch(). listener is called with 0 if all ops succeed, 1
+ * otherwise.
+ */
+as_status as_expbin_touch_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_async_value_listener listener, void* udata, as_event_loop* event_loop);
+
+/*
+ * Async as_expbin_touch_bins(). listener is called with the map of bin name
+ * to status, or 1 if the record doesn't exist.
+ */
+as_status as_expbin_touch_bins_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_async_value_listener listener, void* udata, as_event_loop* event_loop);
+
+/*
+ * Async as_expbin_ttl(). listener is called with the bin time to expire in
+ * seconds.
+ */
+as_status as_expbin_ttl_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin_name, as_async_value_listener listener, void* udata, as_event_loop* event_loop);
+
+/*
+ * Async as_expbin_clean_record(). listener is called with the number of bins
+ * removed, nil if the record doesn't exist.
+ */
+as_status as_expbin_clean_record_async(aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* binlist, as_async_value_listener listener, void* udata, as_event_loop* event_loop);
+
+//----------------------------------------------------------
+// Client-side cache
+//
+// An opt-in cache of live expire bin values for hot keys. Values read through
+// as_expbin_cache_get() are kept until their bin expires or max_stale_ms
+// passes, whichever comes first, and are served without a server round trip
+// until then. Bins that were expired or missing are cached the same way.
+//
+// The cache is a fixed-size table that is never locked: readers retry on a
+// per-entry sequence counter, and a writer that finds an entry busy simply
+// doesn't cache. Values larger than AS_EXPBIN_CACHE_VALUE_MAX bytes once
+// serialized are not cached.
+//
+// The cached write calls below invalidate the key after the write, by moving
+// on a per-key generation that every entry of the key is stamped with. A read
+// racing a local write stores its value under the old generation, so it is
+// never served. Writes made by other clients are only seen once max_stale_ms
+// has passed.
+//
+
+#define AS_EXPBIN_CACHE_VALUE_MAX 256
+
+typedef struct as_expbin_cache_s as_expbin_cache;
+
+/*
+ * Create a cache.
+ *
+ * \param n_entries    - Number of bin values the cache can hold, rounded up to a power of 2.
+ * \param max_stale_ms - How long a value may be served from the cache at most.
+ * \return             - New cache, to be destroyed with as_expbin_cache_destroy(), or NULL.
+ */
+as_expbin_cache* as_expbin_cache_create(uint32_t n_entries, uint32_t max_stale_ms);
+
+/*
+ * Destroy a cache. No other call may be using it.
+ */
+void as_expbin_cache_destroy(as_expbin_cache* cache);
+
+/*
+ * as_expbin_get_exp() served from the cache. Only bins that aren't cached are
+ * read from the server, and their values are added to the cache.
+ *
+ * \return - AEROSPIKE_OK if successful, AEROSPIKE_ERR_RECORD_NOT_FOUND if the record
+ *           doesn't exist, an error otherwise.
+ */
+as_status as_expbin_cache_get(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_operate* policy, const as_key* key, const char* bins[], uint32_t n_bins, as_val** result);
+
+/*
+ * Drop every cached bin of a key.
+ */
+void as_expbin_cache_invalidate(as_expbin_cache* cache, const as_key* key);
+
+/*
+ * Drop every cached bin.
+ */
+void as_expbin_cache_clear(as_expbin_cache* cache);
+
+/*
+ * as_expbin_put(), then invalidate the key.
+ */
+as_status as_expbin_cache_put(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_val* val, int64_t bin_ttl, as_val** result);
+
+/*
+ * as_expbin_put_exp(), then invalidate the key.
+ */
+as_status as_expbin_cache_put_exp(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_operate* policy, const as_key* key, const char* bin, as_val* val, int64_t bin_ttl, uint32_t ttl);
+
+/*
+ * as_expbin_puts(), then invalidate the key.
+ */
+as_status as_expbin_cache_puts(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_val** result);
+
+/*
+ * as_expbin_touch(), then invalidate the key.
+ */
+as_status as_expbin_cache_touch(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_val** result);
+
+/*
+ * as_expbin_touch_bins(), then invalidate the key.
+ */
+as_status as_expbin_cache_touch_bins(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_val** result);
+
+/*
+ * as_expbin_puts_ops(), then invalidate the key.
+ */
+as_status as_expbin_cache_puts_ops(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const as_expbin_bin_op* ops, uint32_t n_ops, as_val** result);
+
+/*
+ * as_expbin_touch_ops(), then invalidate the key.
+ */
+as_status as_expbin_cache_touch_ops(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const as_expbin_bin_op* ops, uint32_t n_ops, as_val** result);
+
+/*
+ * as_expbin_touch_bins_ops(), then invalidate the key.
+ */
+as_status as_expbin_cache_touch_bins_ops(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const as_expbin_bin_op* ops, uint32_t n_ops, as_val** result);
+
+/*
+ * as_expbin_clean_record(), then invalidate the key.
+ */
+as_status as_expbin_cache_clean_record(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* binlist, as_val** result);
+
+//----------------------------------------------------------
+// Instrumentation
+//
+// The key calls, sync and async, and the per-record cleans of
+// as_expbin_clean_partitions(), report their latency and outcome to a
+// listener set once for the process with as_expbin_set_listener(). Without a
+// listener a call only pays for one extra pointer load. The latency is
+// measured on the client and includes the network; comparing as_expbin_get()
+// with as_expbin_get_exp(), which doesn't run Lua, shows the share of the UDF.
+//
+// as_expbin_stats is a ready-made listener keeping a latency histogram and
+// outcome counters per call. It never locks or allocates, and can be left on
+// in production.
+//
+
+typedef enum as_expbin_op_e {
+	AS_EXPBIN_OP_GET,
+	AS_EXPBIN_OP_GET_REPAIR,
+	AS_EXPBIN_OP_GET_EXP,
+	AS_EXPBIN_OP_GET_MANY,
+	AS_EXPBIN_OP_PUT,
+	AS_EXPBIN_OP_PUT_EXP,
+	AS_EXPBIN_OP_PUTS,
+	AS_EXPBIN_OP_TOUCH,
+	AS_EXPBIN_OP_TOUCH_BINS,
+	AS_EXPBIN_OP_TTL,
+	AS_EXPBIN_OP_CLEAN_RECORD,
+	AS_EXPBIN_OP_PUT_ELEM,
+	AS_EXPBIN_OP_GET_ELEMS,
+	AS_EXPBIN_OP_TRIM,
+	AS_EXPBIN_OP_COUNT
+} as_expbin_op;
+
+typedef enum as_expbin_outcome_e {
+	// Bins read live by a get, live elements read by get_elems, or a live bin
+	// for ttl.
+	AS_EXPBIN_OUTCOME_HIT,
+	// Bins asked for by a get that were expired or never written, or a ttl
+	// on a bin that is expired, not an expire bin, or whose record doesn't
+	// exist.
+	AS_EXPBIN_OUTCOME_EXPIRED,
+	// Calls on a record that doesn't exist.
+	AS_EXPBIN_OUTCOME_MISSING,
+	// Expired bins removed by a clean, or expired elements dropped by a trim.
+	AS_EXPBIN_OUTCOME_RECLAIMED,
+	// Writes and touches refused because a bin TTL is invalid or exceeds the
+	// record TTL. For touch_bins, one per refused bin.
+	AS_EXPBIN_OUTCOME_REJECTED,
+	// Calls that failed.
+	AS_EXPBIN_OUTCOME_ERROR,
+	AS_EXPBIN_OUTCOME_COUNT
+} as_expbin_outcome;
+
+/*
+ * Receives the instrumentation of every call, from the thread that made it, or
+ * for async calls from the event loop, before the call's own listener. Both
+ * callbacks must be set.
+ */
+typedef struct as_expbin_listener_s {
+	// Called once per call with its client side latency.
+	void (*on_latency)(as_expbin_op op, uint64_t latency_ns, void* udata);
+
+	// Called after on_latency for each outcome of the call with a non-zero count.
+	void (*on_outcome)(as_expbin_op op, as_expbin_outcome outcome, uint32_t count, void* udata);
+
+	void* udata;
+} as_expbin_listener;
+
+/*
+ * Set the listener of every following call, or NULL to stop reporting. Meant
+ * to be called once at startup; the listener must outlive its use.
+ */
+void as_expbin_set_listener(const as_expbin_listener* listener);
+
+/*
+ * Name of an op or outcome, for exporting.
+ */
+const char* as_expbin_op_name(as_expbin_op op);
+const char* as_expbin_outcome_name(as_expbin_outcome outcome);
+
+typedef struct as_expbin_stats_s as_expbin_stats;
+
+/*
+ * Create an empty set of statistics.
+ *
+ * \return - New stats, to be destroyed with as_expbin_stats_destroy(), or NULL.
+ */
+as_expbin_stats* as_expbin_stats_create(void);
+
+/*
+ * Destroy stats. They must no longer be the listener.
+ */
+void as_expbin_stats_destroy(as_expbin_stats* stats);
+
+/*
+ * Fill in a listener that records into the stats, to pass to
+ * as_expbin_set_listener().
+ */
+void as_expbin_stats_listener(as_expbin_stats* stats, as_expbin_listener* listener);
+
+/*
+ * Number of calls recorded for an op.
+ */
+uint64_t as_expbin_stats_count(const as_expbin_stats* stats, as_expbin_op op);
+
+/*
+ * Latency percentile of an op in microseconds, within about 6%.
+ *
+ * \param pct - Percentile, e.g. 99.9.
+ */
+uint64_t as_expbin_stats_percentile(const as_expbin_stats* stats, as_expbin_op op, double pct);
+
+/*
+ * Highest latency of an op in microseconds.
+ */
+uint64_t as_expbin_stats_max(const as_expbin_stats* stats, as_expbin_op op);
+
+/*
+ * Total count of an outcome of an op.
+ */
+uint64_t as_expbin_stats_outcomes(const as_expbin_stats* stats, as_expbin_op op, as_expbin_outcome outcome);
+
+/*
+ * Clear every histogram and counter. Calls recorded meanwhile may be partly
+ * lost.
+ */
+void as_expbin_stats_reset(as_expbin_stats* stats);
+
+//----------------------------------------------------------
+// Codec
+//
+// Reads expire bins straight from records fetched with plain gets, scans or
+// queries, so that bulk readers can decide which bins are live without
+// running the UDF. Expire bins written by any version of the module are
+// recognized. Nothing is copied: decoded values point into the record, except
+// for the maps of live elements built from element bins.
+//
+// as_expbin_batch gathers the expire bins of many records with their expiries
+// in one contiguous array, and tests them all in a single vectorized pass.
+// Liveness is decided against the client clock, so clock skew with the
+// server shifts expirations by as much.
+//
+
+/*
+ * Expire bins of the records added to a batch. Bin i of the batch is
+ * described by element i of each array.
+ */
+typedef struct as_expbin_batch_s {
+	// Expiry, in seconds since AS_EXPBIN_CITRUSLEAF_EPOCH, 0 if it doesn't expire.
+	uint32_t* expiries;
+
+	// Value, NULL for nil. Owned by the record.
+	as_val** data;
+
+	// Bin name. Owned by the record.
+	const char** bins;
+
+	// Index of the record in the order the records were added.
+	uint32_t* records;
+
+	// 1 if live, 0 if expired, set by as_expbin_batch_eval().
+	uint8_t* live;
+
+	uint32_t size;
+	uint32_t capacity;
+	uint32_t n_records;
+} as_expbin_batch;
+
+/*
+ * Current time in seconds since AS_EXPBIN_CITRUSLEAF_EPOCH, by the client clock.
+ */
+uint32_t as_expbin_now(void);
+
+/*
+ * Whether a bin of the given expiry is live at now.
+ */
+static inline bool
+as_expbin_live(uint32_t expiry, uint32_t now)
+{
+	return expiry == 0 || now <= expiry;
+}
+
+/*
+ * Decode a bin value if it is an expire bin.
+ *
+ * \param val    - The bin value.
+ * \param expiry - Set to the expiry in seconds since AS_EXPBIN_CITRUSLEAF_EPOCH, 0 if it doesn't expire.
+ * \param data   - Set to the stored value, owned by val. NULL for nil.
+ * \return       - true if val is an expire bin.
+ */
+bool as_expbin_decode(const as_val* val, uint32_t* expiry, as_val** data);
+
+/*
+ * Decode a bin value if it is an element bin. Unlike as_expbin_decode(), the
+ * live elements are gathered in a new map, which holds references into val.
+ *
+ * \param val    - The bin value.
+ * \param now    - Time to test the element expiries against, usually as_expbin_now().
+ * \param elems  - Set to a new map of element key to value, to be destroyed by the
+ *                 caller, or NULL if no element is live.
+ * \param failed - Set to true if the map couldn't be allocated. elems is NULL then.
+ * \return       - true if val is an element bin.
+ */
+bool as_expbin_decode_elems(const as_val* val, uint32_t now, as_map** elems, bool* failed);
+
+/*
+ * Initialize an empty batch with room for capacity bins.
+ *
+ * \return - false if memory couldn't be allocated.
+ */
+bool as_expbin_batch_init(as_expbin_batch* batch, uint32_t capacity);
+
+/*
+ * Free the memory of a batch.
+ */
+void as_expbin_batch_destroy(as_expbin_batch* batch);
+
+/*
+ * Empty a batch, keeping its memory for the next records.
+ */
+void as_expbin_batch_clear(as_expbin_batch* batch);
+
+/*
+ * Add the expire bins of a record to a batch. Other bins are skipped. The
+ * record must not be destroyed before the batch is cleared.
+ *
+ * \return - false if the batch couldn't grow, in which case nothing is added.
+ */
+bool as_expbin_batch_add(as_expbin_batch* batch, const as_record* rec);
+
+/*
+ * Set the live flag of every bin of a batch.
+ *
+ * \param now - Time to test against, usually as_expbin_now().
+ * \return    - Number of live bins.
+ */
+uint32_t as_expbin_batch_eval(as_expbin_batch* batch, uint32_t now);
+
+#ifdef __cplusplus
+} // end extern "C"
+#endif
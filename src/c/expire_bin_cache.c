@@ -0,0 +1,505 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+//==========================================================
+// Includes
+//
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <aerospike/as_buffer.h>
+#include <aerospike/as_hashmap.h>
+#include <aerospike/as_msgpack.h>
+#include <aerospike/as_serializer.h>
+#include <aerospike/as_stringmap.h>
+
+#include "expire_bin.h"
+
+
+//==========================================================
+// Constants
+//
+
+// Entries per bucket. Each bin of a key hashes to its own bucket, so a hot
+// key with many bins doesn't evict its own entries.
+#define CACHE_WAYS 4
+
+
+//==========================================================
+// Typedefs
+//
+
+typedef struct expbin_cache_entry_s {
+	// Odd while the entry is being written.
+	uint32_t seq;
+
+	// Serialized value size, 0 if the bin was expired or missing.
+	uint32_t value_size;
+
+	// Generation of the key's slot when the value was read. The entry is
+	// stale once the slot moves on.
+	uint32_t gen;
+
+	// Local time in ms until which the entry may be served, 0 if empty.
+	uint64_t until_ms;
+
+	uint8_t digest[AS_DIGEST_VALUE_SIZE];
+	char ns[AS_NAMESPACE_MAX_SIZE];
+	char bin[AS_BIN_NAME_MAX_SIZE];
+	uint8_t value[AS_EXPBIN_CACHE_VALUE_MAX];
+} expbin_cache_entry;
+
+struct as_expbin_cache_s {
+	uint32_t bucket_mask;
+	uint32_t max_stale_ms;
+	expbin_cache_entry* entries;
+
+	// Per-key generations, one slot per bucket picked by the digest alone.
+	// Bumping a slot invalidates every bin of the keys that share it.
+	uint32_t* gens;
+};
+
+
+//==========================================================
+// Local helpers
+//
+
+static uint64_t
+cache_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t
+cache_key_hash(const uint8_t* digest)
+{
+	// Digests are uniformly distributed, so any 4 bytes make a good hash.
+	uint32_t hash;
+	memcpy(&hash, digest, sizeof(hash));
+	return hash;
+}
+
+// Hash of a bin of a key, mixed so that bins of the same key spread over
+// the whole table.
+static uint32_t
+cache_bin_hash(const uint8_t* digest, const char* bin)
+{
+	uint32_t hash = cache_key_hash(digest);
+
+	for (const char* p = bin; *p; p++) {
+		hash = hash * 31 + (uint8_t)*p;
+	}
+
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	return hash;
+}
+
+static uint32_t*
+cache_gen_slot(as_expbin_cache* cache, const uint8_t* digest)
+{
+	return &cache->gens[cache_key_hash(digest) & cache->bucket_mask];
+}
+
+static bool
+cache_matches(const expbin_cache_entry* e, const uint8_t* digest, const char* ns, const char* bin)
+{
+	return memcmp(e->digest, digest, AS_DIGEST_VALUE_SIZE) == 0 &&
+		strncmp(e->bin, bin, AS_BIN_NAME_MAX_SIZE) == 0 &&
+		strncmp(e->ns, ns, AS_NAMESPACE_MAX_SIZE) == 0;
+}
+
+// Start writing an entry. Fails instead of waiting if another writer has it.
+static bool
+cache_lock(expbin_cache_entry* e)
+{
+	uint32_t seq = __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+
+	if ((seq & 1) != 0 ||
+			!__atomic_compare_exchange_n(&e->seq, &seq, seq + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		return false;
+	}
+
+	// Readers that see the new fields must also see the odd sequence.
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return true;
+}
+
+static void
+cache_unlock(expbin_cache_entry* e)
+{
+	__atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELEASE);
+}
+
+// Copy the value of the live entry of a bin. Returns false on a miss, which
+// includes running into a concurrent write.
+static bool
+cache_lookup(as_expbin_cache* cache, const uint8_t* digest, const char* ns, const char* bin, uint32_t gen, uint64_t now, uint8_t* value, uint32_t* value_size)
+{
+	uint32_t hash = cache_bin_hash(digest, bin);
+	expbin_cache_entry* bucket = &cache->entries[(hash & cache->bucket_mask) * CACHE_WAYS];
+
+	for (uint32_t w = 0; w < CACHE_WAYS; w++) {
+		expbin_cache_entry* e = &bucket[w];
+		uint32_t seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+
+		if ((seq & 1) != 0) {
+			continue;
+		}
+
+		bool hit = e->until_ms > now && e->gen == gen && cache_matches(e, digest, ns, bin);
+		uint32_t size = e->value_size;
+
+		if (hit && size <= AS_EXPBIN_CACHE_VALUE_MAX) {
+			memcpy(value, e->value, size);
+		}
+
+		// The copy is only good if no writer started meanwhile.
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (hit && __atomic_load_n(&e->seq, __ATOMIC_RELAXED) == seq) {
+			*value_size = size;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void
+cache_store(as_expbin_cache* cache, const uint8_t* digest, const char* ns, const char* bin, uint32_t gen, const uint8_t* value, uint32_t value_size, uint64_t until_ms, uint64_t now)
+{
+	uint32_t hash = cache_bin_hash(digest, bin);
+	expbin_cache_entry* bucket = &cache->entries[(hash & cache->bucket_mask) * CACHE_WAYS];
+
+	// Reuse the entry of the same bin, else an empty or stale one, else
+	// evict one picked by the high bits of the hash.
+	expbin_cache_entry* victim = NULL;
+	expbin_cache_entry* free_entry = NULL;
+
+	for (uint32_t w = 0; w < CACHE_WAYS; w++) {
+		expbin_cache_entry* e = &bucket[w];
+
+		if (cache_matches(e, digest, ns, bin)) {
+			victim = e;
+			break;
+		}
+
+		if (!free_entry && e->until_ms <= now) {
+			free_entry = e;
+		}
+	}
+
+	if (!victim) {
+		victim = free_entry ? free_entry : &bucket[(hash >> 24) % CACHE_WAYS];
+	}
+
+	if (!cache_lock(victim)) {
+		return;
+	}
+
+	memcpy(victim->digest, digest, AS_DIGEST_VALUE_SIZE);
+	strncpy(victim->ns, ns, AS_NAMESPACE_MAX_SIZE);
+	strncpy(victim->bin, bin, AS_BIN_NAME_MAX_SIZE);
+	memcpy(victim->value, value, value_size);
+	victim->value_size = value_size;
+	victim->gen = gen;
+	victim->until_ms = until_ms;
+
+	cache_unlock(victim);
+}
+
+// Clear an entry, waiting for a concurrent writer to finish.
+static void
+cache_drop(expbin_cache_entry* e)
+{
+	while (!cache_lock(e)) {
+		sched_yield();
+	}
+
+	e->until_ms = 0;
+	cache_unlock(e);
+}
+
+
+//==========================================================
+// Public API
+//
+
+as_expbin_cache*
+as_expbin_cache_create(uint32_t n_entries, uint32_t max_stale_ms)
+{
+	uint32_t n_buckets = 1;
+
+	while (n_buckets * CACHE_WAYS < n_entries) {
+		n_buckets <<= 1;
+	}
+
+	as_expbin_cache* cache = (as_expbin_cache*)malloc(sizeof(as_expbin_cache));
+
+	if (!cache) {
+		return NULL;
+	}
+
+	cache->entries = (expbin_cache_entry*)calloc(n_buckets * CACHE_WAYS, sizeof(expbin_cache_entry));
+
+	if (!cache->entries) {
+		free(cache);
+		return NULL;
+	}
+
+	cache->gens = (uint32_t*)calloc(n_buckets, sizeof(uint32_t));
+
+	if (!cache->gens) {
+		free(cache->entries);
+		free(cache);
+		return NULL;
+	}
+
+	cache->bucket_mask = n_buckets - 1;
+	cache->max_stale_ms = max_stale_ms;
+	return cache;
+}
+
+void
+as_expbin_cache_destroy(as_expbin_cache* cache)
+{
+	free(cache->gens);
+	free(cache->entries);
+	free(cache);
+}
+
+as_status
+as_expbin_cache_get(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_operate* policy, const as_key* key, const char* bins[], uint32_t n_bins, as_val** result)
+{
+	as_digest* digest = as_key_digest((as_key*)key);
+
+	if (!digest) {
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to compute key digest");
+	}
+
+	// Read before the server, so a value fetched across a local write is
+	// stored with the old generation and never served.
+	uint32_t gen = __atomic_load_n(cache_gen_slot(cache, digest->value), __ATOMIC_ACQUIRE);
+	uint64_t now = cache_now_ms();
+	uint8_t value[AS_EXPBIN_CACHE_VALUE_MAX];
+	uint32_t value_size;
+
+	as_hashmap* map = as_hashmap_new(n_bins);
+
+	if (!map) {
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to allocate result map");
+	}
+
+	const char** missed = (const char**)malloc(sizeof(const char*) * n_bins);
+	uint32_t n_missed = 0;
+
+	if (!missed) {
+		as_hashmap_destroy(map);
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to allocate missed bins");
+	}
+
+	as_serializer ser;
+	as_msgpack_init(&ser);
+
+	for (uint32_t i = 0; i < n_bins; i++) {
+		if (!cache_lookup(cache, digest->value, key->ns, bins[i], gen, now, value, &value_size)) {
+			missed[n_missed++] = bins[i];
+			continue;
+		}
+
+		if (value_size == 0) {
+			// Cached as expired or missing.
+			continue;
+		}
+
+		as_buffer buffer = { .capacity = value_size, .size = value_size, .data = value };
+		as_val* data = NULL;
+
+		if (as_serializer_deserialize(&ser, &buffer, &data) == 0 && data) {
+			as_stringmap_set((as_map*)map, bins[i], data);
+		}
+	}
+
+	if (n_missed > 0) {
+		as_val* fetched = NULL;
+		as_status rc = as_expbin_get_exp_entries(as, err, policy, key, missed, n_missed, &fetched);
+
+		if (rc != AEROSPIKE_OK) {
+			free(missed);
+			as_hashmap_destroy(map);
+			as_serializer_destroy(&ser);
+			return rc;
+		}
+
+		uint64_t stale_ms = now + cache->max_stale_ms;
+
+		for (uint32_t i = 0; i < n_missed; i++) {
+			as_list* entry = as_list_fromval(as_stringmap_get((as_map*)fetched, missed[i]));
+			uint64_t until_ms = stale_ms;
+			value_size = 0;
+
+			if (entry) {
+				int64_t expiry = as_list_get_int64(entry, 0);
+				as_val* data = as_list_get(entry, 1);
+
+				if (expiry != 0) {
+					uint64_t expiry_ms = (uint64_t)(expiry + AS_EXPBIN_CITRUSLEAF_EPOCH) * 1000;
+
+					if (expiry_ms < until_ms) {
+						until_ms = expiry_ms;
+					}
+				}
+
+				value_size = as_serializer_serialize_getsize(&ser, data);
+
+				// Too big to cache, or it could be confused with a cached miss.
+				if (value_size == 0 || value_size > AS_EXPBIN_CACHE_VALUE_MAX) {
+					until_ms = 0;
+				}
+				else {
+					as_serializer_serialize_presized(&ser, data, value);
+				}
+
+				as_val_reserve(data);
+				as_stringmap_set((as_map*)map, missed[i], data);
+			}
+
+			if (until_ms > now) {
+				cache_store(cache, digest->value, key->ns, missed[i], gen, value, value_size, until_ms, now);
+			}
+		}
+
+		as_val_destroy(fetched);
+	}
+
+	free(missed);
+	as_serializer_destroy(&ser);
+	*result = (as_val*)map;
+	return AEROSPIKE_OK;
+}
+
+void
+as_expbin_cache_invalidate(as_expbin_cache* cache, const as_key* key)
+{
+	as_digest* digest = as_key_digest((as_key*)key);
+
+	if (!digest) {
+		return;
+	}
+
+	// The key's entries are spread over the table, so retire them all at
+	// once by moving its generation on.
+	__atomic_fetch_add(cache_gen_slot(cache, digest->value), 1, __ATOMIC_RELEASE);
+}
+
+void
+as_expbin_cache_clear(as_expbin_cache* cache)
+{
+	uint32_t n_entries = (cache->bucket_mask + 1) * CACHE_WAYS;
+
+	for (uint32_t i = 0; i < n_entries; i++) {
+		cache_drop(&cache->entries[i]);
+	}
+}
+
+//----------------------------------------------------------
+// Cached writes
+//
+
+as_status
+as_expbin_cache_put(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_val* val, int64_t bin_ttl, as_val** result)
+{
+	as_status rc = as_expbin_put(as, err, policy, key, bin, val, bin_ttl, result);
+	as_expbin_cache_invalidate(cache, key);
+	return rc;
+}
+
+as_status
+as_expbin_cache_put_exp(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_operate* policy, const as_key* key, const char* bin, as_val* val, int64_t bin_ttl, uint32_t ttl)
+{
+	as_status rc = as_expbin_put_exp(as, err, policy, key, bin, val, bin_ttl, ttl);
+	as_expbin_cache_invalidate(cache, key);
+	return rc;
+}
+
+as_status
+as_expbin_cache_puts(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_val** result)
+{
+	as_status rc = as_expbin_puts(as, err, policy, key, arglist, result);
+	as_expbin_cache_invalidate(cache, key);
+	return rc;
+}
+
+as_status
+as_expbin_cache_touch(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_val** result)
+{
+	as_status rc = as_expbin_touch(as, err, policy, key, arglist, result);
+	as_expbin_cache_invalidate(cache, key);
+	return rc;
+}
+
+as_status
+as_expbin_cache_touch_bins(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* arglist, as_val** result)
+{
+	as_status rc = as_expbin_touch_bins(as, err, policy, key, arglist, result);
+	as_expbin_cache_invalidate(cache, key);
+	return rc;
+}
+
+as_status
+as_expbin_cache_puts_ops(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const as_expbin_bin_op* ops, uint32_t n_ops, as_val** result)
+{
+	as_status rc = as_expbin_puts_ops(as, err, policy, key, ops, n_ops, result);
+	as_expbin_cache_invalidate(cache, key);
+	return rc;
+}
+
+as_status
+as_expbin_cache_touch_ops(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const as_expbin_bin_op* ops, uint32_t n_ops, as_val** result)
+{
+	as_status rc = as_expbin_touch_ops(as, err, policy, key, ops, n_ops, result);
+	as_expbin_cache_invalidate(cache, key);
+	return rc;
+}
+
+as_status
+as_expbin_cache_touch_bins_ops(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, const as_expbin_bin_op* ops, uint32_t n_ops, as_val** result)
+{
+	as_status rc = as_expbin_touch_bins_ops(as, err, policy, key, ops, n_ops, result);
+	as_expbin_cache_invalidate(cache, key);
+	return rc;
+}
+
+as_status
+as_expbin_cache_clean_record(as_expbin_cache* cache, aerospike* as, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* binlist, as_val** result)
+{
+	as_status rc = as_expbin_clean_record(as, err, policy, key, binlist, result);
+	as_expbin_cache_invalidate(cache, key);
+	return rc;
+}
@@ -0,0 +1,301 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+//==========================================================
+// Includes
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <aerospike/as_bin.h>
+#include <aerospike/as_hashmap.h>
+#include <aerospike/as_integer.h>
+#include <aerospike/as_list.h>
+#include <aerospike/as_map.h>
+#include <aerospike/as_record.h>
+#include <aerospike/as_string.h>
+
+#include "expire_bin.h"
+
+
+//==========================================================
+// Constants
+//
+
+// Expire bins are stored as [CODEC_TAG, expiry, data], or by older versions
+// of the module as {CODEC_EXPIRY: expiry, CODEC_DATA: data}.
+#define CODEC_TAG -25
+#define CODEC_EXPIRY "expbin_ttl"
+#define CODEC_DATA "data"
+
+// Element bins are stored as [CODEC_ELEM_TAG, entries], each entry being
+// [expiry, key, val], sorted by expiry with 0 last.
+#define CODEC_ELEM_TAG -26
+
+#define CODEC_MIN_CAPACITY 1024
+
+
+//==========================================================
+// Local helpers
+//
+
+// Expiries are int64 on the server. Negative ones are never written by the
+// module and are taken as long past, and ones past 2146 as that year.
+static bool
+codec_expiry(const as_val* val, uint32_t* expiry)
+{
+	as_integer* i = as_integer_fromval(val);
+
+	if (!i) {
+		return false;
+	}
+
+	int64_t v = as_integer_get(i);
+
+	*expiry = v < 0 ? 1 : v > UINT32_MAX ? UINT32_MAX : (uint32_t)v;
+	return true;
+}
+
+static bool
+codec_decode_list(const as_list* list, uint32_t* expiry, as_val** data)
+{
+	if (as_list_size(list) != 3) {
+		return false;
+	}
+
+	as_integer* tag = as_integer_fromval(as_list_get(list, 0));
+
+	if (!tag || as_integer_get(tag) != CODEC_TAG || !codec_expiry(as_list_get(list, 1), expiry)) {
+		return false;
+	}
+
+	*data = as_list_get(list, 2);
+	return true;
+}
+
+static bool
+codec_decode_map(const as_map* map, uint32_t* expiry, as_val** data)
+{
+	as_string key;
+
+	as_string_init(&key, CODEC_EXPIRY, false);
+
+	if (!codec_expiry(as_map_get(map, (as_val*)&key), expiry)) {
+		return false;
+	}
+
+	as_string_init(&key, CODEC_DATA, false);
+	*data = as_map_get(map, (as_val*)&key);
+	return true;
+}
+
+// Make room for n more bins. Arrays already grown stay grown if a later one
+// fails, which is harmless.
+static bool
+codec_batch_reserve(as_expbin_batch* batch, uint32_t n)
+{
+	if (batch->size + n <= batch->capacity) {
+		return true;
+	}
+
+	uint32_t capacity = batch->capacity ? batch->capacity : CODEC_MIN_CAPACITY;
+
+	while (capacity < batch->size + n) {
+		capacity *= 2;
+	}
+
+	void* p;
+
+	if (!(p = realloc(batch->expiries, capacity * sizeof(uint32_t)))) {
+		return false;
+	}
+	batch->expiries = p;
+
+	if (!(p = realloc(batch->data, capacity * sizeof(as_val*)))) {
+		return false;
+	}
+	batch->data = p;
+
+	if (!(p = realloc(batch->bins, capacity * sizeof(const char*)))) {
+		return false;
+	}
+	batch->bins = p;
+
+	if (!(p = realloc(batch->records, capacity * sizeof(uint32_t)))) {
+		return false;
+	}
+	batch->records = p;
+
+	if (!(p = realloc(batch->live, capacity))) {
+		return false;
+	}
+	batch->live = p;
+
+	batch->capacity = capacity;
+	return true;
+}
+
+
+//==========================================================
+// Public API
+//
+
+uint32_t
+as_expbin_now(void)
+{
+	return (uint32_t)(time(NULL) - AS_EXPBIN_CITRUSLEAF_EPOCH);
+}
+
+bool
+as_expbin_decode(const as_val* val, uint32_t* expiry, as_val** data)
+{
+	if (!val) {
+		return false;
+	}
+
+	switch (as_val_type(val)) {
+	case AS_LIST:
+		return codec_decode_list((const as_list*)val, expiry, data);
+
+	case AS_MAP:
+		return codec_decode_map((const as_map*)val, expiry, data);
+
+	default:
+		return false;
+	}
+}
+
+bool
+as_expbin_decode_elems(const as_val* val, uint32_t now, as_map** elems, bool* failed)
+{
+	*failed = false;
+
+	as_list* list = as_list_fromval((as_val*)val);
+
+	if (!list || as_list_size(list) != 2) {
+		return false;
+	}
+
+	as_integer* tag = as_integer_fromval(as_list_get(list, 0));
+	as_list* entries = as_list_fromval(as_list_get(list, 1));
+
+	if (!tag || as_integer_get(tag) != CODEC_ELEM_TAG || !entries) {
+		return false;
+	}
+
+	uint32_t size = as_list_size(entries);
+	as_map* map = NULL;
+
+	for (uint32_t i = 0; i < size; i++) {
+		as_list* entry = as_list_fromval(as_list_get(entries, i));
+		uint32_t expiry;
+
+		if (!entry || as_list_size(entry) != 3 || !codec_expiry(as_list_get(entry, 0), &expiry) ||
+				!as_expbin_live(expiry, now)) {
+			continue;
+		}
+
+		if (!map) {
+			map = (as_map*)as_hashmap_new(size - i);
+
+			if (!map) {
+				*failed = true;
+				break;
+			}
+		}
+
+		as_map_set(map, as_val_reserve(as_list_get(entry, 1)), as_val_reserve(as_list_get(entry, 2)));
+	}
+
+	*elems = map;
+	return true;
+}
+
+bool
+as_expbin_batch_init(as_expbin_batch* batch, uint32_t capacity)
+{
+	memset(batch, 0, sizeof(as_expbin_batch));
+	return capacity == 0 || codec_batch_reserve(batch, capacity);
+}
+
+void
+as_expbin_batch_destroy(as_expbin_batch* batch)
+{
+	free(batch->expiries);
+	free(batch->data);
+	free(batch->bins);
+	free(batch->records);
+	free(batch->live);
+	memset(batch, 0, sizeof(as_expbin_batch));
+}
+
+void
+as_expbin_batch_clear(as_expbin_batch* batch)
+{
+	batch->size = 0;
+	batch->n_records = 0;
+}
+
+bool
+as_expbin_batch_add(as_expbin_batch* batch, const as_record* rec)
+{
+	if (!codec_batch_reserve(batch, rec->bins.size)) {
+		return false;
+	}
+
+	uint32_t r = batch->n_records++;
+
+	for (uint32_t i = 0; i < rec->bins.size; i++) {
+		const as_bin* bin = &rec->bins.entries[i];
+		uint32_t n = batch->size;
+
+		if (as_expbin_decode((as_val*)as_bin_get_value(bin), &batch->expiries[n], &batch->data[n])) {
+			batch->bins[n] = as_bin_get_name(bin);
+			batch->records[n] = r;
+			batch->size++;
+		}
+	}
+	return true;
+}
+
+// Branch free so that the compiler vectorizes the loop: an expiry of 0 wraps
+// to UINT32_MAX and is always live.
+uint32_t
+as_expbin_batch_eval(as_expbin_batch* batch, uint32_t now)
+{
+	const uint32_t* restrict expiries = batch->expiries;
+	uint8_t* restrict live = batch->live;
+	uint32_t size = batch->size;
+	uint32_t limit = now - 1;
+	uint32_t n_live = 0;
+
+	for (uint32_t i = 0; i < size; i++) {
+		uint8_t l = expiries[i] - 1 >= limit;
+
+		live[i] = l;
+		n_live += l;
+	}
+	return n_live;
+}
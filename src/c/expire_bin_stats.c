@@ -0,0 +1,208 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+//==========================================================
+// Includes
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "expire_bin.h"
+
+
+//==========================================================
+// Constants
+//
+
+// Latency histogram in us: values below STATS_SUB are exact, above that each
+// power of two is split in STATS_SUB buckets, within about 6% of the value.
+#define STATS_SUB_BITS 4
+#define STATS_SUB (1 << STATS_SUB_BITS)
+#define STATS_BUCKETS (64 * STATS_SUB)
+
+static const char* OP_NAMES[AS_EXPBIN_OP_COUNT] = {
+	"get", "get_repair", "get_exp", "get_many", "put", "put_exp", "puts", "touch", "touch_bins", "ttl", "clean_record",
+	"put_elem", "get_elems", "trim"
+};
+
+static const char* OUTCOME_NAMES[AS_EXPBIN_OUTCOME_COUNT] = {
+	"hit", "expired", "missing", "reclaimed", "rejected", "error"
+};
+
+
+//==========================================================
+// Typedefs
+//
+
+typedef struct stats_op_s {
+	uint64_t counts[STATS_BUCKETS];
+	uint64_t n;
+	uint64_t max_us;
+	uint64_t outcomes[AS_EXPBIN_OUTCOME_COUNT];
+} stats_op;
+
+struct as_expbin_stats_s {
+	stats_op ops[AS_EXPBIN_OP_COUNT];
+};
+
+
+//==========================================================
+// Local helpers
+//
+
+static uint32_t
+stats_index(uint64_t us)
+{
+	if (us < STATS_SUB) {
+		return (uint32_t)us;
+	}
+
+	uint32_t msb = 63 - __builtin_clzll(us);
+	uint32_t sub = (uint32_t)(us >> (msb - STATS_SUB_BITS)) & (STATS_SUB - 1);
+
+	return (msb - STATS_SUB_BITS + 1) * STATS_SUB + sub;
+}
+
+// Midpoint of the values falling into a bucket.
+static uint64_t
+stats_value(uint32_t index)
+{
+	uint32_t group = index / STATS_SUB;
+	uint32_t sub = index % STATS_SUB;
+
+	if (group == 0) {
+		return sub;
+	}
+
+	uint32_t shift = group - 1;
+	uint64_t low = (uint64_t)(STATS_SUB + sub) << shift;
+
+	return low + ((1ULL << shift) >> 1);
+}
+
+// Counters are only ever added to, so relaxed increments are enough. Readers
+// may see a call in the histogram before its outcomes.
+static void
+stats_on_latency(as_expbin_op op, uint64_t latency_ns, void* udata)
+{
+	stats_op* s = &((as_expbin_stats*)udata)->ops[op];
+	uint64_t us = latency_ns / 1000;
+
+	__atomic_fetch_add(&s->counts[stats_index(us)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&s->n, 1, __ATOMIC_RELAXED);
+
+	uint64_t max = __atomic_load_n(&s->max_us, __ATOMIC_RELAXED);
+
+	while (us > max && !__atomic_compare_exchange_n(&s->max_us, &max, us, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+}
+
+static void
+stats_on_outcome(as_expbin_op op, as_expbin_outcome outcome, uint32_t count, void* udata)
+{
+	stats_op* s = &((as_expbin_stats*)udata)->ops[op];
+	__atomic_fetch_add(&s->outcomes[outcome], count, __ATOMIC_RELAXED);
+}
+
+
+//==========================================================
+// Public API
+//
+
+const char*
+as_expbin_op_name(as_expbin_op op)
+{
+	return op < AS_EXPBIN_OP_COUNT ? OP_NAMES[op] : "unknown";
+}
+
+const char*
+as_expbin_outcome_name(as_expbin_outcome outcome)
+{
+	return outcome < AS_EXPBIN_OUTCOME_COUNT ? OUTCOME_NAMES[outcome] : "unknown";
+}
+
+as_expbin_stats*
+as_expbin_stats_create(void)
+{
+	return (as_expbin_stats*)calloc(1, sizeof(as_expbin_stats));
+}
+
+void
+as_expbin_stats_destroy(as_expbin_stats* stats)
+{
+	free(stats);
+}
+
+void
+as_expbin_stats_listener(as_expbin_stats* stats, as_expbin_listener* listener)
+{
+	listener->on_latency = stats_on_latency;
+	listener->on_outcome = stats_on_outcome;
+	listener->udata = stats;
+}
+
+uint64_t
+as_expbin_stats_count(const as_expbin_stats* stats, as_expbin_op op)
+{
+	return __atomic_load_n(&stats->ops[op].n, __ATOMIC_RELAXED);
+}
+
+uint64_t
+as_expbin_stats_percentile(const as_expbin_stats* stats, as_expbin_op op, double pct)
+{
+	const stats_op* s = &stats->ops[op];
+	uint64_t target = (uint64_t)(__atomic_load_n(&s->n, __ATOMIC_RELAXED) * pct / 100.0 + 0.5);
+	uint64_t seen = 0;
+
+	if (target == 0) {
+		target = 1;
+	}
+
+	for (uint32_t i = 0; i < STATS_BUCKETS; i++) {
+		seen += __atomic_load_n(&s->counts[i], __ATOMIC_RELAXED);
+
+		if (seen >= target) {
+			return stats_value(i);
+		}
+	}
+	return __atomic_load_n(&s->max_us, __ATOMIC_RELAXED);
+}
+
+uint64_t
+as_expbin_stats_max(const as_expbin_stats* stats, as_expbin_op op)
+{
+	return __atomic_load_n(&stats->ops[op].max_us, __ATOMIC_RELAXED);
+}
+
+uint64_t
+as_expbin_stats_outcomes(const as_expbin_stats* stats, as_expbin_op op, as_expbin_outcome outcome)
+{
+	return __atomic_load_n(&stats->ops[op].outcomes[outcome], __ATOMIC_RELAXED);
+}
+
+void
+as_expbin_stats_reset(as_expbin_stats* stats)
+{
+	memset(stats, 0, sizeof(as_expbin_stats));
+}
@@ -15,36 +15,164 @@
  * the License.
  */
 
+import java.util.Arrays;
 import java.util.HashMap;
+import java.util.List;
 import java.util.Map;
+import java.util.concurrent.CompletableFuture;
 import java.util.concurrent.TimeUnit;
+import java.util.stream.IntStream;
 
 import com.aerospike.client.AerospikeClient;
 import com.aerospike.client.AerospikeException;
+import com.aerospike.client.BatchRecord;
+import com.aerospike.client.BatchResults;
 import com.aerospike.client.Key;
 import com.aerospike.client.Language;
+import com.aerospike.client.Operation;
 import com.aerospike.client.Record;
+import com.aerospike.client.ResultCode;
 import com.aerospike.client.Value;
 import com.aerospike.client.Value.MapValue;
+import com.aerospike.client.async.EventLoop;
+import com.aerospike.client.async.EventLoops;
+import com.aerospike.client.async.NioEventLoops;
+import com.aerospike.client.cdt.ListPolicy;
+import com.aerospike.client.cdt.ListReturnType;
+import com.aerospike.client.cdt.MapReturnType;
+import com.aerospike.client.command.ParticleType;
+import com.aerospike.client.exp.Exp;
+import com.aerospike.client.exp.ExpOperation;
+import com.aerospike.client.exp.ExpReadFlags;
+import com.aerospike.client.exp.ExpWriteFlags;
+import com.aerospike.client.exp.ListExp;
+import com.aerospike.client.exp.MapExp;
+import com.aerospike.client.listener.ExecuteListener;
+import com.aerospike.client.policy.BatchPolicy;
+import com.aerospike.client.policy.ClientPolicy;
 import com.aerospike.client.policy.Policy;
+import com.aerospike.client.policy.RecordExistsAction;
 import com.aerospike.client.policy.WritePolicy;
+import com.aerospike.client.query.Filter;
+import com.aerospike.client.query.IndexType;
 import com.aerospike.client.query.Statement;
 import com.aerospike.client.task.ExecuteTask;
+import com.aerospike.client.task.IndexTask;
 import com.aerospike.client.task.RegisterTask;
 
 public class ExpireBin {
-	private static final String GET_OP          = "get";
-	private static final String PUT_OP          = "put";
-	private static final String BATCH_PUT_OP    = "puts";
-	private static final String TOUCH_OP        = "touch";
+	static final String         GET_OP          = "get";
+	static final String         GET_REPAIR_OP   = "get_repair";
+	static final String         PUT_OP          = "put";
+	static final String         BATCH_PUT_OP    = "puts";
+	static final String         TOUCH_OP        = "touch";
+	static final String         TOUCH_BINS_OP   = "touch_bins";
 	private static final String CLEAN_OP        = "clean";
-	private static final String TTL_OP          = "ttl";
+	private static final String CLEAN_ALL_OP    = "clean_all";
+	static final String         TTL_OP          = "ttl";
+	private static final String PUT_ELEM_OP     = "put_elem";
+	private static final String GET_ELEMS_OP    = "get_elems";
+	private static final String TRIM_OP         = "trim";
 	private static final String MODULE_NAME     = "expire_bin";
 	private static final String BIN_NAME_FIELD  = "bin";
 	private static final String BIN_VALUE_FIELD = "val";
 	private static final String BIN_TTL_FIELD   = "bin_ttl";
+	private static final long   EXP_TAG         = -25;
+	private static final long   ELEM_TAG        = -26;
+	private static final String EXP_ID          = "expbin_ttl";
+	private static final String EXP_DATA        = "data";
+	static final String         EXP_META        = "expbin_meta";
+	private static final String EXP_DUE         = "expbin_due";
+	private static final String LIST_RESULT     = "l";
+	private static final String MAP_RESULT      = "m";
+
+	/** Expire bin expiries are in seconds since this Unix time. */
+	public static final long CITRUSLEAF_EPOCH  = 1262304000;
+	/** Name of the secondary index created by createDueIndex. */
+	public static final String DUE_INDEX       = "expbin_due_idx";
+	/** Status returned by touchBins for a bin whose TTL was updated. */
+	public static final long TOUCH_UPDATED     = 0;
+	/** Status returned by touchBins for a bin TTL that is invalid or exceeds the record TTL. */
+	public static final long TOUCH_INVALID_TTL = 1;
+	/** Status returned by touchBins for a bin that is not an expire bin. */
+	public static final long TOUCH_NOT_EXPBIN  = 2;
 	
 	private static AerospikeClient client;
+	private volatile Listener listener;
+
+	/**
+	 * A live expire bin value together with its expiry.
+	 */
+	public static final class Entry {
+		/** The bin value. */
+		public final Object value;
+		/** Expiry in seconds since the Citrusleaf epoch (CITRUSLEAF_EPOCH), 0 if the bin doesn't expire. */
+		public final long expiry;
+		
+		public Entry(Object value, long expiry) {
+			this.value = value;
+			this.expiry = expiry;
+		}
+	}
+
+	/**
+	 * Wrapper calls reported to a Listener.
+	 */
+	public enum Op {
+		GET, GET_REPAIR, GET_EXP, GET_MANY, PUT, PUT_EXP, PUTS, TOUCH, TOUCH_BINS, TTL, CLEAN_RECORD,
+		PUT_ELEM, GET_ELEMS, TRIM
+	}
+
+	/**
+	 * Outcomes of the wrapper calls reported to a Listener.
+	 */
+	public enum Outcome {
+		/** Bins read live by a get, live elements read by getElems, or a live bin for ttl. */
+		HIT,
+		/**
+		 * Bins asked for by a get that were expired or never written, or a ttl on a
+		 * bin that is expired, not an expire bin, or whose record doesn't exist.
+		 */
+		EXPIRED,
+		/** Calls on a record that doesn't exist. */
+		MISSING,
+		/** Expired bins removed by a clean, or expired elements dropped by a trim. */
+		RECLAIMED,
+		/**
+		 * Writes and touches refused because a bin TTL is invalid or exceeds the
+		 * record TTL, one per refused bin for touchBins. A touch of a record that
+		 * doesn't exist can't be told apart and counts here too.
+		 */
+		REJECTED,
+		/** Calls that threw. */
+		ERROR
+	}
+
+	/**
+	 * Receives the latency and outcomes of every single record call (get, put,
+	 * touch, ttl, cleanRecord and their variants), from the thread that made it.
+	 * The latency is measured on the client and includes the network; comparing
+	 * get with getExp, which doesn't run Lua, shows the share of the UDF.
+	 * Implementations must be thread safe and fast. See ExpireBinStats.
+	 */
+	public interface Listener {
+		/**
+		 * Called once per call.
+		 * 
+		 * @param op    - The call.
+		 * @param nanos - Client side latency.
+		 */
+		void onLatency(Op op, long nanos);
+
+		/**
+		 * Called after onLatency for each outcome of the call with a non-zero count.
+		 * 
+		 * @param op      - The call.
+		 * @param outcome - The outcome.
+		 * @param count   - Number of bins, or 1 for outcomes of the whole call.
+		 */
+		void onOutcome(Op op, Outcome outcome, int count);
+	}
 
 	/**
 	 * Initialize ExpireBin object with suitable client and policy.
@@ -56,7 +184,173 @@ public class ExpireBin {
 	}
 
 	/**
-	 * Try to get values from the expire bin.
+	 * Report the following calls to a listener, or to none if null. Without a
+	 * listener, a call only pays for reading the field.
+	 * 
+	 * @param listener - Listener, e.g. an ExpireBinStats.
+	 */
+	public void setListener(Listener listener) {
+		this.listener = listener;
+	}
+
+	/**
+	 * Start timing a call, 0 if there is no listener to report to.
+	 */
+	private long begin() {
+		return (listener != null) ? System.nanoTime() : 0;
+	}
+
+	/**
+	 * Report the latency of a call started by begin() and return the listener
+	 * to report its outcomes to, null if there is none.
+	 */
+	private Listener end(Op op, long begin) {
+		Listener l = listener;
+		
+		if (l == null || begin == 0) {
+			return null;
+		}
+		l.onLatency(op, System.nanoTime() - begin);
+		return l;
+	}
+
+	private static void outcome(Listener l, Op op, Outcome outcome, int count) {
+		if (l != null && count > 0) {
+			l.onOutcome(op, outcome, count);
+		}
+	}
+
+	/**
+	 * Report a call started by begin() that threw.
+	 */
+	private void fail(Op op, long begin, AerospikeException ae) {
+		Outcome o = Outcome.ERROR;
+		
+		if (ae.getResultCode() == ResultCode.KEY_NOT_FOUND_ERROR) {
+			o = Outcome.MISSING;
+		}
+		outcome(end(op, begin), op, o, 1);
+	}
+
+	/**
+	 * Apply a UDF function to a record and report it.
+	 * 
+	 * @param bins - Number of bins asked for, for gets.
+	 */
+	private Object execute(Op op, int bins, WritePolicy policy, Key key, String function, Value ... args) throws AerospikeException {
+		long begin = begin();
+		Object returnVal;
+		
+		try {
+			returnVal = client.execute(policy, key, MODULE_NAME, function, args);
+		} catch (AerospikeException ae) {
+			fail(op, begin, ae);
+			throw ae;
+		}
+		
+		Listener l = end(op, begin);
+		
+		if (l != null) {
+			classify(l, op, returnVal, bins);
+		}
+		return returnVal;
+	}
+
+	/**
+	 * Apply a UDF function to a record on an event loop and report it, like
+	 * execute. The future is completed on the event loop thread.
+	 */
+	CompletableFuture<Object> executeAsync(EventLoop eventLoop, Op op, int bins, WritePolicy policy, Key key, String function, Value ... args) {
+		final long begin = begin();
+		final CompletableFuture<Object> future = new CompletableFuture<Object>();
+		
+		try {
+			client.execute(eventLoop, new ExecuteListener() {
+				public void onSuccess(Key key, Object returnVal) {
+					Listener l = end(op, begin);
+					
+					if (l != null) {
+						classify(l, op, returnVal, bins);
+					}
+					future.complete(returnVal);
+				}
+				
+				public void onFailure(AerospikeException ae) {
+					fail(op, begin, ae);
+					future.completeExceptionally(ae);
+				}
+			}, policy, key, MODULE_NAME, function, args);
+		} catch (AerospikeException ae) {
+			fail(op, begin, ae);
+			future.completeExceptionally(ae);
+		}
+		return future;
+	}
+
+	/**
+	 * Report the outcomes of a UDF call from its return value.
+	 */
+	private static void classify(Listener l, Op op, Object returnVal, int bins) {
+		switch (op) {
+		case GET:
+		case GET_REPAIR:
+			// get returns 1 if the record doesn't exist.
+			if (returnVal instanceof Map) {
+				int hits = ((Map<?, ?>) returnVal).size();
+				outcome(l, op, Outcome.HIT, hits);
+				outcome(l, op, Outcome.EXPIRED, bins - hits);
+			} else {
+				outcome(l, op, Outcome.MISSING, 1);
+			}
+			break;
+		case PUT:
+		case PUTS:
+		case TOUCH:
+		case PUT_ELEM:
+			if (returnVal instanceof Number && ((Number) returnVal).longValue() != 0) {
+				outcome(l, op, Outcome.REJECTED, 1);
+			}
+			break;
+		case TOUCH_BINS:
+			if (returnVal instanceof Map) {
+				int rejected = 0;
+				
+				for (Object status : ((Map<?, ?>) returnVal).values()) {
+					if (status instanceof Number && ((Number) status).longValue() == TOUCH_INVALID_TTL) {
+						rejected++;
+					}
+				}
+				outcome(l, op, Outcome.REJECTED, rejected);
+			} else {
+				outcome(l, op, Outcome.MISSING, 1);
+			}
+			break;
+		case TTL:
+			outcome(l, op, (returnVal != null) ? Outcome.HIT : Outcome.EXPIRED, 1);
+			break;
+		case GET_ELEMS:
+			if (returnVal instanceof Map) {
+				outcome(l, op, Outcome.HIT, ((Map<?, ?>) returnVal).size());
+			} else {
+				outcome(l, op, Outcome.MISSING, 1);
+			}
+			break;
+		case CLEAN_RECORD:
+		case TRIM:
+			if (returnVal instanceof Number) {
+				outcome(l, op, Outcome.RECLAIMED, ((Number) returnVal).intValue());
+			} else {
+				outcome(l, op, Outcome.MISSING, 1);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	/**
+	 * Try to get values from the expire bin. Element bins are read as a map of
+	 * their live elements.
 	 * 
 	 * @param policy - Configuration parameters for op.
 	 * @param key    - Key to get from.
@@ -65,7 +359,7 @@ public class ExpireBin {
 	 *                 expired/exist. The 'gen' and 'exp' numbers on the Record are not valid.
 	 * @throws       - AerospikeException.
 	 */
-	public Object get(Policy policy, Key key, String ... bins) throws AerospikeException {
+	public Object get(WritePolicy policy, Key key, String ... bins) throws AerospikeException {
 		Value[] valueBins = new Value[bins.length];
 		int count = 0;
 		
@@ -74,8 +368,48 @@ public class ExpireBin {
 			count++;
 		}
 		
-		Object returnVal = client.execute(policy, key, MODULE_NAME, GET_OP, valueBins);
+		Object returnVal = execute(Op.GET, bins.length, policy, key, GET_OP, valueBins);
+		return binRecord(returnVal, bins);
+	}
+
+	/**
+	 * Same as get, but if the record may hold expired bins, every expired bin of
+	 * the record is removed on the way. The record is only written if a bin was
+	 * removed or its expiry summary was stale, and at most once per
+	 * repairInterval seconds.
+	 * 
+	 * @param policy         - Configuration parameters for op.
+	 * @param key            - Key to get from.
+	 * @param repairInterval - Minimum number of seconds between two repairs of the record.
+	 * @param bins           - List of bin names to attempt to get from.
+	 * @return               - Record containing respective values for bins that haven't 
+	 *                         expired/exist. The 'gen' and 'exp' numbers on the Record are not valid.
+	 * @throws               - AerospikeException.
+	 */
+	public Object getRepair(WritePolicy policy, Key key, int repairInterval, String ... bins) throws AerospikeException {
+		Value[] valueArgs = new Value[bins.length + 1];
+		valueArgs[0] = Value.get(repairInterval);
 		
+		for (int i = 0; i < bins.length; i++) {
+			valueArgs[i + 1] = Value.get(bins[i]);
+		}
+		
+		Object returnVal = execute(Op.GET_REPAIR, bins.length, policy, key, GET_REPAIR_OP, valueArgs);
+		return binRecord(returnVal, bins);
+	}
+
+	/**
+	 * Integer result of a UDF call, which the client returns as a Long. Null if the
+	 * UDF returned nil or something else than a number.
+	 */
+	static Integer toInteger(Object returnVal) {
+		return (returnVal instanceof Number) ? ((Number) returnVal).intValue() : null;
+	}
+
+	/**
+	 * Build the Record returned by get from the UDF result.
+	 */
+	static Record binRecord(Object returnVal, String[] bins) {
 		if (returnVal instanceof Map) {
 			Map<?, ?> returnMap = (Map<?, ?>) returnVal;
 			HashMap<String, Object> recMap = new HashMap<String, Object>();
@@ -85,16 +419,210 @@ public class ExpireBin {
 						recMap.put(bin, returnMap.get(bin));
 					}
 				}
-				return new Record(recMap, null, 0, 0);
+				return new Record(recMap, 0, 0);
+			}
+		}
+		return null;
+	}
+
+	/**
+	 * Try to get values from expire bins without running the UDF. The expiry of
+	 * each bin is checked by an expression on the server, against the server
+	 * clock, and only live values are sent back. Reads bins written by any
+	 * version of the module.
+	 * Note: Unlike get, bins that are not expire bins are not returned.
+	 * 
+	 * @param policy - Configuration parameters for op.
+	 * @param key    - Key to get from.
+	 * @param bins   - List of bin names to attempt to get from.
+	 * @return       - Record containing respective values for bins that haven't
+	 *                 expired/exist, null if the record doesn't exist.
+	 * @throws       - AerospikeException.
+	 */
+	public Record getExp(WritePolicy policy, Key key, String ... bins) throws AerospikeException {
+		long begin = begin();
+		Record record = operateExp(begin, policy, key, bins);
+		
+		if (record == null) {
+			return null;
+		}
+		
+		HashMap<String, Object> recMap = new HashMap<String, Object>();
+		
+		for (int i = 0; i < bins.length; i++) {
+			Entry entry = liveEntry(record, i);
+			
+			if (entry != null) {
+				recMap.put(bins[i], entry.value);
+			}
+		}
+		getExpDone(begin, recMap.size(), bins.length);
+		return new Record(recMap, record.generation, record.expiration);
+	}
+
+	/**
+	 * Same as getExp, but each bin also carries its expiry, so the caller can
+	 * tell how long the value stays live.
+	 * 
+	 * @param policy - Configuration parameters for op.
+	 * @param key    - Key to get from.
+	 * @param bins   - List of bin names to attempt to get from.
+	 * @return       - Map of bin name to Entry for bins that haven't expired/exist,
+	 *                 null if the record doesn't exist.
+	 * @throws       - AerospikeException.
+	 */
+	public Map<String, Entry> getExpEntries(WritePolicy policy, Key key, String ... bins) throws AerospikeException {
+		long begin = begin();
+		Record record = operateExp(begin, policy, key, bins);
+		
+		if (record == null) {
+			return null;
+		}
+		
+		HashMap<String, Entry> entries = new HashMap<String, Entry>();
+		
+		for (int i = 0; i < bins.length; i++) {
+			Entry entry = liveEntry(record, i);
+			
+			if (entry != null) {
+				entries.put(bins[i], entry);
 			}
 		}
+		getExpDone(begin, entries.size(), bins.length);
+		return entries;
+	}
+
+	/**
+	 * Read the live expire bins of a record with one operate() call. The result
+	 * of bins[i] is in the record bins LIST_RESULT + i (list format) and
+	 * MAP_RESULT + i (map format). A missing record is reported from here.
+	 */
+	private Record operateExp(long begin, WritePolicy policy, Key key, String ... bins) throws AerospikeException {
+		Operation[] ops = new Operation[bins.length * 2];
+		
+		// The result names are indexes into bins, so they never clash with each other.
+		for (int i = 0; i < bins.length; i++) {
+			ops[i * 2] = ExpOperation.read(LIST_RESULT + i, Exp.build(liveListExp(bins[i])), ExpReadFlags.EVAL_NO_FAIL);
+			ops[i * 2 + 1] = ExpOperation.read(MAP_RESULT + i, Exp.build(liveMapExp(bins[i])), ExpReadFlags.EVAL_NO_FAIL);
+		}
+		
+		Record record;
+		
+		try {
+			record = client.operate(policy, key, ops);
+		} catch (AerospikeException ae) {
+			fail(Op.GET_EXP, begin, ae);
+			throw ae;
+		}
+		
+		if (record == null) {
+			outcome(end(Op.GET_EXP, begin), Op.GET_EXP, Outcome.MISSING, 1);
+		}
+		return record;
+	}
+
+	/**
+	 * Report a getExp call that found its record.
+	 */
+	private void getExpDone(long begin, int hits, int bins) {
+		Listener l = end(Op.GET_EXP, begin);
+		outcome(l, Op.GET_EXP, Outcome.HIT, hits);
+		outcome(l, Op.GET_EXP, Outcome.EXPIRED, bins - hits);
+	}
+
+	/**
+	 * The Entry of bins[i] in a record read by operateExp, null if the bin is not a live expire bin.
+	 */
+	private static Entry liveEntry(Record record, int i) {
+		Object listVal = record.getValue(LIST_RESULT + i);
+		Object mapVal = record.getValue(MAP_RESULT + i);
+		
+		if (listVal instanceof List) {
+			List<?> list = (List<?>) listVal;
+			return new Entry(list.get(2), (Long) list.get(1));
+		} else if (mapVal instanceof Map) {
+			Map<?, ?> map = (Map<?, ?>) mapVal;
+			return new Entry(map.get(EXP_DATA), (Long) map.get(EXP_ID));
+		}
 		return null;
 	}
 
+	/**
+	 * Try to get values from the expire bins of many records with a single batch
+	 * UDF call, which sends one request per server node.
+	 * 
+	 * @param policy - Batch configuration parameters for op, or null for the default.
+	 * @param keys   - Keys to get from.
+	 * @param bins   - List of bin names to attempt to get from.
+	 * @return       - One BatchRecord per key, in the same order as keys. On success, the
+	 *                 record holds the bins that haven't expired/exist and the resultCode is
+	 *                 ResultCode.OK. A missing record has a null record and
+	 *                 ResultCode.KEY_NOT_FOUND_ERROR. Other errors are reported in the
+	 *                 resultCode of their key. The 'gen' and 'exp' numbers are not valid.
+	 * @throws       - AerospikeException.
+	 */
+	public BatchRecord[] getMany(BatchPolicy policy, Key[] keys, String ... bins) throws AerospikeException {
+		Value[] valueBins = new Value[bins.length];
+		int count = 0;
+		
+		for (String bin : bins) {
+			valueBins[count] = Value.get(bin);
+			count++;
+		}
+		
+		long begin = begin();
+		BatchResults results;
+		
+		try {
+			results = client.execute(policy, null, keys, MODULE_NAME, GET_OP, valueBins);
+		} catch (AerospikeException ae) {
+			fail(Op.GET_MANY, begin, ae);
+			throw ae;
+		}
+		
+		BatchRecord[] records = results.records;
+		// The batch is reported as one call with the outcomes of all its keys.
+		int hits = 0, expired = 0, missing = 0, errors = 0;
+		
+		for (int i = 0; i < records.length; i++) {
+			BatchRecord br = records[i];
+			
+			if (br.resultCode != ResultCode.OK || br.record == null) {
+				if (br.resultCode == ResultCode.KEY_NOT_FOUND_ERROR) {
+					missing++;
+				} else {
+					errors++;
+				}
+				continue;
+			}
+			
+			Object returnVal = br.record.getValue("SUCCESS");
+			
+			if (returnVal instanceof Map) {
+				@SuppressWarnings("unchecked")
+				Map<String, Object> returnMap = (Map<String, Object>) returnVal;
+				records[i] = new BatchRecord(br.key, new Record(returnMap, 0, 0), ResultCode.OK, false, false);
+				hits += returnMap.size();
+				expired += bins.length - returnMap.size();
+			} else {
+				records[i] = new BatchRecord(br.key, null, ResultCode.KEY_NOT_FOUND_ERROR, false, false);
+				missing++;
+			}
+		}
+		
+		Listener l = end(Op.GET_MANY, begin);
+		outcome(l, Op.GET_MANY, Outcome.HIT, hits);
+		outcome(l, Op.GET_MANY, Outcome.EXPIRED, expired);
+		outcome(l, Op.GET_MANY, Outcome.MISSING, missing);
+		outcome(l, Op.GET_MANY, Outcome.ERROR, errors);
+		return records;
+	}
+
 	/**
 	 * Create or update expire bins. If the binTTL is not null, all newly created bins will be expire  
 	 * bin, otherwise, only normal bins will be created.
-	 * Note: Existing expire bins will not be converted into normal bins if binTTL is not specified.
+	 * Note: Existing expire bins and element bins will not be converted into normal bins if binTTL
+	 * is not specified.
 	 * 
 	 * @param policy  - Configuration parameters for op.
 	 * @param key     - Record key to apply operation on.
@@ -104,8 +632,136 @@ public class ExpireBin {
 	 * @return        - 0 if success, 1 if error.
 	 * @throws        - AerospikeException.
 	 */
-	public Integer put(Policy policy, Key key, String binName, Value val, int binTTL) throws AerospikeException {
-		return (Integer) client.execute(policy, key, MODULE_NAME, PUT_OP, Value.get(binName), val, Value.get(binTTL));
+	public Integer put(WritePolicy policy, Key key, String binName, Value val, int binTTL) throws AerospikeException {
+		return toInteger(execute(Op.PUT, 0, policy, key, PUT_OP, Value.get(binName), val, Value.get(binTTL)));
+	}
+
+	/**
+	 * Create or update an expire bin without running the UDF. The bin and the
+	 * record's expiry summary are written by expressions in a single operate()
+	 * call, so the record is written once and either both change or neither does.
+	 * The stored format is the same as put's.
+	 * The binTTL must not exceed the record TTL. If the policy sets an expiration,
+	 * binTTL is checked against it. Otherwise it is checked on the server against
+	 * the TTL of the existing record, which the write then leaves unchanged. The
+	 * expressions only update existing records: a record that doesn't exist yet is
+	 * created through the put UDF instead, which checks binTTL against the TTL the
+	 * record is created with and writes its expiry summary. The put UDF also writes
+	 * a bin that expires before the expiry bucket of cleanDue, or on a record whose
+	 * summary says none of its bins expire, as only the UDF knows the bucket size,
+	 * and a binTTL of -1 to a record that expires, as the TTL mode of the UDF
+	 * decides what happens to the record TTL then. The recordExistsAction of the
+	 * policy is ignored.
+	 * 
+	 * @param policy  - Configuration parameters for op.
+	 * @param key     - Record key to apply operation on.
+	 * @param binName - Bin name to create or update.
+	 * @param val     - Bin value.
+	 * @param binTTL  - Expiration time in seconds or -1 for no expiration.
+	 * @return        - 0 if success, 1 if error.
+	 * @throws        - AerospikeException.
+	 */
+	public Integer putExp(WritePolicy policy, Key key, String binName, Value val, int binTTL) throws AerospikeException {
+		WritePolicy wp = (policy != null) ? policy : client.writePolicyDefault;
+		// Only update, so the bin TTL is never written to a record whose TTL is yet unknown.
+		WritePolicy updatePolicy = new WritePolicy(wp);
+		updatePolicy.recordExistsAction = RecordExistsAction.UPDATE_ONLY;
+		// Without an explicit expiration the record keeps the TTL binTTL was checked
+		// against, instead of being reset to the namespace default.
+		if (wp.expiration == 0) {
+			updatePolicy.expiration = -2;
+		}
+		Exp ttlOk = Exp.val(true);
+		long begin = begin();
+		
+		if (binTTL < -1) {
+			outcome(end(Op.PUT_EXP, begin), Op.PUT_EXP, Outcome.REJECTED, 1);
+			return 1;
+		}
+		
+		if (binTTL != -1 && wp.expiration != -1) {
+			if (wp.expiration > 0) {
+				if (binTTL > wp.expiration) {
+					outcome(end(Op.PUT_EXP, begin), Op.PUT_EXP, Outcome.REJECTED, 1);
+					return 1;
+				}
+			} else {
+				// A record that never expires reports a TTL <= 0.
+				ttlOk = Exp.or(Exp.le(Exp.ttl(), Exp.val(0)), Exp.le(Exp.val(binTTL), Exp.ttl()));
+			}
+		}
+		
+		Exp expiry = (binTTL == -1) ? Exp.val(0L) : Exp.add(serverNow(), Exp.val(binTTL));
+		Exp newBin = ListExp.set(ListPolicy.Default, Exp.val(1), expiry, Exp.val(Arrays.asList(EXP_TAG, 0L, val)));
+		
+		// The summary is written first, while the bin still holds its old value.
+		// Without a summary the record is left for clean to recompute it.
+		Exp meta = Exp.listBin(EXP_META);
+		Exp metaEarliest = ListExp.getByIndex(ListReturnType.VALUE, Exp.Type.INT, Exp.val(0), meta);
+		Exp metaCount = ListExp.getByIndex(ListReturnType.VALUE, Exp.Type.INT, Exp.val(1), meta);
+		// An expire bin or element bin being overwritten is already counted.
+		Exp counted = Exp.or(isExpbin(binName), isElembin(binName));
+		Exp newMeta = ListExp.set(ListPolicy.Default, Exp.val(1), Exp.add(metaCount, Exp.cond(counted, Exp.val(0), Exp.val(1))),
+			ListExp.set(ListPolicy.Default, Exp.val(0), minExpiry(metaEarliest, expiry), meta));
+		
+		// A bin expiring before the expiry bucket moves it, and a record whose summary
+		// says none of its bins expire has none. Only the put UDF knows the bucket size,
+		// and a bucket moved to the exact expiry would rewrite the index entry every time.
+		Exp moveDue = Exp.and(Exp.val(binTTL != -1),
+			Exp.cond(Exp.eq(Exp.binType(EXP_DUE), Exp.val(ParticleType.INTEGER)), Exp.lt(expiry, Exp.intBin(EXP_DUE)),
+				Exp.eq(Exp.binType(EXP_META), Exp.val(ParticleType.LIST)), Exp.eq(metaEarliest, Exp.val(0)),
+				Exp.val(false)));
+		// What a bin that never expires does to a record that does depends on the
+		// TTL mode of the put UDF.
+		Exp foreverBin = Exp.and(Exp.val(binTTL == -1 && wp.expiration != -1),
+			Exp.or(Exp.val(wp.expiration > 0), Exp.gt(Exp.ttl(), Exp.val(0))));
+		Exp needsUdf = Exp.or(moveDue, foreverBin);
+		
+		try {
+			client.operate(updatePolicy, key,
+				ExpOperation.write(EXP_META, Exp.build(Exp.cond(Exp.eq(Exp.binType(EXP_META), Exp.val(ParticleType.LIST)), newMeta, Exp.nil())), ExpWriteFlags.ALLOW_DELETE),
+				ExpOperation.write(binName, Exp.build(Exp.cond(needsUdf, Exp.unknown(), ttlOk, newBin, Exp.unknown())), ExpWriteFlags.DEFAULT));
+		} catch (AerospikeException ae) {
+			// Nothing was written. Either the bin TTL doesn't fit, which the UDF
+			// reports again, or the UDF has to write the bin.
+			if (ae.getResultCode() == ResultCode.OP_NOT_APPLICABLE) {
+				WritePolicy udfPolicy = new WritePolicy(wp);
+				udfPolicy.expiration = updatePolicy.expiration;
+				return putExpUdf(udfPolicy, key, binName, val, binTTL, begin);
+			}
+			if (ae.getResultCode() != ResultCode.KEY_NOT_FOUND_ERROR) {
+				fail(Op.PUT_EXP, begin, ae);
+				throw ae;
+			}
+			return putExpUdf(wp, key, binName, val, binTTL, begin);
+		}
+		end(Op.PUT_EXP, begin);
+		return 0;
+	}
+
+	/**
+	 * Write the bin of putExp with the put UDF instead, which checks binTTL against
+	 * the TTL of the record, removing a record it created again if it doesn't fit,
+	 * and writes the expiry summary and bucket.
+	 */
+	private Integer putExpUdf(WritePolicy policy, Key key, String binName, Value val, int binTTL, long begin) throws AerospikeException {
+		Object returnVal;
+		
+		try {
+			returnVal = client.execute(policy, key, MODULE_NAME, PUT_OP, Value.get(binName), val, Value.get(binTTL));
+		} catch (AerospikeException ae) {
+			fail(Op.PUT_EXP, begin, ae);
+			throw ae;
+		}
+		
+		Integer rc = toInteger(returnVal);
+		
+		if (rc == null || rc != 0) {
+			outcome(end(Op.PUT_EXP, begin), Op.PUT_EXP, Outcome.REJECTED, 1);
+			return 1;
+		}
+		end(Op.PUT_EXP, begin);
+		return 0;
 	}
 
 	/**
@@ -118,8 +774,8 @@ public class ExpireBin {
 	 * @return        - 0 if all bins succeeded, 1 if failure.
 	 * @throws        - AerospikeException.
 	 */
-	public Integer puts(Policy policy, Key key, MapValue ... mapBins) throws AerospikeException {
-		return (Integer) client.execute(policy, key, MODULE_NAME, BATCH_PUT_OP, (Value[]) mapBins);
+	public Integer puts(WritePolicy policy, Key key, MapValue ... mapBins) throws AerospikeException {
+		return toInteger(execute(Op.PUTS, 0, policy, key, BATCH_PUT_OP, (Value[]) mapBins));
 	}
 
 	/**
@@ -132,7 +788,15 @@ public class ExpireBin {
 	 * @return        - 0 on success of all touch operations, 1 if a failure occurs.
 	 * @throws        - AerospikeException.
 	 */
-	public Integer touch(Policy policy, Key key, MapValue ... mapBins) throws AerospikeException {
+	public Integer touch(WritePolicy policy, Key key, MapValue ... mapBins) throws AerospikeException {
+		checkTTL(mapBins);
+		return toInteger(execute(Op.TOUCH, 0, policy, key, TOUCH_OP, (Value[]) mapBins));
+	}
+
+	/**
+	 * Throw if a touch op has no bin TTL.
+	 */
+	static void checkTTL(MapValue[] mapBins) throws AerospikeException {
 		for (Value.MapValue map : mapBins) {
 			@SuppressWarnings("unchecked")
 			Map<String, Object> temp_map = (Map<String, Object>) map.getObject();
@@ -140,11 +804,33 @@ public class ExpireBin {
 				throw new AerospikeException("TTL not specified");
 			}
 		}
-		return (Integer) client.execute(policy, key, MODULE_NAME, TOUCH_OP, (Value[]) mapBins);
 	}
 
 	/**
-	 * Perform a scan of the database and clear out expired bins.
+	 * Batch update the bin TTLs and report the outcome of each bin. Unlike touch,
+	 * valid bins are updated even if others are rejected. All changes are written
+	 * to the record once.
+	 * 
+	 * @param policy  - Configuration parameters for op.
+	 * @param key     - Record key.
+	 * @param mapBins - List of MapValues generated by createMapBin containing operation arguments.
+	 * @return        - Map of bin name to TOUCH_UPDATED, TOUCH_INVALID_TTL or TOUCH_NOT_EXPBIN,
+	 *                  null if the record doesn't exist.
+	 * @throws        - AerospikeException.
+	 */
+	public Map<?, ?> touchBins(WritePolicy policy, Key key, MapValue ... mapBins) throws AerospikeException {
+		checkTTL(mapBins);
+		Object returnVal = execute(Op.TOUCH_BINS, 0, policy, key, TOUCH_BINS_OP, (Value[]) mapBins);
+		
+		if (returnVal instanceof Map) {
+			return (Map<?, ?>) returnVal;
+		}
+		return null;
+	}
+
+	/**
+	 * Perform a scan of the database and clear out expired bins and the expired
+	 * elements of element bins.
 	 * 
 	 * @param policy    - Configuration parameters for op.
 	 * @param scan      - Scan policy containing which records should be scanned.
@@ -153,7 +839,7 @@ public class ExpireBin {
 	 * @param bins      - List of bins to scan.
 	 * @throws          - AerospikeException.
 	 */
-	public ExecuteTask clean(Policy policy, Statement statement, String ... bins) throws AerospikeException {
+	public ExecuteTask clean(WritePolicy policy, Statement statement, String ... bins) throws AerospikeException {
 		final Value[] valueBins = new Value[bins.length];
 		int count = 0;
 		for (String bin : bins) {
@@ -163,6 +849,108 @@ public class ExpireBin {
 		return client.execute(policy, statement, MODULE_NAME, CLEAN_OP, valueBins);
 	}
 
+	/**
+	 * Perform a scan of the database and clear out every expired bin and expired
+	 * element. The bins of
+	 * each record are discovered on the server, so expire bin names don't have to
+	 * be known up front.
+	 * 
+	 * @param policy    - Configuration parameters for op.
+	 * @param statement - Statement containing the namespace and set to scan.
+	 * @return          - Task to monitor the scan.
+	 * @throws          - AerospikeException.
+	 */
+	public ExecuteTask cleanAll(WritePolicy policy, Statement statement) throws AerospikeException {
+		return client.execute(policy, statement, MODULE_NAME, CLEAN_ALL_OP);
+	}
+
+	/**
+	 * Create the secondary index used by cleanDue. The expiry bucket it indexes
+	 * is only kept if DUE_BUCKET is set in expire_bin.lua.
+	 * 
+	 * @param policy    - Configuration parameters for op.
+	 * @param namespace - Namespace to index.
+	 * @param set       - Set to index, or null for the whole namespace.
+	 * @return          - Task to monitor the index creation.
+	 * @throws          - AerospikeException.
+	 */
+	public IndexTask createDueIndex(Policy policy, String namespace, String set) throws AerospikeException {
+		return client.createIndex(policy, namespace, set, DUE_INDEX, EXP_DUE, IndexType.NUMERIC);
+	}
+
+	/**
+	 * Clear out the expired bins of the records whose expiry bucket is at or
+	 * before beforeTime, found through the index created by createDueIndex
+	 * instead of a full scan. Records without a bucket, written before DUE_BUCKET
+	 * was set or by putExp on a record without expbin_meta, are only cleaned by
+	 * clean and cleanAll.
+	 * 
+	 * @param policy     - Configuration parameters for op.
+	 * @param statement  - Statement containing the namespace and set to query.
+	 *                     Its filter is replaced.
+	 * @param beforeTime - Unix time in seconds, usually now.
+	 * @param bins       - List of bins to clean, or none to clean every expire bin.
+	 * @return           - Task to monitor the query.
+	 * @throws           - AerospikeException.
+	 */
+	public ExecuteTask cleanDue(WritePolicy policy, Statement statement, long beforeTime, String ... bins) throws AerospikeException {
+		statement.setFilter(Filter.range(EXP_DUE, 1, beforeTime - CITRUSLEAF_EPOCH));
+		
+		if (bins.length == 0) {
+			return client.execute(policy, statement, MODULE_NAME, CLEAN_ALL_OP);
+		}
+		
+		Value[] valueBins = new Value[bins.length];
+		for (int i = 0; i < bins.length; i++) {
+			valueBins[i] = Value.get(bins[i]);
+		}
+		return client.execute(policy, statement, MODULE_NAME, CLEAN_OP, valueBins);
+	}
+
+	/**
+	 * Clear out the expired bins of a single record. The record is only
+	 * rewritten if a bin was removed.
+	 * 
+	 * @param policy - Configuration parameters for op.
+	 * @param key    - Record key.
+	 * @param bins   - List of bins to clean.
+	 * @return       - Number of bins removed, null if the record doesn't exist.
+	 * @throws       - AerospikeException.
+	 */
+	public Integer cleanRecord(WritePolicy policy, Key key, String ... bins) throws AerospikeException {
+		Value[] valueBins = new Value[bins.length];
+		int count = 0;
+		for (String bin : bins) {
+			valueBins[count] = Value.get(bin);
+			count++;
+		}
+		return toInteger(execute(Op.CLEAN_RECORD, 0, policy, key, CLEAN_OP, valueBins));
+	}
+
+	/**
+	 * Clean a single record for ExpireBinCleaner.
+	 * 
+	 * @param policy - Configuration parameters for op.
+	 * @param key    - Record key.
+	 * @param bins   - List of bins to clean, or none to clean every expire bin.
+	 * @return       - Number of bins removed, 0 if the record doesn't exist.
+	 * @throws       - AerospikeException.
+	 */
+	long cleanKey(WritePolicy policy, Key key, String ... bins) throws AerospikeException {
+		Object returnVal;
+		
+		if (bins.length == 0) {
+			returnVal = execute(Op.CLEAN_RECORD, 0, policy, key, CLEAN_ALL_OP);
+		} else {
+			Value[] valueBins = new Value[bins.length];
+			for (int i = 0; i < bins.length; i++) {
+				valueBins[i] = Value.get(bins[i]);
+			}
+			returnVal = execute(Op.CLEAN_RECORD, 0, policy, key, CLEAN_OP, valueBins);
+		}
+		return (returnVal instanceof Number) ? ((Number) returnVal).longValue() : 0;
+	}
+
 	/**
 	 * Get bin TTL in seconds.
 	 * 
@@ -172,10 +960,238 @@ public class ExpireBin {
 	 * @return       - Time in seconds bin will expire, -1 or null if it doesn't expire.
 	 * @throws       - AerospikeException. 
 	 */
-	public Integer ttl(Policy policy, Key key, String bin) throws AerospikeException {
-		return (Integer) (client.execute(policy, key, MODULE_NAME, TTL_OP, Value.get(bin)));
+	public Integer ttl(WritePolicy policy, Key key, String bin) throws AerospikeException {
+		return toInteger(execute(Op.TTL, 1, policy, key, TTL_OP, Value.get(bin)));
+	}
+
+	/**
+	 * Store an element with its own expiration in an element bin, replacing the
+	 * element with the same key. Elements are kept ordered by expiry, and the
+	 * expired ones are dropped on the way.
+	 * 
+	 * @param policy  - Configuration parameters for op.
+	 * @param key     - Record key.
+	 * @param binName - Element bin name, created if it doesn't exist.
+	 * @param elemKey - Element key, an integer or string.
+	 * @param val     - Element value, not null.
+	 * @param elemTTL - Expiration time of the element in seconds or -1 for no expiration.
+	 * @return        - 0 if success, 1 if error or the bin is not an element bin.
+	 * @throws        - AerospikeException.
+	 */
+	public Integer putElem(WritePolicy policy, Key key, String binName, Value elemKey, Value val, int elemTTL) throws AerospikeException {
+		return toInteger(execute(Op.PUT_ELEM, 0, policy, key, PUT_ELEM_OP, Value.get(binName), elemKey, val, Value.get(elemTTL)));
+	}
+
+	/**
+	 * Get the elements of an element bin that haven't expired.
+	 * 
+	 * @param policy  - Configuration parameters for op.
+	 * @param key     - Record key.
+	 * @param binName - Element bin name.
+	 * @return        - Map of element key to value, empty if the bin doesn't exist
+	 *                  or is not an element bin, null if the record doesn't exist.
+	 * @throws        - AerospikeException.
+	 */
+	public Map<?, ?> getElems(WritePolicy policy, Key key, String binName) throws AerospikeException {
+		Object returnVal = execute(Op.GET_ELEMS, 0, policy, key, GET_ELEMS_OP, Value.get(binName));
+		return (returnVal instanceof Map) ? (Map<?, ?>) returnVal : null;
+	}
+
+	/**
+	 * Drop the expired elements of element bins. Bins left with no element are
+	 * removed. The record is only rewritten if an element was dropped.
+	 * 
+	 * @param policy - Configuration parameters for op.
+	 * @param key    - Record key.
+	 * @param bins   - Element bin names.
+	 * @return       - Number of elements dropped, null if the record doesn't exist.
+	 * @throws       - AerospikeException.
+	 */
+	public Integer trim(WritePolicy policy, Key key, String ... bins) throws AerospikeException {
+		Value[] valueBins = new Value[bins.length];
+		for (int i = 0; i < bins.length; i++) {
+			valueBins[i] = Value.get(bins[i]);
+		}
+		return toInteger(execute(Op.TRIM, 0, policy, key, TRIM_OP, valueBins));
 	}
 	
+	/**
+	 * Client time in seconds since the Citrusleaf epoch, as used for expire bin expiries.
+	 */
+	public static long now() {
+		return System.currentTimeMillis() / 1000 - CITRUSLEAF_EPOCH;
+	}
+
+	/**
+	 * Decode a record read without the UDF, by a plain get, scan or query. Live
+	 * expire bins are replaced by their value and element bins by a map of their
+	 * live elements, while expired ones and the bins of the module itself are left
+	 * out. Normal bins are kept. Reads bins written by
+	 * any version of the module.
+	 *
+	 * @param record - Record to decode.
+	 * @param now    - Time to test expiries against, usually now().
+	 * @return       - Record with the remaining bins, null if none remain.
+	 */
+	public static Record liveRecord(Record record, long now) {
+		if (record == null || record.bins == null) {
+			return null;
+		}
+
+		HashMap<String, Object> bins = new HashMap<String, Object>();
+
+		for (Map.Entry<String, Object> bin : record.bins.entrySet()) {
+			String name = bin.getKey();
+			Object value = bin.getValue();
+
+			if (name.equals(EXP_META) || name.equals(EXP_DUE)) {
+				continue;
+			}
+
+			Long expiry = null;
+
+			if (value instanceof List) {
+				List<?> list = (List<?>) value;
+
+				if (list.size() == 3 && Long.valueOf(EXP_TAG).equals(list.get(0)) && list.get(1) instanceof Long) {
+					expiry = (Long) list.get(1);
+					value = list.get(2);
+				} else if (list.size() == 2 && Long.valueOf(ELEM_TAG).equals(list.get(0)) && list.get(1) instanceof List) {
+					value = liveElems((List<?>) list.get(1), now);
+				}
+			} else if (value instanceof Map) {
+				Map<?, ?> map = (Map<?, ?>) value;
+
+				if (map.get(EXP_ID) instanceof Long) {
+					expiry = (Long) map.get(EXP_ID);
+					value = map.get(EXP_DATA);
+				}
+			}
+
+			if (expiry != null && expiry != 0 && expiry < now) {
+				continue;
+			}
+			if (value != null) {
+				bins.put(name, value);
+			}
+		}
+		return bins.isEmpty() ? null : new Record(bins, record.generation, record.expiration);
+	}
+
+	/**
+	 * Live elements of an element bin's entries, null if none is live.
+	 */
+	private static Map<Object, Object> liveElems(List<?> entries, long now) {
+		HashMap<Object, Object> elems = new HashMap<Object, Object>();
+
+		for (Object e : entries) {
+			if (!(e instanceof List) || ((List<?>) e).size() != 3) {
+				continue;
+			}
+
+			List<?> entry = (List<?>) e;
+			Object expiry = entry.get(0);
+
+			if (expiry instanceof Long && ((Long) expiry == 0 || (Long) expiry >= now)) {
+				elems.put(entry.get(1), entry.get(2));
+			}
+		}
+		return elems.isEmpty() ? null : elems;
+	}
+
+	/**
+	 * Server time in seconds since the Citrusleaf epoch, as used for expire bin expiries.
+	 */
+	static Exp serverNow() {
+		Exp nowMillis = Exp.add(Exp.div(Exp.lastUpdate(), Exp.val(1000000L)), Exp.sinceUpdate());
+		return Exp.sub(Exp.div(nowMillis, Exp.val(1000L)), Exp.val(CITRUSLEAF_EPOCH));
+	}
+
+	/**
+	 * True if the record may hold expired bins, going by its expiry summary. Records
+	 * without a summary are always due.
+	 */
+	static Exp isCleanDue() {
+		Exp earliest = ListExp.getByIndex(ListReturnType.VALUE, Exp.Type.INT, Exp.val(0), Exp.listBin(EXP_META));
+		
+		return Exp.cond(
+			Exp.eq(Exp.binType(EXP_META), Exp.val(ParticleType.LIST)),
+			Exp.and(Exp.ne(earliest, Exp.val(0L)), Exp.lt(earliest, serverNow())),
+			Exp.val(true));
+	}
+
+	/**
+	 * True if the expiry is 0 (no expiration) or not yet reached.
+	 */
+	private static Exp isLive(Exp expiry) {
+		return Exp.or(Exp.eq(expiry, Exp.val(0L)), Exp.le(serverNow(), expiry));
+	}
+
+	/**
+	 * Earliest of two expiries, where 0 means no expiration.
+	 */
+	private static Exp minExpiry(Exp a, Exp b) {
+		return Exp.cond(Exp.eq(a, Exp.val(0L)), b, Exp.eq(b, Exp.val(0L)), a, Exp.min(a, b));
+	}
+
+	/**
+	 * True if the bin is an expire bin in either format. Never evaluates to unknown.
+	 */
+	private static Exp isExpbin(String binName) {
+		Exp list = Exp.listBin(binName);
+		Exp head = ListExp.getByIndexRange(ListReturnType.VALUE, Exp.val(0), Exp.val(1), list);
+		
+		return Exp.cond(
+			Exp.eq(Exp.binType(binName), Exp.val(ParticleType.LIST)),
+			Exp.and(Exp.eq(ListExp.size(list), Exp.val(3)), Exp.eq(ListExp.getByValue(ListReturnType.COUNT, Exp.val(EXP_TAG), head), Exp.val(1))),
+			Exp.eq(Exp.binType(binName), Exp.val(ParticleType.MAP)),
+			Exp.gt(MapExp.getByKey(MapReturnType.COUNT, Exp.Type.INT, Exp.val(EXP_ID), Exp.mapBin(binName)), Exp.val(0)),
+			Exp.val(false));
+	}
+
+	/**
+	 * True if the bin is an element bin. Never evaluates to unknown.
+	 */
+	private static Exp isElembin(String binName) {
+		Exp list = Exp.listBin(binName);
+		Exp head = ListExp.getByIndexRange(ListReturnType.VALUE, Exp.val(0), Exp.val(1), list);
+		
+		return Exp.cond(
+			Exp.eq(Exp.binType(binName), Exp.val(ParticleType.LIST)),
+			Exp.and(Exp.eq(ListExp.size(list), Exp.val(2)), Exp.eq(ListExp.getByValue(ListReturnType.COUNT, Exp.val(ELEM_TAG), head), Exp.val(1))),
+			Exp.val(false));
+	}
+
+	/**
+	 * The whole bin if it is a live expire bin [EXP_TAG, expiry, data], unknown otherwise.
+	 */
+	private static Exp liveListExp(String binName) {
+		Exp bin = Exp.listBin(binName);
+		Exp tag = ListExp.getByIndex(ListReturnType.VALUE, Exp.Type.INT, Exp.val(0), bin);
+		Exp expiry = ListExp.getByIndex(ListReturnType.VALUE, Exp.Type.INT, Exp.val(1), bin);
+		
+		return Exp.cond(
+			Exp.eq(Exp.binType(binName), Exp.val(ParticleType.LIST)),
+			Exp.cond(
+				Exp.and(Exp.eq(ListExp.size(bin), Exp.val(3)), Exp.eq(tag, Exp.val(EXP_TAG)), isLive(expiry)),
+				bin,
+				Exp.unknown()),
+			Exp.unknown());
+	}
+
+	/**
+	 * The whole bin if it is a live expire bin in the older map format, unknown otherwise.
+	 */
+	private static Exp liveMapExp(String binName) {
+		Exp bin = Exp.mapBin(binName);
+		Exp expiry = MapExp.getByKey(MapReturnType.VALUE, Exp.Type.INT, Exp.val(EXP_ID), bin);
+		
+		return Exp.cond(
+			Exp.eq(Exp.binType(binName), Exp.val(ParticleType.MAP)),
+			Exp.cond(isLive(expiry), bin, Exp.unknown()),
+			Exp.unknown());
+	}
+
 	/**
 	 * Used to generate maps for use with batch put and touch operations.
 	 * 
@@ -205,9 +1221,12 @@ public class ExpireBin {
 		System.out.println("This is a demo of the expirable bin module for Java:");
 		try {
 			System.out.println("\nConnecting to Aerospike server...");
-			testClient = new AerospikeClient("127.0.0.1", 3000);
+			// Event loops for the async calls of ExpireBinAsync.
+			ClientPolicy clientPolicy = new ClientPolicy();
+			clientPolicy.eventLoops = new NioEventLoops(2);
+			testClient = new AerospikeClient(clientPolicy, "127.0.0.1", 3000);
 			System.out.println("Connected!");
-			Policy policy = new WritePolicy();
+			WritePolicy policy = new WritePolicy();
 			System.out.println("\nRegistering UDF...");
 			try {
 				RegisterTask regStatus = testClient.register(policy, "expire_bin.lua", "expire_bin.lua", Language.LUA);
@@ -222,6 +1241,10 @@ public class ExpireBin {
 			
 			ExpireBin eb = new ExpireBin(testClient);
 			Key testKey = new Key("test", "expireBin", "eb");
+			
+			// Record the latency and outcome of every call.
+			ExpireBinStats stats = new ExpireBinStats();
+			eb.setListener(stats);
 
 			// Example 1: validates the basic bin expiration.
 			expExample(policy, testKey, eb);
@@ -232,28 +1255,44 @@ public class ExpireBin {
 			// Example 3: shows the difference between normal 'get' and 'eb.get'.
 			getExample(policy, testKey, eb);
 			
+			// Example 4: elements expiring on their own inside a bin.
+			elemExample(policy, testKey, eb);
+			
+			// Example 5: writes many records asynchronously.
+			asyncExample(policy, eb, clientPolicy.eventLoops);
+			
+			System.out.println("\nCall statistics:");
+			System.out.print(stats);
 			System.out.println("Demo of the expirable bin module for Java successfully completed");
 		} catch (AerospikeException e) {
 			e.printStackTrace();
 			System.exit(1);
+		} finally {
+			if (testClient != null) {
+				testClient.close();
+				testClient.getEventLoops().close();
+			}
 		}
 	}
 	
-	private static void expExample(Policy policy, Key testKey, ExpireBin eb) throws AerospikeException {
+	private static void expExample(WritePolicy policy, Key testKey, ExpireBin eb) throws AerospikeException {
 		System.out.println("\nInserting bins...");
 		System.out.println(eb.put(policy, testKey, "TestBin1", Value.get("Hello World."), -1) == 0 ? "TestBin 1 inserted" : "TestBin 1 not inserted");
 		System.out.println(eb.put(policy, testKey, "TestBin2", Value.get("I don't expire."), 8) == 0 ? "TestBin 2 inserted" : "TestBin 2 not inserted");
 		System.out.println(eb.put(policy, testKey, "TestBin3", Value.get("I will expire soon."), 5) == 0 ? "TestBin 3 inserted" : "TestBin 3 not inserted");
 		
+		System.out.println(eb.putExp(policy, testKey, "TestBin6", Value.get("Written without the UDF."), 5) == 0 ? "TestBin 6 inserted" : "TestBin 6 not inserted");
+		
 		System.out.println("Getting bins...");
-		System.out.println(eb.get(policy, testKey, "TestBin1", "TestBin2", "TestBin3"));
+		System.out.println(eb.get(policy, testKey, "TestBin1", "TestBin2", "TestBin3", "TestBin6"));
 		
 		System.out.println("Getting bins TTL...");
 		System.out.println("TestBin 1 TTL: " + eb.ttl(policy, testKey, "TestBin1"));
 		System.out.println("TestBin 2 TTL: " + eb.ttl(policy, testKey, "TestBin2"));
 		System.out.println("TestBin 3 TTL: " + eb.ttl(policy, testKey, "TestBin3"));
+		System.out.println("TestBin 6 TTL: " + eb.ttl(policy, testKey, "TestBin6"));
 		
-		System.out.println("Waiting for TestBin 3 to expire...");
+		System.out.println("Waiting for TestBin 3 and TestBin 6 to expire...");
 		try {
 			TimeUnit.SECONDS.sleep(6);
 		} catch(InterruptedException ex) {
@@ -261,10 +1300,13 @@ public class ExpireBin {
 		}
 		
 		System.out.println("Getting bins again...");
-		System.out.println(eb.get(policy, testKey, "TestBin1", "TestBin2", "TestBin3"));
+		System.out.println(eb.get(policy, testKey, "TestBin1", "TestBin2", "TestBin3", "TestBin6"));
+		
+		System.out.println("Getting bins again, removing the expired ones...");
+		System.out.println(eb.getRepair(policy, testKey, 60, "TestBin1", "TestBin2", "TestBin3", "TestBin6"));
 	}
 	
-	private static void touchExample(Policy policy, Key testKey, ExpireBin eb) throws AerospikeException {
+	private static void touchExample(WritePolicy policy, Key testKey, ExpireBin eb) throws AerospikeException {
 		System.out.println("\nChanging expiration time for TestBin 1 and TestBin 2...");
 		eb.touch(policy, testKey, createBinMap("TestBin1", null, 3), createBinMap("TestBin2", null, -1));
 		
@@ -283,7 +1325,39 @@ public class ExpireBin {
 		System.out.println(eb.get(policy, testKey, "TestBin1", "TestBin2", "TestBin3"));
 	}
 	
-	private static void getExample(Policy policy, Key testKey, ExpireBin eb) throws Exception {
+	private static void elemExample(WritePolicy policy, Key testKey, ExpireBin eb) throws AerospikeException {
+		System.out.println("\nInserting elements into ElemBin...");
+		eb.putElem(policy, testKey, "ElemBin", Value.get("short"), Value.get(1), 2);
+		eb.putElem(policy, testKey, "ElemBin", Value.get("long"), Value.get(2), 60);
+		eb.putElem(policy, testKey, "ElemBin", Value.get("forever"), Value.get(3), -1);
+		System.out.println("Elements: " + eb.getElems(policy, testKey, "ElemBin"));
+		
+		System.out.println("Waiting for the short element to expire...");
+		try {
+			TimeUnit.SECONDS.sleep(3);
+		} catch(InterruptedException ex) {
+			Thread.currentThread().interrupt();
+		}
+		
+		System.out.println("Elements: " + eb.getElems(policy, testKey, "ElemBin"));
+		System.out.println("Elements dropped: " + eb.trim(policy, testKey, "ElemBin"));
+	}
+	
+	private static void asyncExample(WritePolicy policy, ExpireBin eb, EventLoops eventLoops) throws Exception {
+		ExpireBinAsync async = new ExpireBinAsync(eb, eventLoops, 64);
+		
+		System.out.println("\nInserting 1000 records asynchronously...");
+		ExpireBinAsync.BulkResult result = async.submitAll(policy, IntStream.range(0, 1000)
+			.mapToObj(i -> ExpireBinAsync.Write.put(new Key("test", "expireBin", "async" + i),
+				createBinMap("AsyncBin", Value.get(i), 30)))
+			.iterator()).get();
+		System.out.println(result);
+		
+		System.out.println("Getting one of them...");
+		System.out.println(async.get(policy, new Key("test", "expireBin", "async7"), "AsyncBin").get());
+	}
+	
+	private static void getExample(WritePolicy policy, Key testKey, ExpireBin eb) throws Exception {
 		// This illustrates the use of 'puts'.
 		System.out.println("\nInserting bins...");
 		System.out.println(eb.puts(policy, testKey, 
@@ -324,6 +1398,28 @@ public class ExpireBin {
 		
 		System.out.println("Scan completed!");
 		
+		System.out.println("Cleaning bins partition by partition, 4 workers at up to 1000 records per second...");
+		ExpireBinCleaner cleaner = new ExpireBinCleaner(client, eb)
+			.setThreads(4)
+			.setRecordsPerSecond(1000)
+			.setBins("TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5")
+			.setListener(progress -> {
+				if (progress.partitionsDone % 1024 == 0) {
+					System.out.println(progress);
+				}
+			});
+		
+		System.out.println("Partition clean completed, " + cleaner.run("test", "expireBin"));
+		
+		System.out.println("Reading the live bins of the set with a client-side scan...");
+		long scanned = new ExpireBinScanner(client)
+			.setThreads(4)
+			.scan("test", "expireBin", (key, rec) -> {
+				System.out.println(rec);
+				return true;
+			});
+		System.out.println(scanned + " records read");
+		
 		System.out.println("Checking expire bins again using 'eb interface'...");
 		System.out.println(eb.get(policy, testKey, "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5"));
 		
@@ -331,10 +1427,27 @@ public class ExpireBin {
 		record = client.get(policy, testKey, "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5");
 		
 		if (record != null) {
-			System.out.println(record.toString() + "\n");
+			System.out.println(record.toString());
 		}
 		else {		
-			System.out.println("Record not found\n");
+			System.out.println("Record not found");
+		}
+		
+		System.out.println("Checking expire bins again using 'eb interface' without the UDF...");
+		System.out.println(eb.getExp(policy, testKey, "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5"));
+		
+		// The second read is served from the client-side cache.
+		System.out.println("Checking expire bins twice through the client-side cache...");
+		ExpireBinCache cache = new ExpireBinCache(eb, 1000, 1000);
+		System.out.println(cache.get(policy, testKey, "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5"));
+		System.out.println(cache.get(policy, testKey, "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5"));
+		
+		// Read the test record and one that doesn't exist in a single batch call.
+		System.out.println("Getting expire bins of two records using 'batch get'...");
+		Key[] keys = new Key[] {testKey, new Key("test", "expireBin", "missingKey")};
+		for (BatchRecord br : eb.getMany(null, keys, "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5")) {
+			System.out.println(br.key.userKey + ": " + (br.resultCode == ResultCode.OK ? br.record : ResultCode.getResultString(br.resultCode)));
 		}
+		System.out.println();
 	}
 }
\ No newline at end of file
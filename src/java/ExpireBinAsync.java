@@ -0,0 +1,275 @@
+/*
+ * Copyright 2012-2015 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements WHICH ARE COMPATIBLE WITH THE APACHE LICENSE, VERSION 2.0.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+import java.util.Iterator;
+import java.util.Map;
+import java.util.concurrent.CompletableFuture;
+import java.util.concurrent.Semaphore;
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.concurrent.atomic.AtomicReference;
+
+import com.aerospike.client.AerospikeException;
+import com.aerospike.client.Key;
+import com.aerospike.client.Record;
+import com.aerospike.client.Value;
+import com.aerospike.client.Value.MapValue;
+import com.aerospike.client.async.EventLoops;
+import com.aerospike.client.policy.WritePolicy;
+
+/**
+ * Asynchronous counterpart of the ExpireBin key calls, run on the client's event
+ * loops. Each call returns a CompletableFuture instead of holding a thread until
+ * the server answers. The client must have been created with
+ * ClientPolicy.eventLoops set.
+ *
+ * At most maxInFlight calls are in flight at once. A call made at the limit
+ * blocks the calling thread until an earlier one completes, so a fast producer
+ * is held back to the rate the server absorbs instead of queueing without
+ * bound. Calls must therefore never be made from an event loop thread,
+ * including from the dependent stages of a future, which also run there.
+ *
+ * Calls are reported to the listener of the ExpireBin like its own.
+ */
+public class ExpireBinAsync {
+	private final ExpireBin eb;
+	private final EventLoops eventLoops;
+	private final int maxInFlight;
+	private final Semaphore permits;
+
+	/**
+	 * A put or touch of submitAll.
+	 */
+	public static final class Write {
+		final Key key;
+		final MapValue[] mapBins;
+		final boolean touch;
+
+		private Write(Key key, MapValue[] mapBins, boolean touch) {
+			this.key = key;
+			this.mapBins = mapBins;
+			this.touch = touch;
+		}
+
+		/** ExpireBin.puts of mapBins to key. */
+		public static Write put(Key key, MapValue ... mapBins) {
+			return new Write(key, mapBins, false);
+		}
+
+		/** ExpireBin.touch of mapBins of key. */
+		public static Write touch(Key key, MapValue ... mapBins) {
+			return new Write(key, mapBins, true);
+		}
+	}
+
+	/**
+	 * Outcome of submitAll.
+	 */
+	public static final class BulkResult {
+		/** Writes that succeeded. */
+		public final long succeeded;
+		/** Writes that returned 1, e.g. because a bin TTL exceeds the record TTL. */
+		public final long rejected;
+		/** Writes that failed with an exception. */
+		public final long failed;
+		/** Exception of the first failed write, null if none failed. */
+		public final Throwable firstError;
+
+		BulkResult(long succeeded, long rejected, long failed, Throwable firstError) {
+			this.succeeded = succeeded;
+			this.rejected = rejected;
+			this.failed = failed;
+			this.firstError = firstError;
+		}
+
+		@Override
+		public String toString() {
+			return succeeded + " succeeded, " + rejected + " rejected, " + failed + " failed";
+		}
+	}
+
+	/**
+	 * Initialize the async wrapper.
+	 *
+	 * @param eb          - ExpireBin of the client to run the calls on.
+	 * @param eventLoops  - Event loops of that client, from ClientPolicy.eventLoops.
+	 * @param maxInFlight - Maximum number of calls in flight at once.
+	 */
+	public ExpireBinAsync(ExpireBin eb, EventLoops eventLoops, int maxInFlight) {
+		this.eb = eb;
+		this.eventLoops = eventLoops;
+		this.maxInFlight = maxInFlight;
+		this.permits = new Semaphore(maxInFlight);
+	}
+
+	/**
+	 * Number of calls in flight.
+	 */
+	public int inFlight() {
+		return maxInFlight - permits.availablePermits();
+	}
+
+	/**
+	 * ExpireBin.get. The future holds null if the record doesn't exist.
+	 */
+	public CompletableFuture<Record> get(WritePolicy policy, Key key, String ... bins) {
+		return submit(ExpireBin.Op.GET, bins.length, policy, key, ExpireBin.GET_OP, values(bins))
+			.thenApply(returnVal -> ExpireBin.binRecord(returnVal, bins));
+	}
+
+	/**
+	 * ExpireBin.getRepair. The future holds null if the record doesn't exist.
+	 */
+	public CompletableFuture<Record> getRepair(WritePolicy policy, Key key, int repairInterval, String ... bins) {
+		Value[] valueArgs = new Value[bins.length + 1];
+		valueArgs[0] = Value.get(repairInterval);
+		System.arraycopy(values(bins), 0, valueArgs, 1, bins.length);
+
+		return submit(ExpireBin.Op.GET_REPAIR, bins.length, policy, key, ExpireBin.GET_REPAIR_OP, valueArgs)
+			.thenApply(returnVal -> ExpireBin.binRecord(returnVal, bins));
+	}
+
+	/**
+	 * ExpireBin.put. The future holds 0 if success, 1 if error.
+	 */
+	public CompletableFuture<Integer> put(WritePolicy policy, Key key, String binName, Value val, int binTTL) {
+		return submit(ExpireBin.Op.PUT, 0, policy, key, ExpireBin.PUT_OP, Value.get(binName), val, Value.get(binTTL))
+			.thenApply(ExpireBin::toInteger);
+	}
+
+	/**
+	 * ExpireBin.puts. The future holds 0 if all ops succeed, 1 otherwise.
+	 */
+	public CompletableFuture<Integer> puts(WritePolicy policy, Key key, MapValue ... mapBins) {
+		return submit(ExpireBin.Op.PUTS, 0, policy, key, ExpireBin.BATCH_PUT_OP, (Value[]) mapBins)
+			.thenApply(ExpireBin::toInteger);
+	}
+
+	/**
+	 * ExpireBin.touch. The future holds 0 on success of all touch operations, 1 if
+	 * a failure occurs.
+	 *
+	 * @throws - AerospikeException if a bin TTL is missing, before anything is sent.
+	 */
+	public CompletableFuture<Integer> touch(WritePolicy policy, Key key, MapValue ... mapBins) throws AerospikeException {
+		ExpireBin.checkTTL(mapBins);
+		return submit(ExpireBin.Op.TOUCH, 0, policy, key, ExpireBin.TOUCH_OP, (Value[]) mapBins)
+			.thenApply(ExpireBin::toInteger);
+	}
+
+	/**
+	 * ExpireBin.touchBins. The future holds the map of bin name to touch status,
+	 * null if the record doesn't exist.
+	 *
+	 * @throws - AerospikeException if a bin TTL is missing, before anything is sent.
+	 */
+	public CompletableFuture<Map<?, ?>> touchBins(WritePolicy policy, Key key, MapValue ... mapBins) throws AerospikeException {
+		ExpireBin.checkTTL(mapBins);
+		return submit(ExpireBin.Op.TOUCH_BINS, 0, policy, key, ExpireBin.TOUCH_BINS_OP, (Value[]) mapBins)
+			.thenApply(returnVal -> (returnVal instanceof Map) ? (Map<?, ?>) returnVal : null);
+	}
+
+	/**
+	 * ExpireBin.ttl. The future holds the time in seconds the bin will expire in,
+	 * -1 or null if it doesn't expire.
+	 */
+	public CompletableFuture<Integer> ttl(WritePolicy policy, Key key, String bin) {
+		return submit(ExpireBin.Op.TTL, 1, policy, key, ExpireBin.TTL_OP, Value.get(bin))
+			.thenApply(ExpireBin::toInteger);
+	}
+
+	/**
+	 * Submit a stream of puts and touches, e.g. stream.iterator(). The iterator is
+	 * consumed on the calling thread, which blocks whenever maxInFlight calls are
+	 * in flight, and this method returns once every write has been sent. A failed
+	 * write doesn't stop the others. Stops early if the calling thread is
+	 * interrupted.
+	 *
+	 * @param policy - Configuration parameters for the writes.
+	 * @param writes - Writes to submit.
+	 * @return       - Future completed once every write has completed.
+	 */
+	public CompletableFuture<BulkResult> submitAll(WritePolicy policy, Iterator<Write> writes) {
+		final CompletableFuture<BulkResult> done = new CompletableFuture<BulkResult>();
+		final AtomicLong succeeded = new AtomicLong();
+		final AtomicLong rejected = new AtomicLong();
+		final AtomicLong failed = new AtomicLong();
+		final AtomicReference<Throwable> firstError = new AtomicReference<Throwable>();
+		// One more than the writes in flight until the iterator is exhausted.
+		final AtomicLong pending = new AtomicLong(1);
+
+		Runnable complete = () -> {
+			if (pending.decrementAndGet() == 0) {
+				done.complete(new BulkResult(succeeded.get(), rejected.get(), failed.get(), firstError.get()));
+			}
+		};
+
+		while (writes.hasNext() && !Thread.currentThread().isInterrupted()) {
+			Write w = writes.next();
+			CompletableFuture<Integer> f;
+
+			pending.incrementAndGet();
+
+			try {
+				f = w.touch ? touch(policy, w.key, w.mapBins) : puts(policy, w.key, w.mapBins);
+			} catch (AerospikeException ae) {
+				f = new CompletableFuture<Integer>();
+				f.completeExceptionally(ae);
+			}
+
+			f.whenComplete((rc, t) -> {
+				if (t != null) {
+					failed.incrementAndGet();
+					firstError.compareAndSet(null, t);
+				} else if (rc != null && rc != 0) {
+					rejected.incrementAndGet();
+				} else {
+					succeeded.incrementAndGet();
+				}
+				complete.run();
+			});
+		}
+		complete.run();
+		return done;
+	}
+
+	/**
+	 * Run a call once a permit is free, and give the permit back when it completes.
+	 */
+	private CompletableFuture<Object> submit(ExpireBin.Op op, int bins, WritePolicy policy, Key key, String function, Value ... args) {
+		try {
+			permits.acquire();
+		} catch (InterruptedException ie) {
+			Thread.currentThread().interrupt();
+			CompletableFuture<Object> f = new CompletableFuture<Object>();
+			f.completeExceptionally(new AerospikeException(ie));
+			return f;
+		}
+
+		CompletableFuture<Object> f = eb.executeAsync(eventLoops.next(), op, bins, policy, key, function, args);
+		f.whenComplete((returnVal, t) -> permits.release());
+		return f;
+	}
+
+	private static Value[] values(String[] bins) {
+		Value[] valueBins = new Value[bins.length];
+
+		for (int i = 0; i < bins.length; i++) {
+			valueBins[i] = Value.get(bins[i]);
+		}
+		return valueBins;
+	}
+}
@@ -0,0 +1,268 @@
+/*
+ * Copyright 2012-2015 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements WHICH ARE COMPATIBLE WITH THE APACHE LICENSE, VERSION 2.0.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+import java.util.Arrays;
+import java.util.Random;
+import java.util.concurrent.TimeUnit;
+
+import com.aerospike.client.AerospikeClient;
+import com.aerospike.client.AerospikeException;
+import com.aerospike.client.Key;
+import com.aerospike.client.Value;
+import com.aerospike.client.Value.MapValue;
+import com.aerospike.client.policy.ClientPolicy;
+import com.aerospike.client.policy.WritePolicy;
+
+/**
+ * Load generator for the expire bin operations. Runs a weighted mix of get, put,
+ * puts, touch and ttl over keys x bins from a number of threads against a
+ * server with the expire_bin module registered, then reports the throughput and
+ * latency percentiles of each operation, as recorded by an ExpireBinStats.
+ *
+ * Run with: mvn -Pbenchmark verify -Dbenchmark.args="-k 10000 -z 8 -d 10"
+ */
+public class ExpireBinBenchmark {
+	private static final String[] OP_NAMES = {"get", "put", "puts", "touch", "ttl"};
+	private static final ExpireBin.Op[] OPS = {ExpireBin.Op.GET, ExpireBin.Op.PUT, ExpireBin.Op.PUTS, ExpireBin.Op.TOUCH, ExpireBin.Op.TTL};
+	private static final int GET = 0, PUT = 1, PUTS = 2, TOUCH = 3, TTL = 4;
+
+	private String host = "127.0.0.1";
+	private int port = 3000;
+	private String namespace = "test";
+	private String set = "expireBinBench";
+	private int keys = 10000;
+	private int bins = 4;
+	private int threads = 8;
+	private int duration = 10;
+	private int binTTL = 3600;
+	private boolean prefill = true;
+	private int[] weights = {50, 20, 10, 10, 10};
+
+	private String[] binNames;
+	private volatile boolean running = true;
+
+	/**
+	 * One load generating thread with its own error counts. Latencies are
+	 * recorded by the listener of eb.
+	 */
+	private final class Worker extends Thread {
+		final long[] errors = new long[OP_NAMES.length];
+		final ExpireBin eb;
+		final Random random;
+
+		Worker(ExpireBin eb, long seed) {
+			this.eb = eb;
+			this.random = new Random(seed);
+		}
+
+		@Override
+		public void run() {
+			WritePolicy policy = new WritePolicy();
+
+			while (running) {
+				int op = pickOp(random);
+				Key key = new Key(namespace, set, random.nextInt(keys));
+
+				try {
+					runOp(eb, policy, op, key, random);
+				} catch (AerospikeException ae) {
+					errors[op]++;
+				}
+			}
+		}
+	}
+
+	private int pickOp(Random random) {
+		int total = 0;
+
+		for (int w : weights) {
+			total += w;
+		}
+
+		int r = random.nextInt(total);
+
+		for (int i = 0; i < weights.length; i++) {
+			if (r < weights[i]) {
+				return i;
+			}
+			r -= weights[i];
+		}
+		return GET;
+	}
+
+	private MapValue[] binMaps(boolean withValue, Random random) {
+		MapValue[] maps = new MapValue[bins];
+
+		for (int i = 0; i < bins; i++) {
+			maps[i] = ExpireBin.createBinMap(binNames[i], withValue ? Value.get(random.nextInt()) : null, binTTL);
+		}
+		return maps;
+	}
+
+	private void runOp(ExpireBin eb, WritePolicy policy, int op, Key key, Random random) throws AerospikeException {
+		String bin = binNames[random.nextInt(bins)];
+
+		switch (op) {
+		case GET:
+			eb.get(policy, key, binNames);
+			break;
+		case PUT:
+			eb.put(policy, key, bin, Value.get(random.nextInt()), binTTL);
+			break;
+		case PUTS:
+			eb.puts(policy, key, binMaps(true, random));
+			break;
+		case TOUCH:
+			eb.touch(policy, key, binMaps(false, random));
+			break;
+		case TTL:
+			eb.ttl(policy, key, bin);
+			break;
+		}
+	}
+
+	private void run() throws Exception {
+		binNames = new String[bins];
+
+		for (int i = 0; i < bins; i++) {
+			binNames[i] = "bin" + i;
+		}
+
+		ClientPolicy clientPolicy = new ClientPolicy();
+		clientPolicy.maxConnsPerNode = threads * 2;
+		AerospikeClient client = new AerospikeClient(clientPolicy, host, port);
+
+		try {
+			// The expire_bin module must already be registered, see ExpireBin.main.
+			ExpireBin eb = new ExpireBin(client);
+
+			if (prefill) {
+				System.out.println("Writing " + keys + " keys x " + bins + " bins...");
+				Random random = new Random(0);
+
+				for (int k = 0; k < keys; k++) {
+					eb.puts(null, new Key(namespace, set, k), binMaps(true, random));
+				}
+			}
+
+			// Only record the run itself.
+			ExpireBinStats stats = new ExpireBinStats();
+			eb.setListener(stats);
+
+			System.out.println("Running " + threads + " workers for " + duration + " seconds...");
+			Worker[] workers = new Worker[threads];
+			long begin = System.nanoTime();
+
+			for (int i = 0; i < threads; i++) {
+				workers[i] = new Worker(eb, begin + i);
+				workers[i].start();
+			}
+
+			TimeUnit.SECONDS.sleep(duration);
+			running = false;
+
+			for (Worker worker : workers) {
+				worker.join();
+			}
+
+			double elapsed = (System.nanoTime() - begin) / 1e9;
+
+			System.out.println(String.format("%-6s %10s %10s %8s %8s %8s %8s %8s", "op", "count", "ops/s", "p50 us", "p99 us", "p999 us", "max us", "errors"));
+
+			for (int op = 0; op < OP_NAMES.length; op++) {
+				long n = stats.count(OPS[op]);
+				long errors = 0;
+
+				for (Worker worker : workers) {
+					errors += worker.errors[op];
+				}
+
+				if (n == 0) {
+					continue;
+				}
+
+				System.out.println(String.format("%-6s %10d %10.0f %8d %8d %8d %8d %8d", OP_NAMES[op], n, n / elapsed,
+					stats.percentile(OPS[op], 50), stats.percentile(OPS[op], 99), stats.percentile(OPS[op], 99.9), stats.max(OPS[op]), errors));
+			}
+		} finally {
+			client.close();
+		}
+	}
+
+	private void parseMix(String mix) {
+		weights = new int[OP_NAMES.length];
+
+		for (String part : mix.split(",")) {
+			String[] kv = part.split("=");
+			int op = Arrays.asList(OP_NAMES).indexOf(kv[0]);
+
+			if (kv.length != 2 || op < 0) {
+				throw new IllegalArgumentException("Invalid op weight: " + part);
+			}
+			weights[op] = Integer.parseInt(kv[1]);
+		}
+	}
+
+	private void usage() {
+		System.out.println("Usage: ExpireBinBenchmark [options]");
+		System.out.println("  -h host       Server host (default " + host + ").");
+		System.out.println("  -p port       Server port (default " + port + ").");
+		System.out.println("  -n namespace  Namespace (default " + namespace + ").");
+		System.out.println("  -s set        Set (default " + set + ").");
+		System.out.println("  -k keys       Number of keys (default " + keys + ").");
+		System.out.println("  -b bins       Expire bins per key (default " + bins + ").");
+		System.out.println("  -z threads    Concurrent workers (default " + threads + ").");
+		System.out.println("  -d seconds    Duration (default " + duration + ").");
+		System.out.println("  -t bin_ttl    Bin TTL of puts and touches (default " + binTTL + ").");
+		System.out.println("  -w mix        Op weights, e.g. get=50,put=20,puts=10,touch=10,ttl=10 (the default).");
+		System.out.println("  -P            Skip writing every key before the run.");
+	}
+
+	private boolean parseArgs(String[] args) {
+		try {
+			for (int i = 0; i < args.length; i++) {
+				switch (args[i]) {
+				case "-h": host = args[++i]; break;
+				case "-p": port = Integer.parseInt(args[++i]); break;
+				case "-n": namespace = args[++i]; break;
+				case "-s": set = args[++i]; break;
+				case "-k": keys = Integer.parseInt(args[++i]); break;
+				case "-b": bins = Integer.parseInt(args[++i]); break;
+				case "-z": threads = Integer.parseInt(args[++i]); break;
+				case "-d": duration = Integer.parseInt(args[++i]); break;
+				case "-t": binTTL = Integer.parseInt(args[++i]); break;
+				case "-w": parseMix(args[++i]); break;
+				case "-P": prefill = false; break;
+				default: return false;
+				}
+			}
+		} catch (RuntimeException e) {
+			return false;
+		}
+		return keys > 0 && bins > 0 && threads > 0;
+	}
+
+	public static void main(String[] args) throws Exception {
+		ExpireBinBenchmark benchmark = new ExpireBinBenchmark();
+
+		if (!benchmark.parseArgs(args)) {
+			benchmark.usage();
+			System.exit(1);
+		}
+		benchmark.run();
+	}
+}
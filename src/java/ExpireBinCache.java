@@ -0,0 +1,314 @@
+/*
+ * Copyright 2012-2015 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements WHICH ARE COMPATIBLE WITH THE APACHE LICENSE, VERSION 2.0.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.Iterator;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.atomic.AtomicLongArray;
+
+import com.aerospike.client.AerospikeException;
+import com.aerospike.client.Key;
+import com.aerospike.client.Record;
+import com.aerospike.client.Value;
+import com.aerospike.client.Value.MapValue;
+import com.aerospike.client.policy.WritePolicy;
+import com.aerospike.client.query.Statement;
+import com.aerospike.client.task.ExecuteTask;
+
+/**
+ * Opt-in client-side cache of live expire bin values for hot keys. Values read
+ * through get are kept until their bin expires or maxStaleMillis passes,
+ * whichever comes first, and are served without a server round trip until then.
+ * Bins that were expired or missing are cached the same way.
+ *
+ * Reads never block. The write methods of this class invalidate the key after
+ * the write, and a read that was already on its way to the server when the key
+ * was invalidated doesn't cache what it read. Writes made by other clients are
+ * only seen once maxStaleMillis has passed. Cached values are shared between
+ * callers and must not be modified.
+ */
+public class ExpireBinCache {
+	private static final int VERSION_STRIPES = 1024;
+
+	private final ExpireBin eb;
+	private final int maxKeys;
+	private final long maxStaleMillis;
+	private final ConcurrentHashMap<Key, ConcurrentHashMap<String, CachedBin>> keys;
+	// Bumped when a key is invalidated. Keys share the version of their stripe,
+	// which only makes reads skip the cache a little more often.
+	private final AtomicLongArray versions = new AtomicLongArray(VERSION_STRIPES);
+
+	/**
+	 * A cached bin value, or a cached miss if present is false.
+	 */
+	private static final class CachedBin {
+		final Object value;
+		final boolean present;
+		final long untilMillis;
+
+		CachedBin(Object value, boolean present, long untilMillis) {
+			this.value = value;
+			this.present = present;
+			this.untilMillis = untilMillis;
+		}
+	}
+
+	/**
+	 * Initialize the cache.
+	 *
+	 * @param eb             - ExpireBin to read and write through.
+	 * @param maxKeys        - Maximum number of keys to cache.
+	 * @param maxStaleMillis - How long a value may be served from the cache at most.
+	 */
+	public ExpireBinCache(ExpireBin eb, int maxKeys, long maxStaleMillis) {
+		this.eb = eb;
+		this.maxKeys = maxKeys;
+		this.maxStaleMillis = maxStaleMillis;
+		this.keys = new ConcurrentHashMap<Key, ConcurrentHashMap<String, CachedBin>>();
+	}
+
+	/**
+	 * ExpireBin.getExp served from the cache. Only bins that aren't cached are
+	 * read from the server, and their values are added to the cache.
+	 *
+	 * @param policy - Configuration parameters for op.
+	 * @param key    - Key to get from.
+	 * @param bins   - List of bin names to attempt to get from.
+	 * @return       - Record containing respective values for bins that haven't
+	 *                 expired/exist, null if the record doesn't exist. The 'gen' and
+	 *                 'exp' numbers on the Record are not valid.
+	 * @throws       - AerospikeException.
+	 */
+	public Record get(WritePolicy policy, Key key, String ... bins) throws AerospikeException {
+		long now = System.currentTimeMillis();
+		ConcurrentHashMap<String, CachedBin> cached = keys.get(key);
+		HashMap<String, Object> recMap = new HashMap<String, Object>();
+		List<String> missed = new ArrayList<String>();
+
+		for (String bin : bins) {
+			CachedBin cb = (cached != null) ? cached.get(bin) : null;
+
+			if (cb == null || cb.untilMillis <= now) {
+				missed.add(bin);
+			} else if (cb.present) {
+				recMap.put(bin, cb.value);
+			}
+		}
+
+		if (missed.isEmpty()) {
+			return new Record(recMap, 0, 0);
+		}
+
+		int stripe = stripe(key);
+		long version = versions.get(stripe);
+		Map<String, ExpireBin.Entry> fetched = eb.getExpEntries(policy, key, missed.toArray(new String[missed.size()]));
+
+		if (fetched == null) {
+			return null;
+		}
+
+		// The key was written while reading: the values may predate the write.
+		boolean cache = versions.get(stripe) == version;
+
+		if (cache && cached == null) {
+			if (keys.size() >= maxKeys) {
+				evict(now);
+			}
+			cached = keys.computeIfAbsent(key, k -> new ConcurrentHashMap<String, CachedBin>());
+		}
+
+		long staleMillis = now + maxStaleMillis;
+
+		for (String bin : missed) {
+			ExpireBin.Entry entry = fetched.get(bin);
+
+			if (entry == null) {
+				if (cache) {
+					cached.put(bin, new CachedBin(null, false, staleMillis));
+				}
+				continue;
+			}
+
+			long untilMillis = staleMillis;
+
+			if (entry.expiry != 0) {
+				untilMillis = Math.min(untilMillis, (entry.expiry + ExpireBin.CITRUSLEAF_EPOCH) * 1000);
+			}
+			if (cache) {
+				cached.put(bin, new CachedBin(entry.value, true, untilMillis));
+			}
+			recMap.put(bin, entry.value);
+		}
+
+		// Invalidated while the values were added.
+		if (cache && versions.get(stripe) != version) {
+			keys.remove(key, cached);
+		}
+		return new Record(recMap, 0, 0);
+	}
+
+	/**
+	 * Drop every cached bin of a key.
+	 *
+	 * @param key - Record key.
+	 */
+	public void invalidate(Key key) {
+		versions.incrementAndGet(stripe(key));
+		keys.remove(key);
+	}
+
+	/**
+	 * Drop every cached bin.
+	 */
+	public void clear() {
+		for (int i = 0; i < VERSION_STRIPES; i++) {
+			versions.incrementAndGet(i);
+		}
+		keys.clear();
+	}
+
+	/**
+	 * ExpireBin.put, then invalidate the key.
+	 */
+	public Integer put(WritePolicy policy, Key key, String binName, Value val, int binTTL) throws AerospikeException {
+		try {
+			return eb.put(policy, key, binName, val, binTTL);
+		} finally {
+			invalidate(key);
+		}
+	}
+
+	/**
+	 * ExpireBin.putExp, then invalidate the key.
+	 */
+	public Integer putExp(WritePolicy policy, Key key, String binName, Value val, int binTTL) throws AerospikeException {
+		try {
+			return eb.putExp(policy, key, binName, val, binTTL);
+		} finally {
+			invalidate(key);
+		}
+	}
+
+	/**
+	 * ExpireBin.puts, then invalidate the key.
+	 */
+	public Integer puts(WritePolicy policy, Key key, MapValue ... mapBins) throws AerospikeException {
+		try {
+			return eb.puts(policy, key, mapBins);
+		} finally {
+			invalidate(key);
+		}
+	}
+
+	/**
+	 * ExpireBin.touch, then invalidate the key.
+	 */
+	public Integer touch(WritePolicy policy, Key key, MapValue ... mapBins) throws AerospikeException {
+		try {
+			return eb.touch(policy, key, mapBins);
+		} finally {
+			invalidate(key);
+		}
+	}
+
+	/**
+	 * ExpireBin.touchBins, then invalidate the key.
+	 */
+	public Map<?, ?> touchBins(WritePolicy policy, Key key, MapValue ... mapBins) throws AerospikeException {
+		try {
+			return eb.touchBins(policy, key, mapBins);
+		} finally {
+			invalidate(key);
+		}
+	}
+
+	/**
+	 * ExpireBin.cleanRecord, then invalidate the key.
+	 */
+	public Integer cleanRecord(WritePolicy policy, Key key, String ... bins) throws AerospikeException {
+		try {
+			return eb.cleanRecord(policy, key, bins);
+		} finally {
+			invalidate(key);
+		}
+	}
+
+	/**
+	 * ExpireBin.clean, then clear the cache.
+	 */
+	public ExecuteTask clean(WritePolicy policy, Statement statement, String ... bins) throws AerospikeException {
+		try {
+			return eb.clean(policy, statement, bins);
+		} finally {
+			clear();
+		}
+	}
+
+	/**
+	 * ExpireBin.cleanAll, then clear the cache.
+	 */
+	public ExecuteTask cleanAll(WritePolicy policy, Statement statement) throws AerospikeException {
+		try {
+			return eb.cleanAll(policy, statement);
+		} finally {
+			clear();
+		}
+	}
+
+	private static int stripe(Key key) {
+		return (key.hashCode() & 0x7fffffff) % VERSION_STRIPES;
+	}
+
+	/**
+	 * Make room for new keys: drop keys whose bins are all stale, then, if that
+	 * wasn't enough, an eighth of the cache.
+	 */
+	private void evict(long now) {
+		Iterator<ConcurrentHashMap<String, CachedBin>> it = keys.values().iterator();
+
+		while (it.hasNext()) {
+			boolean stale = true;
+
+			for (CachedBin cb : it.next().values()) {
+				if (cb.untilMillis > now) {
+					stale = false;
+					break;
+				}
+			}
+
+			if (stale) {
+				it.remove();
+			}
+		}
+
+		if (keys.size() < maxKeys) {
+			return;
+		}
+
+		int excess = keys.size() - maxKeys + Math.max(1, maxKeys / 8);
+		it = keys.values().iterator();
+
+		while (excess > 0 && it.hasNext()) {
+			it.next();
+			it.remove();
+			excess--;
+		}
+	}
+}
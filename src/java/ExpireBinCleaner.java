@@ -0,0 +1,330 @@
+/*
+ * Copyright 2012-2015 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements WHICH ARE COMPATIBLE WITH THE APACHE LICENSE, VERSION 2.0.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.io.Writer;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Files;
+import java.util.ArrayList;
+import java.util.BitSet;
+import java.util.List;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicInteger;
+import java.util.concurrent.atomic.AtomicLong;
+
+import com.aerospike.client.AerospikeClient;
+import com.aerospike.client.AerospikeException;
+import com.aerospike.client.Key;
+import com.aerospike.client.Record;
+import com.aerospike.client.ResultCode;
+import com.aerospike.client.ScanCallback;
+import com.aerospike.client.exp.Exp;
+import com.aerospike.client.policy.ScanPolicy;
+import com.aerospike.client.policy.WritePolicy;
+import com.aerospike.client.query.PartitionFilter;
+
+/**
+ * Clean expired bins partition by partition, as an alternative to the single
+ * background scan UDF of ExpireBin.clean.
+ *
+ * Each partition is scanned for the keys of records that may hold expired bins,
+ * going by their expbin_meta summary, and those records are cleaned one by one.
+ * Partitions are shared out to a pool of workers, the number of records cleaned
+ * per second can be capped, progress is reported after each partition, and
+ * finished partitions can be recorded in a checkpoint file so that a later run
+ * resumes where an interrupted one stopped.
+ */
+public class ExpireBinCleaner {
+	public static final int PARTITIONS = 4096;
+
+	private final AerospikeClient client;
+	private final ExpireBin eb;
+	private int threads = 1;
+	private int recordsPerSecond = 0;
+	private File checkpoint = null;
+	private Listener listener = null;
+	private String[] bins = new String[0];
+	private ScanPolicy scanPolicy = new ScanPolicy();
+	private WritePolicy writePolicy = new WritePolicy();
+
+	/**
+	 * Called after each partition is cleaned, from the worker that cleaned it.
+	 */
+	public interface Listener {
+		void onProgress(Progress progress);
+	}
+
+	/**
+	 * Progress of a run.
+	 */
+	public static final class Progress {
+		/** Partitions cleaned, including those skipped by a checkpoint. */
+		public final int partitionsDone;
+		public final int partitionsTotal;
+		/** Records cleaned in this run. */
+		public final long records;
+		/** Expired bins removed in this run. */
+		public final long binsRemoved;
+		/** Records whose clean failed in this run, for example on a timeout. They are skipped. */
+		public final long failed;
+
+		Progress(int partitionsDone, int partitionsTotal, long records, long binsRemoved, long failed) {
+			this.partitionsDone = partitionsDone;
+			this.partitionsTotal = partitionsTotal;
+			this.records = records;
+			this.binsRemoved = binsRemoved;
+			this.failed = failed;
+		}
+
+		@Override
+		public String toString() {
+			return partitionsDone + "/" + partitionsTotal + " partitions, " + records + " records, " + binsRemoved + " bins removed, "
+				+ failed + " failed";
+		}
+	}
+
+	/**
+	 * Initialize the cleaner.
+	 *
+	 * @param client - Client to perform operations on.
+	 */
+	public ExpireBinCleaner(AerospikeClient client) {
+		this(client, new ExpireBin(client));
+	}
+
+	/**
+	 * Initialize the cleaner with the ExpireBin cleaning each record, so the
+	 * per-record cleans are reported to its listener.
+	 *
+	 * @param client - Client to perform operations on.
+	 * @param eb     - ExpireBin to clean records with.
+	 */
+	public ExpireBinCleaner(AerospikeClient client, ExpireBin eb) {
+		this.client = client;
+		this.eb = eb;
+		this.scanPolicy.includeBinData = false;
+	}
+
+	/** Number of workers, each cleaning one partition at a time. Default 1. */
+	public ExpireBinCleaner setThreads(int threads) {
+		this.threads = threads;
+		return this;
+	}
+
+	/**
+	 * Maximum records cleaned per second over all workers, 0 for no limit. Default 0.
+	 * Enforced by the server, which paces each partition scan.
+	 */
+	public ExpireBinCleaner setRecordsPerSecond(int recordsPerSecond) {
+		this.recordsPerSecond = recordsPerSecond;
+		return this;
+	}
+
+	/**
+	 * File recording finished partitions, null to always clean every partition. Default null.
+	 * It is deleted once every partition is done.
+	 */
+	public ExpireBinCleaner setCheckpoint(File checkpoint) {
+		this.checkpoint = checkpoint;
+		return this;
+	}
+
+	/** Progress listener, or null. Default null. */
+	public ExpireBinCleaner setListener(Listener listener) {
+		this.listener = listener;
+		return this;
+	}
+
+	/** Bins to clean, or none to clean every expire bin. Default none. */
+	public ExpireBinCleaner setBins(String ... bins) {
+		this.bins = bins;
+		return this;
+	}
+
+	/** Policy for the partition scans. The filter expression is set by the cleaner. */
+	public ExpireBinCleaner setScanPolicy(ScanPolicy scanPolicy) {
+		this.scanPolicy = new ScanPolicy(scanPolicy);
+		this.scanPolicy.includeBinData = false;
+		return this;
+	}
+
+	/** Policy for cleaning each record. */
+	public ExpireBinCleaner setWritePolicy(WritePolicy writePolicy) {
+		this.writePolicy = writePolicy;
+		return this;
+	}
+
+	/**
+	 * Clean a namespace or set. A record whose clean fails is counted in
+	 * Progress.failed and skipped; only a failed partition scan stops the run.
+	 * If the run fails, the partitions finished so far stay in the checkpoint
+	 * file and are skipped by the next run. Once every partition is done, the
+	 * file is deleted so the next run starts over.
+	 *
+	 * @param namespace - Namespace to clean.
+	 * @param set       - Set to clean, or null for the whole namespace.
+	 * @return          - Progress at the end of the run.
+	 * @throws          - AerospikeException, IOException or InterruptedException.
+	 */
+	public Progress run(String namespace, String set) throws AerospikeException, IOException, InterruptedException {
+		BitSet done = loadCheckpoint();
+		final List<Integer> pending = new ArrayList<Integer>();
+
+		for (int id = 0; id < PARTITIONS; id++) {
+			if (!done.get(id)) {
+				pending.add(id);
+			}
+		}
+
+		final ScanPolicy policy = new ScanPolicy(scanPolicy);
+		policy.filterExp = Exp.build(ExpireBin.isCleanDue());
+
+		// A partition is on a single node, so splitting the cap over the
+		// workers caps the whole run.
+		if (recordsPerSecond > 0) {
+			policy.recordsPerSecond = Math.max(1, recordsPerSecond / threads);
+		}
+
+		final AtomicInteger next = new AtomicInteger();
+		final AtomicInteger partitionsDone = new AtomicInteger(PARTITIONS - pending.size());
+		final AtomicLong records = new AtomicLong();
+		final AtomicLong binsRemoved = new AtomicLong();
+		final AtomicLong failed = new AtomicLong();
+		final Writer out = (checkpoint != null) ? new FileWriter(checkpoint, true) : null;
+
+		// End a line cut short by a crash before appending to it.
+		if (out != null && checkpoint.length() > 0) {
+			try (RandomAccessFile in = new RandomAccessFile(checkpoint, "r")) {
+				in.seek(in.length() - 1);
+
+				if (in.read() != '\n') {
+					out.write("\n");
+				}
+			}
+		}
+		ExecutorService pool = Executors.newFixedThreadPool(threads);
+
+		try {
+			List<Future<Void>> workers = new ArrayList<Future<Void>>();
+
+			for (int i = 0; i < threads; i++) {
+				workers.add(pool.submit(() -> {
+					int index;
+
+					while ((index = next.getAndIncrement()) < pending.size()) {
+						int id = pending.get(index);
+
+						client.scanPartitions(policy, PartitionFilter.id(id), namespace, set, new ScanCallback() {
+							public void scanCallback(Key key, Record record) throws AerospikeException {
+								try {
+									binsRemoved.addAndGet(eb.cleanKey(writePolicy, key, bins));
+									records.incrementAndGet();
+								} catch (AerospikeException ae) {
+									// The record may have been removed since the scan saw it.
+									// Any other failure, such as a timeout, only skips the record.
+									if (ae.getResultCode() != ResultCode.KEY_NOT_FOUND_ERROR) {
+										failed.incrementAndGet();
+									}
+								}
+							}
+						});
+
+						markDone(out, id);
+						Progress progress = new Progress(partitionsDone.incrementAndGet(), PARTITIONS, records.get(), binsRemoved.get(),
+							failed.get());
+
+						if (listener != null) {
+							listener.onProgress(progress);
+						}
+					}
+					return null;
+				}));
+			}
+
+			for (Future<Void> worker : workers) {
+				try {
+					worker.get();
+				} catch (ExecutionException ee) {
+					// Stop the other workers at their next partition.
+					next.set(pending.size());
+
+					if (ee.getCause() instanceof AerospikeException) {
+						throw (AerospikeException) ee.getCause();
+					}
+					if (ee.getCause() instanceof IOException) {
+						throw (IOException) ee.getCause();
+					}
+					throw new AerospikeException(ee.getCause());
+				}
+			}
+		} finally {
+			pool.shutdown();
+			pool.awaitTermination(1, TimeUnit.MINUTES);
+
+			if (out != null) {
+				out.close();
+			}
+		}
+
+		// Start the next run over once every partition is done.
+		if (checkpoint != null && partitionsDone.get() == PARTITIONS) {
+			Files.deleteIfExists(checkpoint.toPath());
+		}
+		return new Progress(partitionsDone.get(), PARTITIONS, records.get(), binsRemoved.get(), failed.get());
+	}
+
+	/**
+	 * Partitions finished by earlier runs.
+	 */
+	private BitSet loadCheckpoint() throws IOException {
+		BitSet done = new BitSet(PARTITIONS);
+
+		if (checkpoint == null || !checkpoint.exists()) {
+			return done;
+		}
+
+		String[] lines = new String(Files.readAllBytes(checkpoint.toPath()), StandardCharsets.US_ASCII).split("\n", -1);
+
+		// The last line is either empty or was cut short by a crash.
+		for (int i = 0; i < lines.length - 1; i++) {
+			String line = lines[i].trim();
+
+			if (line.matches("\\d+") && Integer.parseInt(line) < PARTITIONS) {
+				done.set(Integer.parseInt(line));
+			}
+		}
+		return done;
+	}
+
+	private static void markDone(Writer out, int id) throws IOException {
+		if (out == null) {
+			return;
+		}
+
+		synchronized (out) {
+			out.write(id + "\n");
+			out.flush();
+		}
+	}
+}
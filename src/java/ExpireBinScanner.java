@@ -0,0 +1,210 @@
+/*
+ * Copyright 2012-2015 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements WHICH ARE COMPATIBLE WITH THE APACHE LICENSE, VERSION 2.0.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.ArrayBlockingQueue;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicBoolean;
+import java.util.concurrent.atomic.AtomicInteger;
+
+import com.aerospike.client.AerospikeClient;
+import com.aerospike.client.AerospikeException;
+import com.aerospike.client.Key;
+import com.aerospike.client.Record;
+import com.aerospike.client.ScanCallback;
+import com.aerospike.client.policy.ScanPolicy;
+import com.aerospike.client.query.KeyRecord;
+import com.aerospike.client.query.PartitionFilter;
+
+/**
+ * Read every record of a namespace or set with the expiry of its bins applied,
+ * without running the UDF.
+ *
+ * Partitions are scanned by a pool of workers, one partition at a time. Each
+ * record is decoded on the client as it arrives, with ExpireBin.liveRecord, and
+ * handed over through a bounded queue to the handler, which runs on the thread
+ * that called scan. Once the queue is full the workers wait, so a slow handler
+ * slows the scans down instead of buffering the result set. Expiries are tested
+ * against the client clock.
+ */
+public class ExpireBinScanner {
+	private static final KeyRecord END = new KeyRecord(null, null);
+
+	private final AerospikeClient client;
+	private int threads = 1;
+	private int queueSize = 1024;
+	private String[] bins = new String[0];
+	private ScanPolicy scanPolicy = new ScanPolicy();
+
+	/**
+	 * Receives the records of a scan, on the thread that called scan.
+	 */
+	public interface Handler {
+		/**
+		 * @param key    - Key of the record. The user key is only set if it was stored with the record.
+		 * @param record - Live bins of the record, see ExpireBin.liveRecord.
+		 * @return       - false to stop the scan.
+		 */
+		boolean onRecord(Key key, Record record);
+	}
+
+	/**
+	 * Initialize the scanner.
+	 *
+	 * @param client - Client to perform operations on.
+	 */
+	public ExpireBinScanner(AerospikeClient client) {
+		this.client = client;
+	}
+
+	/** Number of workers, each scanning one partition at a time. Default 1. */
+	public ExpireBinScanner setThreads(int threads) {
+		this.threads = threads;
+		return this;
+	}
+
+	/** Records decoded ahead of the handler at most. Default 1024. */
+	public ExpireBinScanner setQueueSize(int queueSize) {
+		this.queueSize = queueSize;
+		return this;
+	}
+
+	/** Bins to read, or none to read every bin. Default none. */
+	public ExpireBinScanner setBins(String ... bins) {
+		this.bins = bins;
+		return this;
+	}
+
+	/** Policy for the partition scans. */
+	public ExpireBinScanner setScanPolicy(ScanPolicy scanPolicy) {
+		this.scanPolicy = new ScanPolicy(scanPolicy);
+		return this;
+	}
+
+	/**
+	 * Scan a namespace or set. Records left with no bin once expired bins are
+	 * removed are skipped.
+	 *
+	 * @param namespace - Namespace to scan.
+	 * @param set       - Set to scan, or null for the whole namespace.
+	 * @param handler   - Receives each record.
+	 * @return          - Number of records handed to the handler.
+	 * @throws          - AerospikeException or InterruptedException.
+	 */
+	public long scan(String namespace, String set, Handler handler) throws AerospikeException, InterruptedException {
+		final ScanPolicy policy = new ScanPolicy(scanPolicy);
+		final BlockingQueue<KeyRecord> queue = new ArrayBlockingQueue<KeyRecord>(queueSize);
+		final AtomicInteger next = new AtomicInteger();
+		// stopped ends the scans, closed is set once nothing reads the queue.
+		final AtomicBoolean stopped = new AtomicBoolean();
+		final AtomicBoolean closed = new AtomicBoolean();
+		final String[] binNames = (bins.length > 0) ? bins : null;
+		ExecutorService pool = Executors.newFixedThreadPool(threads);
+		List<Future<Void>> workers = new ArrayList<Future<Void>>();
+		long records = 0;
+
+		try {
+			for (int i = 0; i < threads; i++) {
+				workers.add(pool.submit(() -> {
+					try {
+						int id;
+
+						while (!stopped.get() && (id = next.getAndIncrement()) < ExpireBinCleaner.PARTITIONS) {
+							client.scanPartitions(policy, PartitionFilter.id(id), namespace, set, new ScanCallback() {
+								public void scanCallback(Key key, Record record) throws AerospikeException {
+									Record live = ExpireBin.liveRecord(record, ExpireBin.now());
+
+									if (live != null && !offer(queue, new KeyRecord(key, live), stopped)) {
+										throw new AerospikeException.ScanTerminated();
+									}
+								}
+							}, binNames);
+						}
+					} catch (RuntimeException re) {
+						// Stop the other workers too.
+						stopped.set(true);
+						throw re;
+					} finally {
+						offer(queue, END, closed);
+					}
+					return null;
+				}));
+			}
+
+			int ended = 0;
+
+			while (ended < threads) {
+				KeyRecord kr = queue.take();
+
+				if (kr == END) {
+					ended++;
+					continue;
+				}
+
+				records++;
+
+				if (!handler.onRecord(kr.key, kr.record)) {
+					break;
+				}
+			}
+		} finally {
+			stopped.set(true);
+			closed.set(true);
+			pool.shutdown();
+			pool.awaitTermination(1, TimeUnit.MINUTES);
+		}
+
+		for (Future<Void> worker : workers) {
+			try {
+				worker.get();
+			} catch (ExecutionException ee) {
+				if (ee.getCause() instanceof AerospikeException.ScanTerminated) {
+					continue;
+				}
+				if (ee.getCause() instanceof AerospikeException) {
+					throw (AerospikeException) ee.getCause();
+				}
+				throw new AerospikeException(ee.getCause());
+			}
+		}
+		return records;
+	}
+
+	/**
+	 * Wait for room in the queue until cancel is set. Scan callbacks may run on
+	 * the client's own threads, so they are never interrupted.
+	 */
+	private static boolean offer(BlockingQueue<KeyRecord> queue, KeyRecord kr, AtomicBoolean cancel) {
+		try {
+			while (!queue.offer(kr, 100, TimeUnit.MILLISECONDS)) {
+				if (cancel.get()) {
+					return false;
+				}
+			}
+			return true;
+		} catch (InterruptedException ie) {
+			Thread.currentThread().interrupt();
+			return false;
+		}
+	}
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2012-2015 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements WHICH ARE COMPATIBLE WITH THE APACHE LICENSE, VERSION 2.0.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+import java.util.concurrent.atomic.AtomicLongArray;
+
+/**
+ * ExpireBin.Listener keeping a latency histogram and outcome counters per call.
+ * Recording never locks or allocates, so it can be left on in production:
+ *
+ * <pre>
+ * ExpireBinStats stats = new ExpireBinStats();
+ * eb.setListener(stats);
+ * ...
+ * System.out.println(stats);
+ * </pre>
+ */
+public class ExpireBinStats implements ExpireBin.Listener {
+	// Latency histogram in microseconds. Values below SUB are exact, above that
+	// each power of two is split in SUB buckets, within about 6% of the value.
+	private static final int SUB_BITS = 4;
+	private static final int SUB = 1 << SUB_BITS;
+	private static final int BUCKETS = 64 * SUB;
+
+	private static final int OPS = ExpireBin.Op.values().length;
+	private static final int OUTCOMES = ExpireBin.Outcome.values().length;
+
+	private final AtomicLongArray counts = new AtomicLongArray(OPS * BUCKETS);
+	private final AtomicLongArray calls = new AtomicLongArray(OPS);
+	private final AtomicLongArray maxMicros = new AtomicLongArray(OPS);
+	private final AtomicLongArray outcomes = new AtomicLongArray(OPS * OUTCOMES);
+
+	@Override
+	public void onLatency(ExpireBin.Op op, long nanos) {
+		int o = op.ordinal();
+		long micros = nanos / 1000;
+
+		counts.incrementAndGet(o * BUCKETS + index(micros));
+		calls.incrementAndGet(o);
+
+		long max = maxMicros.get(o);
+
+		while (micros > max && !maxMicros.compareAndSet(o, max, micros)) {
+			max = maxMicros.get(o);
+		}
+	}
+
+	@Override
+	public void onOutcome(ExpireBin.Op op, ExpireBin.Outcome outcome, int count) {
+		outcomes.addAndGet(op.ordinal() * OUTCOMES + outcome.ordinal(), count);
+	}
+
+	/**
+	 * Number of calls recorded for an op.
+	 */
+	public long count(ExpireBin.Op op) {
+		return calls.get(op.ordinal());
+	}
+
+	/**
+	 * Latency percentile of an op in microseconds, within about 6%.
+	 *
+	 * @param op  - The call.
+	 * @param pct - Percentile, e.g. 99.9.
+	 */
+	public long percentile(ExpireBin.Op op, double pct) {
+		int o = op.ordinal();
+		long target = Math.max(1, Math.round(calls.get(o) * pct / 100.0));
+		long seen = 0;
+
+		for (int i = 0; i < BUCKETS; i++) {
+			seen += counts.get(o * BUCKETS + i);
+
+			if (seen >= target) {
+				return value(i);
+			}
+		}
+		return maxMicros.get(o);
+	}
+
+	/**
+	 * Highest latency of an op in microseconds.
+	 */
+	public long max(ExpireBin.Op op) {
+		return maxMicros.get(op.ordinal());
+	}
+
+	/**
+	 * Total count of an outcome of an op.
+	 */
+	public long outcomes(ExpireBin.Op op, ExpireBin.Outcome outcome) {
+		return outcomes.get(op.ordinal() * OUTCOMES + outcome.ordinal());
+	}
+
+	/**
+	 * Clear every histogram and counter. Calls recorded meanwhile may be partly lost.
+	 */
+	public void reset() {
+		for (int i = 0; i < counts.length(); i++) {
+			counts.set(i, 0);
+		}
+		for (int i = 0; i < OPS; i++) {
+			calls.set(i, 0);
+			maxMicros.set(i, 0);
+		}
+		for (int i = 0; i < outcomes.length(); i++) {
+			outcomes.set(i, 0);
+		}
+	}
+
+	/**
+	 * One line per op that was called, with its latencies and outcomes.
+	 */
+	@Override
+	public String toString() {
+		StringBuilder sb = new StringBuilder();
+
+		for (ExpireBin.Op op : ExpireBin.Op.values()) {
+			long n = count(op);
+
+			if (n == 0) {
+				continue;
+			}
+
+			sb.append(String.format("%-12s %8d calls p50 %d us p99 %d us p999 %d us max %d us", op.name().toLowerCase(), n,
+				percentile(op, 50), percentile(op, 99), percentile(op, 99.9), max(op)));
+
+			for (ExpireBin.Outcome outcome : ExpireBin.Outcome.values()) {
+				long c = outcomes(op, outcome);
+
+				if (c != 0) {
+					sb.append(' ').append(outcome.name().toLowerCase()).append(' ').append(c);
+				}
+			}
+			sb.append('\n');
+		}
+		return sb.toString();
+	}
+
+	private static int index(long micros) {
+		if (micros < SUB) {
+			return (int) micros;
+		}
+
+		int msb = 63 - Long.numberOfLeadingZeros(micros);
+		int sub = (int) (micros >>> (msb - SUB_BITS)) & (SUB - 1);
+		return (msb - SUB_BITS + 1) * SUB + sub;
+	}
+
+	// Midpoint of the values falling into a bucket.
+	private static long value(int index) {
+		int group = index / SUB;
+		int sub = index % SUB;
+
+		if (group == 0) {
+			return sub;
+		}
+
+		int shift = group - 1;
+		return ((long) (SUB + sub) << shift) + ((1L << shift) >> 1);
+	}
+}
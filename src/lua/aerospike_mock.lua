@@ -0,0 +1,231 @@
+-- Copyright 2015 Aerospike, Inc.
+
+-- Licensed under the Apache License, Version 2.0 (the "License");
+-- you may not use this file except in compliance with the License.
+-- You may obtain a copy of the License at
+
+-- http://www.apache.org/licenses/LICENSE-2.0
+
+-- Unless required by applicable law or agreed to in writing, software
+-- distributed under the License is distributed on an "AS IS" BASIS,
+-- WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+-- See the License for the specific language governing permissions and
+-- limitations under the License.
+
+-- =========================================================================
+-- In-process stand-in for the server side UDF environment
+-- =========================================================================
+--
+-- Defines the globals a record UDF sees on the server (map, list, record,
+-- aerospike and the log functions) well enough to run expire_bin.lua under
+-- a plain Lua 5.1 or LuaJIT interpreter. Records live in a Lua table, maps
+-- and lists are userdata like on the server so that their metatables can
+-- be told apart, and log calls are dropped after their arguments have been
+-- evaluated, as with the server log level above debug.
+--
+-- USAGE:
+-- local mock = dofile("src/lua/aerospike_mock.lua");
+-- local eb = dofile("expire_bin.lua");
+-- eb.put(mock.rec("key"), "bin", 1, 100);
+
+local mock = {};
+
+-- Committed records: key -> {bins = {...}, ttl = seconds}
+local store = {};
+
+-- Number of record writes, for checking that a call wrote or not
+mock.writes = 0;
+
+-- TTL given to records created without one
+mock.default_ttl = 86400;
+
+-- =========================================================================
+-- Maps and lists
+-- =========================================================================
+local data = setmetatable({}, {__mode = "k"});
+
+local map_proto = newproxy(true);
+local MapMT = getmetatable(map_proto);
+MapMT.__index = function(m, k) return data[m][k] end
+MapMT.__newindex = function(m, k, v) data[m][k] = v end
+MapMT.__tostring = function(m)
+	local t = {};
+	for k, v in pairs(data[m]) do
+		t[#t+1] = tostring(k) .. "=" .. tostring(v);
+	end
+	return "{" .. table.concat(t, ", ") .. "}";
+end
+
+map = setmetatable({}, {__call = function(_, init)
+	local m = newproxy(map_proto);
+	data[m] = {};
+	if init then
+		for k, v in pairs(init) do
+			data[m][k] = v;
+		end
+	end
+	return m;
+end});
+map.size = function(m)
+	local n = 0;
+	for _ in pairs(data[m]) do
+		n = n + 1;
+	end
+	return n;
+end
+map.pairs = function(m) return pairs(data[m]) end
+
+local list_proto = newproxy(true);
+local ListMT = getmetatable(list_proto);
+ListMT.__index = function(l, i) return data[l][i] end
+ListMT.__newindex = function(l, i, v) data[l][i] = v end
+ListMT.__tostring = function(l)
+	local t = {};
+	for i = 1, data[l].n do
+		t[#t+1] = tostring(data[l][i]);
+	end
+	return "[" .. table.concat(t, ", ") .. "]";
+end
+
+list = setmetatable({}, {__call = function(_, init)
+	local l = newproxy(list_proto);
+	data[l] = {n = 0};
+	if init then
+		for i = 1, #init do
+			data[l][i] = init[i];
+		end
+		data[l].n = #init;
+	end
+	return l;
+end});
+list.size = function(l) return data[l].n end
+list.append = function(l, v)
+	local d = data[l];
+	d.n = d.n + 1;
+	d[d.n] = v;
+end
+list.insert = function(l, pos, v)
+	local d = data[l];
+	table.insert(d, pos, v);
+	d.n = d.n + 1;
+end
+list.remove = function(l, pos)
+	local d = data[l];
+	table.remove(d, pos);
+	d.n = d.n - 1;
+end
+-- A new list without the first n elements of l
+list.drop = function(l, n)
+	local d = data[l];
+	local t = {};
+	for i = n + 1, d.n do
+		t[#t+1] = d[i];
+	end
+	return list(t);
+end
+list.iterator = function(l)
+	local i = 0;
+	return function()
+		i = i + 1;
+		if i <= data[l].n then
+			return data[l][i];
+		end
+	end
+end
+
+-- =========================================================================
+-- Records
+-- =========================================================================
+local RecMT = {
+	__index = function(r, bin) return rawget(r, "_bins")[bin] end,
+	__newindex = function(r, bin, v) rawget(r, "_bins")[bin] = v end,
+	__tostring = function(r)
+		local t = {};
+		for k, v in pairs(rawget(r, "_bins")) do
+			t[#t+1] = tostring(k) .. "=" .. tostring(v);
+		end
+		return "rec{" .. table.concat(t, ", ") .. "}";
+	end
+};
+
+local function commit(r)
+	local s = store[rawget(r, "_key")];
+	s.bins = {};
+	for k, v in pairs(rawget(r, "_bins")) do
+		s.bins[k] = v;
+	end
+	local ttl = rawget(r, "_ttl");
+	if ttl then
+		s.ttl = ttl;
+		rawset(r, "_ttl", nil);
+	end
+	mock.writes = mock.writes + 1;
+	return 0;
+end
+
+record = {};
+record.ttl = function(r)
+	local s = store[rawget(r, "_key")];
+	return s and s.ttl or 0;
+end
+record.set_ttl = function(r, ttl) rawset(r, "_ttl", ttl) end
+record.bin_names = function(r)
+	local t = {};
+	for k in pairs(rawget(r, "_bins")) do
+		t[#t+1] = k;
+	end
+	return t;
+end
+
+aerospike = {};
+function aerospike:exists(r) return store[rawget(r, "_key")] ~= nil end
+function aerospike:update(r) return commit(r) end
+function aerospike:create(r)
+	store[rawget(r, "_key")] = {bins = {}, ttl = mock.default_ttl};
+	return commit(r);
+end
+function aerospike:remove(r)
+	store[rawget(r, "_key")] = nil;
+	mock.writes = mock.writes + 1;
+	return 0;
+end
+
+-- =========================================================================
+-- Logging
+-- =========================================================================
+function debug(...) end
+function trace(...) end
+function info(...) end
+function warn(...) end
+
+-- =========================================================================
+-- Helpers
+-- =========================================================================
+
+-- Open the record of a key, as the server does for each UDF call
+function mock.rec(key)
+	local r = setmetatable({}, RecMT);
+	rawset(r, "_key", key);
+	rawset(r, "_bins", {});
+	local s = store[key];
+	if s then
+		for k, v in pairs(s.bins) do
+			rawget(r, "_bins")[k] = v;
+		end
+	end
+	return r;
+end
+
+-- Committed bins of a key, nil if the record doesn't exist
+function mock.stored(key)
+	local s = store[key];
+	return s and s.bins;
+end
+
+-- Remove every record
+function mock.reset()
+	store = {};
+	mock.writes = 0;
+end
+
+return mock;
@@ -0,0 +1,105 @@
+-- Copyright 2015 Aerospike, Inc.
+
+-- Licensed under the Apache License, Version 2.0 (the "License");
+-- you may not use this file except in compliance with the License.
+-- You may obtain a copy of the License at
+
+-- http://www.apache.org/licenses/LICENSE-2.0
+
+-- Unless required by applicable law or agreed to in writing, software
+-- distributed under the License is distributed on an "AS IS" BASIS,
+-- WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+-- See the License for the specific language governing permissions and
+-- limitations under the License.
+
+-- =========================================================================
+-- Expire Bin UDF Benchmark
+-- =========================================================================
+--
+-- Times each function of expire_bin.lua in isolation, in process, against
+-- the stand-in server environment of aerospike_mock.lua. Only the Lua side
+-- is measured: no record storage, serialization or network.
+--
+-- USAGE (from the repository root, with Lua 5.1 or LuaJIT):
+-- lua src/lua/benchmark.lua [module] [calls] [keys] [bins] [value_entries]
+--
+-- (*) module: UDF file to load, default expire_bin.lua
+-- (*) calls: calls per function, default 100000
+-- (*) keys: number of records, default 1000
+-- (*) bins: expire bins per record, default 8
+-- (*) value_entries: bin values are maps of this many entries, or integers
+--     if 0, default 0
+
+local module_path = arg[1] or "expire_bin.lua";
+local calls = tonumber(arg[2]) or 100000;
+local n_keys = tonumber(arg[3]) or 1000;
+local n_bins = tonumber(arg[4]) or 8;
+local value_entries = tonumber(arg[5]) or 0;
+
+local script_dir = (arg[0]:match("^(.*)/") or ".") .. "/";
+local mock = dofile(script_dir .. "aerospike_mock.lua");
+local eb = dofile(module_path);
+
+local bins = {};
+for i = 1, n_bins do
+	bins[i] = "bin" .. i;
+end
+
+local function value(i)
+	if (value_entries == 0) then
+		return i;
+	end
+	local m = map();
+	for j = 1, value_entries do
+		m["field" .. j] = i + j;
+	end
+	return m;
+end
+
+local function bin_maps(with_val, bin_ttl)
+	local ops = {};
+	for i = 1, n_bins do
+		ops[i] = map{bin = bins[i], val = with_val and value(i) or nil, bin_ttl = bin_ttl};
+	end
+	return ops;
+end
+
+-- Write every bin of every record, each expiring in an hour
+local function prefill()
+	mock.reset();
+	local ops = bin_maps(true, 3600);
+	for k = 1, n_keys do
+		eb.puts(mock.rec(k), unpack(ops));
+	end
+end
+
+-- Each case calls one function on record k
+local cases = {
+	{"get", function(k) return eb.get(mock.rec(k), unpack(bins)) end},
+	{"get_repair", function(k) return eb.get_repair(mock.rec(k), 60, unpack(bins)) end},
+	{"put", function(k) return eb.put(mock.rec(k), bins[k % n_bins + 1], value(k), 3600) end},
+	{"puts", function(k) return eb.puts(mock.rec(k), unpack(bin_maps(true, 3600))) end},
+	{"touch", function(k) return eb.touch(mock.rec(k), unpack(bin_maps(false, 3600))) end},
+	{"touch_bins", function(k) return eb.touch_bins(mock.rec(k), unpack(bin_maps(false, 3600))) end},
+	{"ttl", function(k) return eb.ttl(mock.rec(k), bins[k % n_bins + 1]) end},
+	{"clean", function(k) return eb.clean(mock.rec(k), unpack(bins)) end},
+	{"clean_all", function(k) return eb.clean_all(mock.rec(k)) end},
+};
+
+print(string.format("%s: %d calls, %d keys x %d bins, values %s", module_path, calls, n_keys, n_bins,
+	value_entries == 0 and "integers" or ("maps of " .. value_entries)));
+print(string.format("%-12s %10s %12s %8s", "function", "us/call", "calls/s", "writes"));
+
+for _, case in ipairs(cases) do
+	local name, fn = case[1], case[2];
+	if (eb[name] ~= nil) then
+		prefill();
+		mock.writes = 0;
+		local begin = os.clock();
+		for i = 1, calls do
+			fn(i % n_keys + 1);
+		end
+		local elapsed = os.clock() - begin;
+		print(string.format("%-12s %10.2f %12.0f %8d", name, elapsed * 1e6 / calls, calls / elapsed, mock.writes));
+	end
+end
@@ -0,0 +1,89 @@
+-- Copyright 2015 Aerospike, Inc.
+
+-- Licensed under the Apache License, Version 2.0 (the "License");
+-- you may not use this file except in compliance with the License.
+-- You may obtain a copy of the License at
+
+-- http://www.apache.org/licenses/LICENSE-2.0
+
+-- Unless required by applicable law or agreed to in writing, software
+-- distributed under the License is distributed on an "AS IS" BASIS,
+-- WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+-- See the License for the specific language governing permissions and
+-- limitations under the License.
+
+-- =========================================================================
+-- Expire Bin UDF Build
+-- =========================================================================
+--
+-- Generates the two variants of the module from expire_bin.lua:
+--
+-- (*) target_dir/expire_bin.lua: production. Every "GP=F and debug(...)"
+--     line is blanked, so no debug message or tostring() of a record or
+--     map is ever built.
+-- (*) target_dir/debug/expire_bin.lua: debug. Logging starts on and can be
+--     turned off and on again with set_debug().
+--
+-- Lines are blanked rather than removed so that line numbers in server
+-- errors match the source. Register one of the two under the module name
+-- expire_bin.
+--
+-- USAGE (from the repository root, with Lua 5.1 or LuaJIT):
+-- lua src/lua/build.lua [source] [target_dir]
+--
+-- (*) source: default expire_bin.lua
+-- (*) target_dir: default target/udf
+
+local source = arg[1] or "expire_bin.lua";
+local target_dir = arg[2] or "target/udf";
+
+local DEBUG_CALL = "^%s*GP=F and debug%(.*%);%s*$";
+local DEBUG_FLAG = "local F = false;";
+
+local function read_lines(path)
+	local f = assert(io.open(path, "r"));
+	local lines = {};
+	for line in f:lines() do
+		lines[#lines+1] = line;
+	end
+	f:close();
+	return lines;
+end
+
+local function write_lines(path, lines, variant)
+	local f = assert(io.open(path, "w"));
+	f:write(table.concat(lines, "\n"), "\n");
+	f:write("-- Generated from ", source, " by src/lua/build.lua (", variant, ")\n");
+	f:close();
+	print("Wrote " .. path);
+end
+
+local lines = read_lines(source);
+local prod, dbg = {}, {};
+local n_calls, n_flags = 0, 0;
+
+for i, line in ipairs(lines) do
+	prod[i], dbg[i] = line, line;
+	if (line:find(DEBUG_CALL)) then
+		prod[i] = "";
+		n_calls = n_calls + 1;
+	elseif (line:find("GP=F", 1, true) and not line:find("^%s*%-%-")) then
+		error(string.format("%s:%d: debug call must be on a line of its own", source, i));
+	elseif (line == DEBUG_FLAG) then
+		dbg[i] = "local F = true;";
+		n_flags = n_flags + 1;
+	end
+end
+
+if (n_flags ~= 1) then
+	error(string.format("%s: expected one '%s' line, found %d", source, DEBUG_FLAG, n_flags));
+end
+
+-- Neither variant may fail to load on the server
+assert(loadstring(table.concat(prod, "\n"), "=" .. source));
+assert(loadstring(table.concat(dbg, "\n"), "=" .. source));
+
+assert(os.execute(string.format("mkdir -p '%s/debug'", target_dir)));
+write_lines(target_dir .. "/expire_bin.lua", prod, "production");
+write_lines(target_dir .. "/debug/expire_bin.lua", dbg, "debug");
+print(string.format("Stripped %d debug calls", n_calls));
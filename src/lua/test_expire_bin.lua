@@ -0,0 +1,218 @@
+-- Copyright 2015 Aerospike, Inc.
+
+-- Licensed under the Apache License, Version 2.0 (the "License");
+-- you may not use this file except in compliance with the License.
+-- You may obtain a copy of the License at
+
+-- http://www.apache.org/licenses/LICENSE-2.0
+
+-- Unless required by applicable law or agreed to in writing, software
+-- distributed under the License is distributed on an "AS IS" BASIS,
+-- WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+-- See the License for the specific language governing permissions and
+-- limitations under the License.
+
+-- =========================================================================
+-- Expire Bin UDF Tests
+-- =========================================================================
+--
+-- Checks the guarantees of expire_bin.lua that a client can't easily see,
+-- in process, against the stand-in server environment of
+-- aerospike_mock.lua. The clock is replaced so that bins can be expired
+-- without waiting.
+--
+-- USAGE (from the repository root, with Lua 5.1 or LuaJIT):
+-- lua src/lua/test_expire_bin.lua [module]
+--
+-- (*) module: UDF file to test, default expire_bin.lua
+--
+-- Exits with status 1 if a test fails.
+
+local module_path = arg[1] or "expire_bin.lua";
+
+local script_dir = (arg[0]:match("^(.*)/") or ".") .. "/";
+local mock = dofile(script_dir .. "aerospike_mock.lua");
+
+-- Unix time seen by the module
+local now = 1600000000;
+os.time = function() return now end
+
+-- Load the module, with the settings in the table settings (name -> value
+-- source) replaced
+local function load_module(settings)
+	local f = assert(io.open(module_path));
+	local src = f:read("*a");
+	f:close();
+	for name, value in pairs(settings or {}) do
+		local n;
+		src, n = src:gsub("local " .. name .. " = [^;]*;", "local " .. name .. " = " .. value .. ";");
+		assert(n == 1, name .. " not found in " .. module_path);
+	end
+	return assert(loadstring(src, "@" .. module_path))();
+end
+
+local eb = load_module();
+
+local function record_ttl(key)
+	return record.ttl(mock.rec(key));
+end
+
+-- Keys of the entries of an element bin, in stored order
+local function elem_keys(key, bin)
+	local t = {};
+	for entry in list.iterator(mock.stored(key)[bin][2]) do
+		t[#t+1] = entry[2];
+	end
+	return table.concat(t, ",");
+end
+
+local tests = {};
+
+-- A rejected bin keeps every bin of puts from being written
+tests[#tests+1] = {"puts all or none", function()
+	assert(eb.put(mock.rec("k"), "x", 1, 50) == 0);
+	assert(eb.puts(mock.rec("k"), map{bin = "y", val = 2, bin_ttl = 50},
+		map{bin = "z", val = 3, bin_ttl = 500}) == 1);
+	local bins = mock.stored("k");
+	assert(bins.y == nil and bins.z == nil);
+	assert(eb.puts(mock.rec("k"), map{bin = "y", val = 2, bin_ttl = 50},
+		map{bin = "z", val = 3, bin_ttl = 60}) == 0);
+	assert(eb.get(mock.rec("k"), "y", "z").z == 3);
+end};
+
+-- A rejected bin keeps every bin of touch from being changed
+tests[#tests+1] = {"touch all or none", function()
+	assert(eb.puts(mock.rec("k"), map{bin = "x", val = 1, bin_ttl = 50},
+		map{bin = "y", val = 2, bin_ttl = 50}) == 0);
+	local writes = mock.writes;
+	assert(eb.touch(mock.rec("k"), map{bin = "x", bin_ttl = 80},
+		map{bin = "y", bin_ttl = 500}) == 1);
+	assert(mock.writes == writes);
+	assert(eb.ttl(mock.rec("k"), "x") == 50);
+	assert(eb.touch(mock.rec("k"), map{bin = "x", bin_ttl = 80},
+		map{bin = "y", bin_ttl = 90}) == 0);
+	assert(eb.ttl(mock.rec("k"), "x") == 80 and eb.ttl(mock.rec("k"), "y") == 90);
+end};
+
+-- clean only writes the record when it removes something
+tests[#tests+1] = {"clean writes only on change", function()
+	assert(eb.puts(mock.rec("k"), map{bin = "x", val = 1, bin_ttl = 10},
+		map{bin = "y", val = 2, bin_ttl = 50}) == 0);
+	local writes = mock.writes;
+	assert(eb.clean(mock.rec("k"), "x", "y") == 0);
+	assert(eb.clean_all(mock.rec("k")) == 0);
+	assert(mock.writes == writes);
+	now = now + 20;
+	assert(eb.clean(mock.rec("k"), "x", "y") == 1);
+	assert(mock.writes == writes + 1);
+	assert(mock.stored("k").x == nil and mock.stored("k").y ~= nil);
+	assert(eb.clean(mock.rec("k"), "x", "y") == 0);
+	assert(mock.writes == writes + 1);
+end};
+
+-- A record that never expires takes any bin TTL, like it does through the
+-- expression writes of the clients
+tests[#tests+1] = {"never expiring record", function()
+	mock.default_ttl = 0;
+	assert(eb.put(mock.rec("k"), "x", 1, 50) == 0);
+	assert(record_ttl("k") == 0);
+	assert(eb.put(mock.rec("k"), "y", 2, 5000) == 0);
+	assert(eb.touch(mock.rec("k"), map{bin = "x", bin_ttl = 9000}) == 0);
+	assert(eb.ttl(mock.rec("k"), "x") == 9000);
+end};
+
+-- TTL_EXTEND raises the record TTL to cover the bins written
+tests[#tests+1] = {"ttl mode extend", function()
+	local ext = load_module{TTL_MODE = "TTL_EXTEND"};
+	assert(ext.put(mock.rec("k"), "x", 1, 50) == 0);
+	assert(ext.put(mock.rec("k"), "y", 1, 5000) == 0);
+	assert(record_ttl("k") == 5000);
+	assert(ext.put(mock.rec("k"), "x", 1, 100) == 0);
+	assert(record_ttl("k") == 5000);
+	assert(ext.touch(mock.rec("k"), map{bin = "x", bin_ttl = 9000}) == 0);
+	assert(record_ttl("k") == 9000);
+	assert(ext.put(mock.rec("k"), "z", 1, -1) == 0);
+	assert(record_ttl("k") == -1);
+end};
+
+-- TTL_SHRINK sets the record TTL to the latest bin expiry, unless the
+-- record also holds normal bins
+tests[#tests+1] = {"ttl mode shrink", function()
+	local shr = load_module{TTL_MODE = "TTL_SHRINK"};
+	assert(shr.put(mock.rec("k"), "x", 1, 5000) == 0);
+	assert(record_ttl("k") == 5000);
+	assert(shr.puts(mock.rec("k"), map{bin = "x", val = 1, bin_ttl = 50},
+		map{bin = "y", val = 2, bin_ttl = 70}) == 0);
+	assert(record_ttl("k") == 70);
+	assert(shr.touch_bins(mock.rec("k"), map{bin = "y", bin_ttl = 10}).y == 0);
+	assert(record_ttl("k") == 50);
+	assert(shr.puts(mock.rec("k"), map{bin = "n", val = 3}) == 0);
+	assert(shr.put(mock.rec("k"), "x", 1, 20) == 0);
+	assert(record_ttl("k") == 50);
+end};
+
+-- Elements are kept sorted by expiry, those that never expire last, and
+-- trim drops the expired ones along with their share of the summary
+tests[#tests+1] = {"element order and trim", function()
+	assert(eb.put_elem(mock.rec("k"), "e", "a", 1, 30) == 0);
+	assert(eb.put_elem(mock.rec("k"), "e", "b", 2, -1) == 0);
+	assert(eb.put_elem(mock.rec("k"), "e", "c", 3, 10) == 0);
+	assert(eb.put_elem(mock.rec("k"), "e", "d", 4, 20) == 0);
+	assert(elem_keys("k", "e") == "c,d,a,b", elem_keys("k", "e"));
+	assert(eb.put_elem(mock.rec("k"), "e", "c", 5, 40) == 0);
+	assert(elem_keys("k", "e") == "d,a,c,b", elem_keys("k", "e"));
+	now = now + 25;
+	local elems = eb.get_elems(mock.rec("k"), "e");
+	assert(elems.d == nil and elems.a == 1 and elems.c == 5 and elems.b == 2);
+	assert(eb.trim(mock.rec("k"), "e") == 1);
+	assert(elem_keys("k", "e") == "a,c,b");
+	assert(eb.trim(mock.rec("k"), "e") == 0);
+	assert(eb.put_elem(mock.rec("k"), "f", "a", 1, 10) == 0);
+	assert(mock.stored("k").expbin_meta[2] == 2);
+	now = now + 100;
+	assert(eb.trim(mock.rec("k"), "e", "f") == 3);
+	assert(elem_keys("k", "e") == "b");
+	assert(mock.stored("k").f == nil);
+	assert(mock.stored("k").expbin_meta[1] == 0 and mock.stored("k").expbin_meta[2] == 1);
+end};
+
+-- Like an expire bin, an element bin isn't turned into a normal bin by a
+-- put without bin_ttl
+tests[#tests+1] = {"element bin kept by put", function()
+	assert(eb.put_elem(mock.rec("k"), "e", "a", 1, 30) == 0);
+	local meta = mock.stored("k").expbin_meta;
+	assert(eb.put(mock.rec("k"), "e", 5, nil) == 1);
+	assert(eb.get_elems(mock.rec("k"), "e").a == 1);
+	assert(mock.stored("k").expbin_meta[1] == meta[1] and mock.stored("k").expbin_meta[2] == 1);
+end};
+
+-- put adds the expiry bucket to a record whose bins so far never expire,
+-- which the expression writes of the clients leave to it
+tests[#tests+1] = {"expiry bucket of a record that never expired", function()
+	local due = load_module{DUE_BUCKET = "60"};
+	assert(due.put(mock.rec("k"), "x", 1, -1) == 0);
+	assert(mock.stored("k").expbin_meta[1] == 0 and mock.stored("k").expbin_due == nil);
+	assert(due.put(mock.rec("k"), "y", 2, 50) == 0);
+	local earliest = mock.stored("k").expbin_meta[1];
+	local bucket = mock.stored("k").expbin_due;
+	assert(earliest ~= 0 and bucket ~= nil);
+	assert(bucket % 60 == 0 and bucket >= earliest and bucket - earliest < 60);
+end};
+
+local failed = 0;
+for i = 1, #tests do
+	local name, fn = tests[i][1], tests[i][2];
+	mock.reset();
+	mock.default_ttl = 100;
+	local ok, err = pcall(fn);
+	if ok then
+		print(string.format("ok      %s", name));
+	else
+		failed = failed + 1;
+		print(string.format("FAILED  %s: %s", name, tostring(err)));
+	end
+end
+print(string.format("%d of %d tests passed", #tests - failed, #tests));
+if (failed > 0) then
+	os.exit(1);
+end
@@ -1,4 +1,4 @@
-#!/usr/bin/env python
+#!/usr/bin/env python3
 
 # Copyright 2014 Aerospike, Inc
 
@@ -15,17 +15,143 @@
 # limitations under the License.
 
 import aerospike
+from aerospike import exception as ex
+from aerospike import predicates as p
+from aerospike_helpers import expressions as exp
+from aerospike_helpers.batch import records as batch_records
+from aerospike_helpers.operations import expression_operations as expr_ops
+from concurrent.futures import ThreadPoolExecutor
+import asyncio
+import functools
+import itertools
+import os
+import threading
 import time
 
 MODULE_NAME = "expire_bin"
 GET_OP = "get"
+GET_REPAIR_OP = "get_repair"
 PUT_OP = "put"
 BATCH_PUT_OP = "puts"
 TTL_OP = "ttl"
 TOUCH_OP = "touch"
+TOUCH_BINS_OP = "touch_bins"
 CLEAN_OP = "clean"
+CLEAN_ALL_OP = "clean_all"
+PUT_ELEM_OP = "put_elem"
+GET_ELEMS_OP = "get_elems"
+TRIM_OP = "trim"
 CITRUSLEAF_EPOCH = 1262304000
 
+# Stored expbin format, see expire_bin.lua
+EXP_TAG = -25
+EXP_ELEM_TAG = -26
+EXP_ID = "expbin_ttl"
+EXP_DATA = "data"
+EXP_META = "expbin_meta"
+EXP_DUE = "expbin_due"
+
+# Name of the secondary index created by create_due_index
+DUE_INDEX = "expbin_due_idx"
+
+# Server particle types returned by the BinType expression
+PARTICLE_INTEGER = 1
+PARTICLE_MAP = 19
+PARTICLE_LIST = 20
+
+# Per-key status returned by get_many
+AEROSPIKE_OK = 0
+AEROSPIKE_ERR_RECORD_NOT_FOUND = 2
+
+# Number of partitions of a namespace, cleaned one at a time by clean_partitions
+PARTITIONS = 4096
+
+# Per-bin status returned by touch_bins
+TOUCH_UPDATED = 0
+TOUCH_INVALID_TTL = 1
+TOUCH_NOT_EXPBIN = 2
+
+def _server_now():
+	"""Expression for the server time in seconds since the Citrusleaf epoch"""
+	now_millis = exp.Add(exp.Div(exp.LastUpdateTime(), 1000000), exp.SinceUpdateTime())
+	return exp.Sub(exp.Div(now_millis, 1000), CITRUSLEAF_EPOCH)
+
+def _is_live(expiry):
+	"""Expression that is true if expiry is 0 (no expiration) or not yet reached"""
+	return exp.Or(exp.Eq(expiry, 0), exp.LE(_server_now(), expiry))
+
+def _min_expiry(a, b):
+	"""Expression for the earliest of two expiries, where 0 means no expiration"""
+	return exp.Cond(exp.Eq(a, 0), b, exp.Eq(b, 0), a, exp.Min(a, b))
+
+def _expiry(bin_ttl):
+	"""Expression for the expiry of a bin written now with bin_ttl"""
+	if bin_ttl == -1:
+		return 0
+	return exp.Add(_server_now(), bin_ttl)
+
+def _is_expbin(bin):
+	"""Expression that is true if the bin is an expbin in either format. Never
+	evaluates to unknown."""
+	head = exp.ListGetByIndexRange(None, aerospike.LIST_RETURN_VALUE, 0, 1, exp.ListBin(bin))
+	return exp.Cond(
+		exp.Eq(exp.BinType(bin), PARTICLE_LIST),
+		exp.And(
+			exp.Eq(exp.ListSize(None, exp.ListBin(bin)), 3),
+			exp.Eq(exp.ListGetByValue(None, aerospike.LIST_RETURN_COUNT, EXP_TAG, head), 1)),
+		exp.Eq(exp.BinType(bin), PARTICLE_MAP),
+		exp.GT(exp.MapGetByKey(None, aerospike.MAP_RETURN_COUNT, exp.ResultType.INTEGER, EXP_ID, exp.MapBin(bin)), 0),
+		False)
+
+def _is_elembin(bin):
+	"""Expression that is true if the bin is an element bin. Never evaluates
+	to unknown."""
+	head = exp.ListGetByIndexRange(None, aerospike.LIST_RETURN_VALUE, 0, 1, exp.ListBin(bin))
+	return exp.Cond(
+		exp.Eq(exp.BinType(bin), PARTICLE_LIST),
+		exp.And(
+			exp.Eq(exp.ListSize(None, exp.ListBin(bin)), 2),
+			exp.Eq(exp.ListGetByValue(None, aerospike.LIST_RETURN_COUNT, EXP_ELEM_TAG, head), 1)),
+		False)
+
+def _is_clean_due():
+	"""Expression that is true if the record may hold expired bins, going by
+	its expiry summary. Records without a summary are always due."""
+	earliest = exp.ListGetByIndex(None, aerospike.LIST_RETURN_VALUE, exp.ResultType.INTEGER, 0, exp.ListBin(EXP_META))
+	return exp.Cond(
+		exp.Eq(exp.BinType(EXP_META), PARTICLE_LIST),
+		exp.And(exp.NE(earliest, 0), exp.LT(earliest, _server_now())),
+		True)
+
+def _load_checkpoint(path):
+	"""Set of partitions finished by earlier runs"""
+	if not path or not os.path.exists(path):
+		return set()
+	with open(path) as f:
+		lines = f.read().split("\n")
+	# The last line is either empty or was cut short by a crash.
+	return set(int(line) for line in lines[:-1] if line.strip().isdigit() and int(line) < PARTITIONS)
+
+def _live_list_exp(bin):
+	"""Expression for the whole bin if it is a live expbin [EXP_TAG, expiry, data]"""
+	tag = exp.ListGetByIndex(None, aerospike.LIST_RETURN_VALUE, exp.ResultType.INTEGER, 0, exp.ListBin(bin))
+	expiry = exp.ListGetByIndex(None, aerospike.LIST_RETURN_VALUE, exp.ResultType.INTEGER, 1, exp.ListBin(bin))
+	return exp.Cond(
+		exp.Eq(exp.BinType(bin), PARTICLE_LIST),
+		exp.Cond(
+			exp.And(exp.Eq(exp.ListSize(None, exp.ListBin(bin)), 3), exp.Eq(tag, EXP_TAG), _is_live(expiry)),
+			exp.ListBin(bin),
+			exp.Unknown()),
+		exp.Unknown())
+
+def _live_map_exp(bin):
+	"""Expression for the whole bin if it is a live expbin in the older map format"""
+	expiry = exp.MapGetByKey(None, aerospike.MAP_RETURN_VALUE, exp.ResultType.INTEGER, EXP_ID, exp.MapBin(bin))
+	return exp.Cond(
+		exp.Eq(exp.BinType(bin), PARTICLE_MAP),
+		exp.Cond(_is_live(expiry), exp.MapBin(bin), exp.Unknown()),
+		exp.Unknown())
+
 class ExpireBin:
 	def __init__(self, client):
 		"""Initialize the ExpireBin module
@@ -38,7 +164,8 @@ class ExpireBin:
 
 	def get(self, policy, key, *bins):
 		"""Attempt to retrieve values from list of bins. The bins
-		can be expire bins or normal bins.
+		can be expire bins, element bins or normal bins. Element bins
+		are read as a dict of their live elements.
 
 		Args:
 			policy -- policy to use for op
@@ -58,10 +185,108 @@ class ExpireBin:
 			raise Exception("Get operation failed, return {0} instead of map".format(type(rv)))
 		return rv
 
+	def get_repair(self, policy, key, repair_interval, *bins):
+		"""Same as get, but if the record may hold expired bins, every
+		expired bin of the record is removed on the way. The record is
+		only written if a bin was removed or its expiry summary was stale,
+		and at most once per repair_interval seconds.
+
+		Args:
+			policy -- policy to use for op
+			key -- tuple (namespace, set, record name)
+			repair_interval -- minimum number of seconds between two repairs of the record
+			*bins -- one or more bin names to retrieve values from
+
+		Returns:
+			record dict: A record with each bin value mapped to the bin name.
+			If the bin value expired or does not exist, there will not
+			be an entry in the dict
+
+		Raises:
+			Exception: Exception with details of server error.
+		"""
+		rv = self.client.apply(key, MODULE_NAME, GET_REPAIR_OP, [repair_interval] + list(bins), policy)
+		if not type(rv) == dict:
+			raise Exception("Get operation failed, return {0} instead of map".format(type(rv)))
+		return rv
+
+	def get_exp(self, policy, key, *bins):
+		"""Attempt to retrieve values from list of expire bins without running
+		the UDF. The expiry of each bin is checked by an expression on the
+		server, against the server clock, and only live values are sent back.
+		Bins written by any version of the module are read. Unlike get, bins
+		that are not expire bins are not returned.
+
+		Args:
+			policy -- operate policy to use for op
+			key -- tuple (namespace, set, record name)
+			*bins -- one or more bin names to retrieve values from
+
+		Returns:
+			record dict: A record with each bin value mapped to the bin name.
+			If the bin value expired or does not exist, there will not
+			be an entry in the dict. None if the record does not exist.
+
+		Raises:
+			Exception: Exception with details of server error.
+		"""
+		# The result names are indexes into bins, so they never clash with each other.
+		ops = []
+		for i, bin in enumerate(bins):
+			ops.append(expr_ops.expression_read("l%d" % i, _live_list_exp(bin).compile(), aerospike.EXP_READ_EVAL_NO_FAIL))
+			ops.append(expr_ops.expression_read("m%d" % i, _live_map_exp(bin).compile(), aerospike.EXP_READ_EVAL_NO_FAIL))
+		try:
+			(_, _, results) = self.client.operate(key, ops, None, policy)
+		except ex.RecordNotFound:
+			return None
+		rv = {}
+		for i, bin in enumerate(bins):
+			list_val = results.get("l%d" % i)
+			map_val = results.get("m%d" % i)
+			if type(list_val) == list:
+				rv[bin] = list_val[2]
+			elif type(map_val) == dict:
+				rv[bin] = map_val.get(EXP_DATA)
+		return rv
+
+	def get_many(self, policy, keys, *bins):
+		"""Attempt to retrieve values from list of bins of many records,
+		with a single batch UDF call that sends one request per server node.
+
+		Args:
+			policy -- batch policy to use for op
+			keys -- list of tuples (namespace, set, record name)
+			*bins -- one or more bin names to retrieve values from
+
+		Returns:
+			list: One tuple (key, status, bins) per key, in the same order as
+			keys. On success, status is AEROSPIKE_OK and bins is a dict as
+			returned by get. If the record does not exist, status is
+			AEROSPIKE_ERR_RECORD_NOT_FOUND and bins is None. Other errors
+			are reported in the status of their key.
+
+		Raises:
+			Exception: Exception with details of server error.
+		"""
+		batch = self.client.batch_apply(list(keys), MODULE_NAME, GET_OP, list(bins), policy)
+		results = []
+		for br in batch.batch_records:
+			status = br.result
+			bins_dict = None
+			if status == AEROSPIKE_OK:
+				rv = br.record[2].get("SUCCESS") if br.record else None
+				if type(rv) == dict:
+					bins_dict = rv
+				else:
+					status = AEROSPIKE_ERR_RECORD_NOT_FOUND
+			results.append((br.key, status, bins_dict))
+		return results
+
 	def put(self, policy, key, bin, val, bin_ttl):
 		"""Create or update expire bins. If bin_ttl is not None,
 		all newly created bins will be expire bins otherwise, only normal bins will be created
-		Note: existing expire bins will not be converted into normal bins if bin_ttl is None.
+		Note: existing expire bins and element bins will not be converted into normal bins
+		if bin_ttl is None.
 
 		Args:
 			policy -- policy to use for op
@@ -78,6 +303,109 @@ class ExpireBin:
 		"""
 		return self.client.apply(key, MODULE_NAME, PUT_OP, [bin, val, bin_ttl], policy)
 
+	def put_exp(self, policy, key, bin, val, bin_ttl, meta=None):
+		"""Create or update an expire bin without running the UDF. The bin and
+		the record's expiry summary are written by expressions in a single
+		operate call, so either both change or neither does. The stored format
+		is the same as put's.
+		The bin_ttl must not exceed the record TTL. If meta sets a ttl,
+		bin_ttl is checked against it. Otherwise it is checked on the server
+		against the TTL of the existing record, which the write then leaves
+		unchanged. The expressions only update existing records: a record
+		that does not exist yet is created through the put UDF instead,
+		which checks bin_ttl against the TTL the record is created with and
+		writes its expiry summary. The put UDF also writes a bin that expires
+		before the expiry bucket of clean_due, or on a record whose summary
+		says none of its bins expire, as only the UDF knows the bucket size,
+		and a bin_ttl of -1 to a record that expires, as the TTL mode of the
+		UDF decides what happens to the record TTL then. The 'exists' policy
+		is ignored.
+
+		Args:
+			policy -- operate policy to use for op
+			key -- tuple (namespace, set, record name)
+			bin -- bin name
+			val -- value to store into bin
+			bin_ttl -- expiration time in seconds or -1 for no expiration
+			meta -- optional dict {'ttl' : record ttl} for the write
+
+		Returns:
+			int: 0 if success, 1 otherwise
+
+		Raises:
+			Exception: Exception with details of server error.
+		"""
+		ttl = (meta or {}).get('ttl', 0)
+		if bin_ttl < -1 or (ttl > 0 and bin_ttl > ttl):
+			return 1
+		if bin_ttl == -1 or ttl > 0 or ttl == -1:
+			# Checked above, or the record never expires
+			ttl_ok = True
+		else:
+			# A record that never expires reports a TTL <= 0
+			ttl_ok = exp.Or(exp.LE(exp.TTL(), 0), exp.LE(bin_ttl, exp.TTL()))
+
+		new_bin = exp.ListSet(None, None, 1, _expiry(bin_ttl), [EXP_TAG, 0, val])
+
+		# The summary is written first, while the bin still holds its old value.
+		# Without a summary the record is left for clean to recompute it.
+		meta_bin = exp.ListBin(EXP_META)
+		earliest = exp.ListGetByIndex(None, aerospike.LIST_RETURN_VALUE, exp.ResultType.INTEGER, 0, meta_bin)
+		count = exp.ListGetByIndex(None, aerospike.LIST_RETURN_VALUE, exp.ResultType.INTEGER, 1, meta_bin)
+		# An expire bin or element bin being overwritten is already counted.
+		counted = exp.Or(_is_expbin(bin), _is_elembin(bin))
+		new_meta = exp.ListSet(None, None, 1, exp.Add(count, exp.Cond(counted, 0, 1)),
+			exp.ListSet(None, None, 0, _min_expiry(earliest, _expiry(bin_ttl)), meta_bin))
+
+		# A bin expiring before the expiry bucket moves it, and a record whose
+		# summary says none of its bins expire has none. Only the put UDF knows
+		# the bucket size, and a bucket moved to the exact expiry would rewrite
+		# the index entry every time.
+		move_due = exp.And(bin_ttl != -1,
+			exp.Cond(exp.Eq(exp.BinType(EXP_DUE), PARTICLE_INTEGER), exp.LT(_expiry(bin_ttl), exp.IntBin(EXP_DUE)),
+				exp.Eq(exp.BinType(EXP_META), PARTICLE_LIST), exp.Eq(earliest, 0),
+				False))
+		# What a bin that never expires does to a record that does depends on
+		# the TTL mode of the put UDF.
+		forever_bin = exp.And(bin_ttl == -1 and ttl != -1, exp.Or(ttl > 0, exp.GT(exp.TTL(), 0)))
+		needs_udf = exp.Or(move_due, forever_bin)
+
+		ops = [
+			expr_ops.expression_write(EXP_META,
+				exp.Cond(exp.Eq(exp.BinType(EXP_META), PARTICLE_LIST), new_meta, exp.Nil()).compile(),
+				aerospike.EXP_WRITE_ALLOW_DELETE),
+			expr_ops.expression_write(bin,
+				exp.Cond(needs_udf, exp.Unknown(), ttl_ok, new_bin, exp.Unknown()).compile(),
+				aerospike.EXP_WRITE_DEFAULT)
+		]
+		# Only update, so the bin_ttl is never written to a record whose TTL is yet unknown
+		update_policy = dict(policy or {})
+		update_policy['exists'] = aerospike.POLICY_EXISTS_UPDATE
+		# Without an explicit ttl the record keeps the TTL bin_ttl was checked
+		# against, instead of being reset to the namespace default
+		update_meta = dict(meta or {})
+		if ttl == 0:
+			update_meta['ttl'] = aerospike.TTL_DONT_UPDATE
+		try:
+			self.client.operate(key, ops, update_meta, update_policy)
+		except ex.OpNotApplicable:
+			# Nothing was written. Either bin_ttl doesn't fit, which the UDF
+			# reports again, or the UDF has to write the bin.
+			return self._put_exp_udf(policy, key, bin, val, bin_ttl, update_meta)
+		except ex.RecordNotFound:
+			return self._put_exp_udf(policy, key, bin, val, bin_ttl, meta)
+		return 0
+
+	def _put_exp_udf(self, policy, key, bin, val, bin_ttl, meta):
+		# The put UDF checks bin_ttl against the TTL of the record, removes a
+		# record it created again if it doesn't fit, and writes the expiry
+		# summary and bucket.
+		apply_policy = dict(policy or {})
+		apply_policy.pop('exists', None)
+		if meta and 'ttl' in meta:
+			apply_policy['ttl'] = meta['ttl']
+		return 0 if self.client.apply(key, MODULE_NAME, PUT_OP, [bin, val, bin_ttl], apply_policy) == 0 else 1
+
 	def puts(self, policy, key, *binMaps):
 		"""Batch create or update expire bins for a given key. Use the dict
 			{'bin' : bin_name, 'val' : bin_value, 'bin_ttl' : ttl}
@@ -97,6 +425,35 @@ class ExpireBin:
 		"""
 		return self.client.apply(key, MODULE_NAME, BATCH_PUT_OP, list(binMaps), policy)
 
+	def put_many(self, policy, writes):
+		"""Create or update expire bins of many records, with a single batch
+		call that sends one request per server node. Each record is written
+		like puts.
+
+		Args:
+			policy -- batch policy to use for op
+			writes -- list of tuples (key, binMaps), where binMaps is a list of
+				dicts {'bin' : bin_name, 'val' : bin_val, 'bin_ttl' : ttl}
+
+		Returns:
+			list: One tuple (key, status, rv) per write, in the same order as
+			writes. On success, status is AEROSPIKE_OK and rv is the return
+			value of puts. Other errors are reported in the status of their key.
+
+		Raises:
+			Exception: Exception with details of server error.
+		"""
+		batch = batch_records.BatchRecords([batch_records.Apply(key, MODULE_NAME, BATCH_PUT_OP, list(binMaps))
+			for key, binMaps in writes])
+		batch = self.client.batch_write(batch, policy)
+		results = []
+		for br in batch.batch_records:
+			rv = None
+			if br.result == AEROSPIKE_OK and br.record:
+				rv = br.record[2].get("SUCCESS")
+			results.append((br.key, br.result, rv))
+		return results
+
 	def touch(self, policy, key, *mapBins):
 		"""Batch update the bin TTLs. Us this method to change or reset the bin TTL of
 		multiple bins in a record. Use a dict to store each touch operation.
@@ -114,21 +471,255 @@ class ExpireBin:
 		"""
 		return self.client.apply(key, MODULE_NAME, TOUCH_OP, list(mapBins), policy)
 
-	def clean(self, policy, scan, *bins):
-		"""Clear out the expired bins on a scan of the database
+	def touch_bins(self, policy, key, *mapBins):
+		"""Batch update the bin TTLs and report the outcome of each bin. Unlike
+		touch, valid bins are updated even if others are rejected. All changes
+		are written to the record once.
 
 		Args:
 			policy -- policy to use for op
+			key -- tuple (namespace, set, record name)
+			*mapBins -- dict {'bin' : bin_name, 'bin_ttl' : ttl}
+
+		Returns:
+			dict: bin name mapped to TOUCH_UPDATED, TOUCH_INVALID_TTL or TOUCH_NOT_EXPBIN
+
+		Raises:
+			Exception: Exception with details of server error.
+		"""
+		rv = self.client.apply(key, MODULE_NAME, TOUCH_BINS_OP, list(mapBins), policy)
+		if not type(rv) == dict:
+			raise Exception("Touch operation failed, record does not exist")
+		return rv
+
+	def clean(self, policy, scan, *bins, progress=None, poll_interval=0.5):
+		"""Clear out the expired bins and elements on a scan of the database. The clean
+		UDF runs as a background scan, on every node in parallel, and only
+		on the records whose expbin_meta summary says a bin may have
+		expired. Waits for the scan to complete.
+
+		Args:
+			policy -- write policy to use for the scan
 			scan -- Scan object to run bin clean on
+			*bins -- bin names to clean out, none for every expire bin
+			progress -- callable called with the job info dict {'status',
+				'progress_pct', 'records_read'} every poll_interval seconds
+			poll_interval -- seconds between two progress checks
+
+		Returns:
+			dict: job info of the completed scan
+
+		Raises:
+			Exception: Exception with details of server error.
+		"""
+		job_id = self._clean_start(policy, scan, bins)
+		while True:
+			info = self.client.job_info(job_id, aerospike.JOB_SCAN)
+			if progress:
+				progress(info)
+			if info['status'] == aerospike.JOB_STATUS_COMPLETED:
+				return info
+			time.sleep(poll_interval)
+
+	def _clean_start(self, policy, scan, bins):
+		"""Start the background clean scan of clean and return its job id"""
+		if bins:
+			scan.apply(MODULE_NAME, CLEAN_OP, list(bins))
+		else:
+			scan.apply(MODULE_NAME, CLEAN_ALL_OP, [])
+		scan_pol = dict(policy or {})
+		if 'expressions' not in scan_pol:
+			scan_pol['expressions'] = _is_clean_due().compile()
+		return scan.execute_background(scan_pol)
+
+	def create_due_index(self, policy, namespace, set):
+		"""Create the secondary index used by clean_due. The expiry bucket
+		it indexes is only kept if DUE_BUCKET is set in expire_bin.lua.
+
+		Args:
+			policy -- policy to use for op
+			namespace -- namespace to index
+			set -- set to index, or None for the whole namespace
+
+		Raises:
+			Exception: Exception with details of server error.
+		"""
+		self.client.index_integer_create(namespace, set, EXP_DUE, DUE_INDEX, policy)
+
+	def clean_due(self, policy, namespace, set, before_time, *bins):
+		"""Clear out the expired bins of the records whose expiry bucket is
+		at or before before_time, found through the index created by
+		create_due_index instead of a full scan, and wait for the background
+		query to complete. Records without a bucket, written before
+		DUE_BUCKET was set or by put_exp on a record without expbin_meta,
+		are only cleaned by a full scan.
+
+		Args:
+			policy -- write policy to use for op
+			namespace -- namespace to clean
+			set -- set to clean, or None for the whole namespace
+			before_time -- Unix time in seconds, usually time.time()
+			*bins -- bin names to clean out, none for every expire bin
+
+		Raises:
+			Exception: Exception with details of server error.
+		"""
+		query = self.client.query(namespace, set)
+		query.where(p.between(EXP_DUE, 1, int(before_time) - CITRUSLEAF_EPOCH))
+		if bins:
+			query.apply(MODULE_NAME, CLEAN_OP, list(bins))
+		else:
+			query.apply(MODULE_NAME, CLEAN_ALL_OP, [])
+		job_id = query.execute_background(policy)
+		while self.client.job_info(job_id, aerospike.JOB_QUERY)['status'] != aerospike.JOB_STATUS_COMPLETED:
+			time.sleep(0.5)
+
+	def clean_partitions(self, policy, namespace, set, bins=None, threads=1,
+			records_per_second=0, checkpoint=None, progress=None, scan_policy=None):
+		"""Clear out the expired bins partition by partition. Each partition
+		is scanned for the keys of records that may hold expired bins, going
+		by their expbin_meta summary, and those records are cleaned one by one.
+		Partitions are shared out to a pool of worker threads and the number
+		of records cleaned per second can be capped by the server's scan
+		throttle. A record whose clean fails is counted as failed and
+		skipped; only a failed partition scan stops the run. With a
+		checkpoint file, finished partitions are appended to it and skipped
+		by a later run, so a run that failed or was killed resumes where it
+		stopped. The file is removed once every partition is done, so the
+		next run starts over.
+
+		Args:
+			policy -- policy to use for cleaning each record
+			namespace -- namespace to clean
+			set -- set to clean, or None for the whole namespace
+			bins -- list of bin names to clean out, or None for every expire bin
+			threads -- number of worker threads
+			records_per_second -- maximum records cleaned per second, 0 for no limit
+			checkpoint -- path of the checkpoint file, or None
+			progress -- callable called with a dict {'partitions_done',
+				'partitions_total', 'records', 'bins_removed', 'failed'} after
+				each partition, from the worker that cleaned it
+			scan_policy -- policy to use for the partition scans
+
+		Returns:
+			dict: progress at the end of the run, as passed to progress
+
+		Raises:
+			Exception: Exception with details of the first scan error.
+		"""
+		done = _load_checkpoint(checkpoint)
+		pending = [p for p in range(PARTITIONS) if p not in done]
+		lock = threading.Lock()
+		state = {'partitions_done' : PARTITIONS - len(pending), 'partitions_total' : PARTITIONS,
+			'records' : 0, 'bins_removed' : 0, 'failed' : 0}
+		errors = []
+		out = None
+		if checkpoint:
+			out = open(checkpoint, "a")
+			# End a line cut short by a crash before appending to it.
+			if out.tell() > 0:
+				with open(checkpoint, "rb") as f:
+					f.seek(-1, os.SEEK_END)
+					if f.read(1) != b"\n":
+						out.write("\n")
+		op = CLEAN_OP if bins else CLEAN_ALL_OP
+		args = list(bins) if bins else []
+
+		def clean_key(record):
+			if errors:
+				return False
+			try:
+				removed = self.client.apply(record[0], MODULE_NAME, op, args, policy)
+			except ex.RecordNotFound:
+				# The record was removed since the scan saw it.
+				return True
+			except Exception:
+				# Any other failure, such as a timeout, only skips the record.
+				with lock:
+					state['failed'] += 1
+				return True
+			with lock:
+				state['records'] += 1
+				state['bins_removed'] += removed or 0
+			return True
+
+		def worker():
+			while True:
+				with lock:
+					if errors or not pending:
+						return
+					partition = pending.pop(0)
+				scan_pol = dict(scan_policy or {})
+				scan_pol['partition_filter'] = {'begin' : partition, 'count' : 1}
+				scan_pol['expressions'] = _is_clean_due().compile()
+				# A partition is on a single node, so splitting the cap over
+				# the workers caps the whole run.
+				if records_per_second > 0:
+					scan_pol['records_per_second'] = max(1, records_per_second // threads)
+				try:
+					self.client.scan(namespace, set).foreach(clean_key, scan_pol, {'nobins' : True})
+				except Exception as e:
+					with lock:
+						errors.append(e)
+					return
+				with lock:
+					if errors:
+						return
+					if out:
+						out.write("%d\n" % partition)
+						out.flush()
+					state['partitions_done'] += 1
+					if progress:
+						progress(dict(state))
+
+		workers = [threading.Thread(target=worker) for _ in range(max(threads, 1))]
+		try:
+			for w in workers:
+				w.start()
+			for w in workers:
+				w.join()
+		finally:
+			if out:
+				out.close()
+		if errors:
+			raise errors[0]
+		# Start the next run over once every partition is done.
+		if checkpoint and state['partitions_done'] == PARTITIONS:
+			os.remove(checkpoint)
+		return dict(state)
+
+	def clean_record(self, policy, key, *bins):
+		"""Clear out the expired bins of a single record. The record is only
+		rewritten if a bin was removed.
+
+		Args:
+			policy -- policy to use for op
+			key -- tuple (namespace, set, record name)
 			*bins -- bin names to clean out
 
+		Returns:
+			int: number of bins removed, None if the record does not exist
+
 		Raises:
 			Exception: Exception with details of server error.
 		"""
-		raise NotImplementedError("Scan UDF not yet implemented in python client")
-		#def callback((key, meta, record)):
-		#	self.client.apply(key, MODULE_NAME, "does_not_exist", list(bins), self.policy)
-		#scan.foreach(callback)
+		return self.client.apply(key, MODULE_NAME, CLEAN_OP, list(bins), policy)
+
+	def clean_all_record(self, policy, key):
+		"""Clear out every expired bin of a single record, without naming
+		the bins. The record is only rewritten if a bin was removed.
+
+		Args:
+			policy -- policy to use for op
+			key -- tuple (namespace, set, record name)
+
+		Returns:
+			int: number of bins removed, None if the record does not exist
+
+		Raises:
+			Exception: Exception with details of server error.
+		"""
+		return self.client.apply(key, MODULE_NAME, CLEAN_ALL_OP, [], policy)
 
 	def ttl(self, policy, key, bin):
 		"""Get the time bin will expire in seconds.
@@ -146,71 +737,327 @@ class ExpireBin:
 		"""
 		return self.client.apply(key, MODULE_NAME, TTL_OP, [bin], policy)
 
+	def put_elem(self, policy, key, bin, elem_key, val, elem_ttl):
+		"""Store an element with its own expiration in an element bin,
+		replacing the element with the same key. Elements are kept ordered
+		by expiry, and the expired ones are dropped on the way.
+
+		Args:
+			policy -- policy to use for op
+			key -- tuple (namespace, set, record name)
+			bin -- element bin name, created if it does not exist
+			elem_key -- element key, an int or str
+			val -- element value, not None
+			elem_ttl -- expiration time of the element in seconds or -1 for no expiration
+
+		Returns:
+			int: 0 if success, 1 if error or the bin is not an element bin
+
+		Raises:
+			Exception: Exception with details of server error.
+		"""
+		return self.client.apply(key, MODULE_NAME, PUT_ELEM_OP, [bin, elem_key, val, elem_ttl], policy)
+
+	def get_elems(self, policy, key, bin):
+		"""Get the elements of an element bin that haven't expired.
+
+		Args:
+			policy -- policy to use for op
+			key -- tuple (namespace, set, record name)
+			bin -- element bin name
+
+		Returns:
+			dict: element key mapped to value, empty if the bin does not
+			exist or is not an element bin
+
+		Raises:
+			Exception: Exception with details of server error.
+		"""
+		rv = self.client.apply(key, MODULE_NAME, GET_ELEMS_OP, [bin], policy)
+		if not type(rv) == dict:
+			raise Exception("Get elements operation failed, record does not exist")
+		return rv
+
+	def trim(self, policy, key, *bins):
+		"""Drop the expired elements of element bins. Bins left with no
+		element are removed. The record is only rewritten if an element
+		was dropped.
+
+		Args:
+			policy -- policy to use for op
+			key -- tuple (namespace, set, record name)
+			*bins -- element bin names
+
+		Returns:
+			int: number of elements dropped, None if the record does not exist
+
+		Raises:
+			Exception: Exception with details of server error.
+		"""
+		return self.client.apply(key, MODULE_NAME, TRIM_OP, list(bins), policy)
+
+class ExpireBinAsync:
+	"""asyncio interface to an ExpireBin. The client calls block, so they
+	run on a pool of threads, and the client releases the GIL while it
+	waits on the network. At most max_in_flight calls run at once; calls
+	made beyond that wait in the pool's queue. For large numbers of writes,
+	put_all keeps the queue bounded as well.
+	"""
+	def __init__(self, eb, max_in_flight=64, executor=None):
+		"""Initialize the asyncio interface
+
+		Args:
+			eb -- ExpireBin to run the calls on
+			max_in_flight -- maximum number of calls running at once
+			executor -- executor to run the calls on, instead of a pool of
+				max_in_flight threads
+		"""
+
+		self.eb = eb
+		self.max_in_flight = max_in_flight
+		self.executor = executor or ThreadPoolExecutor(max_workers=max_in_flight)
+
+	def _run(self, fn, *args, **kwargs):
+		return asyncio.get_running_loop().run_in_executor(self.executor, functools.partial(fn, *args, **kwargs))
+
+	async def get(self, policy, key, *bins):
+		"""Same as ExpireBin.get"""
+		return await self._run(self.eb.get, policy, key, *bins)
+
+	async def get_repair(self, policy, key, repair_interval, *bins):
+		"""Same as ExpireBin.get_repair"""
+		return await self._run(self.eb.get_repair, policy, key, repair_interval, *bins)
+
+	async def get_exp(self, policy, key, *bins):
+		"""Same as ExpireBin.get_exp"""
+		return await self._run(self.eb.get_exp, policy, key, *bins)
+
+	async def get_many(self, policy, keys, *bins):
+		"""Same as ExpireBin.get_many"""
+		return await self._run(self.eb.get_many, policy, keys, *bins)
+
+	async def put(self, policy, key, bin, val, bin_ttl):
+		"""Same as ExpireBin.put"""
+		return await self._run(self.eb.put, policy, key, bin, val, bin_ttl)
+
+	async def put_exp(self, policy, key, bin, val, bin_ttl, meta=None):
+		"""Same as ExpireBin.put_exp"""
+		return await self._run(self.eb.put_exp, policy, key, bin, val, bin_ttl, meta)
+
+	async def puts(self, policy, key, *binMaps):
+		"""Same as ExpireBin.puts"""
+		return await self._run(self.eb.puts, policy, key, *binMaps)
+
+	async def put_many(self, policy, writes):
+		"""Same as ExpireBin.put_many"""
+		return await self._run(self.eb.put_many, policy, writes)
+
+	async def touch(self, policy, key, *mapBins):
+		"""Same as ExpireBin.touch"""
+		return await self._run(self.eb.touch, policy, key, *mapBins)
+
+	async def touch_bins(self, policy, key, *mapBins):
+		"""Same as ExpireBin.touch_bins"""
+		return await self._run(self.eb.touch_bins, policy, key, *mapBins)
+
+	async def ttl(self, policy, key, bin):
+		"""Same as ExpireBin.ttl"""
+		return await self._run(self.eb.ttl, policy, key, bin)
+
+	async def clean_record(self, policy, key, *bins):
+		"""Same as ExpireBin.clean_record"""
+		return await self._run(self.eb.clean_record, policy, key, *bins)
+
+	async def put_elem(self, policy, key, bin, elem_key, val, elem_ttl):
+		"""Same as ExpireBin.put_elem"""
+		return await self._run(self.eb.put_elem, policy, key, bin, elem_key, val, elem_ttl)
+
+	async def get_elems(self, policy, key, bin):
+		"""Same as ExpireBin.get_elems"""
+		return await self._run(self.eb.get_elems, policy, key, bin)
+
+	async def trim(self, policy, key, *bins):
+		"""Same as ExpireBin.trim"""
+		return await self._run(self.eb.trim, policy, key, *bins)
+
+	async def put_all(self, policy, writes, batch_size=100):
+		"""Write a stream of records, e.g. a generator, in batches of
+		batch_size records sent with put_many. At most max_in_flight batches
+		are sent at once, and writes are only read from the stream as
+		batches complete, so memory stays bounded however long the stream.
+		A failed batch doesn't stop the others.
+
+		Args:
+			policy -- batch policy to use for op
+			writes -- iterable of tuples (key, binMaps), as taken by put_many
+			batch_size -- number of records per batch
+
+		Returns:
+			dict: {'succeeded', 'rejected', 'failed', 'first_error'}, where
+			rejected counts the records puts returned 1 for, failed counts
+			the records that got an error status or were in a batch that
+			raised, and first_error is the first exception raised or None
+		"""
+		result = {'succeeded' : 0, 'rejected' : 0, 'failed' : 0, 'first_error' : None}
+		writes = iter(writes)
+		running = {}
+
+		def count(task, size):
+			try:
+				rows = task.result()
+			except Exception as e:
+				result['failed'] += size
+				if result['first_error'] is None:
+					result['first_error'] = e
+				return
+			for _, status, rv in rows:
+				if status != AEROSPIKE_OK:
+					result['failed'] += 1
+				elif rv:
+					result['rejected'] += 1
+				else:
+					result['succeeded'] += 1
+
+		while True:
+			batch = list(itertools.islice(writes, batch_size))
+			if batch:
+				running[asyncio.ensure_future(self.put_many(policy, batch))] = len(batch)
+			if running and (len(running) >= self.max_in_flight or not batch):
+				done, _ = await asyncio.wait(running, return_when=asyncio.FIRST_COMPLETED)
+				for task in done:
+					count(task, running.pop(task))
+			if not batch and not running:
+				return result
+
+	async def clean(self, policy, scan, *bins, progress=None, poll_interval=0.5):
+		"""Same as ExpireBin.clean, polling the scan without holding a
+		thread. progress is called on the event loop."""
+		job_id = await self._run(self.eb._clean_start, policy, scan, bins)
+		while True:
+			info = await self._run(self.eb.client.job_info, job_id, aerospike.JOB_SCAN)
+			if progress:
+				progress(info)
+			if info['status'] == aerospike.JOB_STATUS_COMPLETED:
+				return info
+			await asyncio.sleep(poll_interval)
+
+async def async_example(aeb, policy):
+	writes = ((("test", "expireBin", "async{0}".format(i)), [{'bin' : "AsyncBin", 'val' : i, 'bin_ttl' : 30}])
+		for i in range(10000))
+	result = await aeb.put_all(None, writes)
+	print("{succeeded} succeeded, {rejected} rejected, {failed} failed".format(**result))
+
+	print("Getting three of them concurrently...")
+
+	keys = [("test", "expireBin", "async{0}".format(i)) for i in range(3)]
+	print(await asyncio.gather(*[aeb.get(policy, k, "AsyncBin") for k in keys]))
+
 def main():
 	config = { 'hosts' : [ ('127.0.0.1', 3000) ]}
 	policy = { "timeout" : 2000 }
 	testClient = aerospike.client(config).connect()
 	try:
-		print "Registering UDF..."
+		print("Registering UDF...")
 		filename = "../../expire_bin.lua"
 		udf_type = 0
 		testClient.udf_put(policy, filename, udf_type)
-		print "UDF Registered!"
+		print("UDF Registered!")
 	except Exception as e:
-		print "Error registering lua function: {0}".format(e)
+		print("Error registering lua function: {0}".format(e))
 
 	eb = ExpireBin(testClient)
 	key = ("test", "expireBin", "eb")
 
-	print "Creating expire bins..."
+	print("Creating expire bins...")
 
-	print "TestBin 1: {0}".format("Inserted!" if eb.put(policy, key, "TestBin1", "Hello World", -1) is 0 else "Insertion Failed")
-	print "TestBin 2: {0}".format("Inserted!" if eb.put(policy, key, "TestBin2", "I don't expire", -1) is 0 else "Insertion Failed")
-	print "TestBin 3: {0}".format("Inserted!" if eb.put(policy, key, "TestBin3", "I will expire soon", 5 ) is 0 else "Insertion Failed")
-	print "TestBin 4 & 5: {0}".format("Inserted!" if eb.puts(policy, key, {'bin' : "TestBin4", 'val' : "Good Morning.", 'bin_ttl' : 100}, {'bin' : "TestBin5", 'val' : "Good Night."})  is 0 else "Insertion Failed")
+	print("TestBin 1: {0}".format("Inserted!" if eb.put(policy, key, "TestBin1", "Hello World", -1) == 0 else "Insertion Failed"))
+	print("TestBin 2: {0}".format("Inserted!" if eb.put(policy, key, "TestBin2", "I don't expire", -1) == 0 else "Insertion Failed"))
+	print("TestBin 3: {0}".format("Inserted!" if eb.put(policy, key, "TestBin3", "I will expire soon", 5 ) == 0 else "Insertion Failed"))
+	print("TestBin 6: {0}".format("Inserted!" if eb.put_exp(policy, key, "TestBin6", "Written without the UDF", 5) == 0 else "Insertion Failed"))
+	print("TestBin 4 & 5: {0}".format("Inserted!" if eb.puts(policy, key, {'bin' : "TestBin4", 'val' : "Good Morning.", 'bin_ttl' : 100}, {'bin' : "TestBin5", 'val' : "Good Night."})  == 0 else "Insertion Failed"))
 
 
-	print "Getting expire bins..."
+	print("Getting expire bins...")
 
-	print "TestBins: {0}".format(eb.get(policy, key, "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5"))
+	print("TestBins: {0}".format(eb.get(policy, key, "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5")))
 
-	print "Current time is: {0}\nGetting bin TTLs...".format(time.time() - CITRUSLEAF_EPOCH)
-	print "TestBin 1 TTL: {0}".format(eb.ttl(policy, key, "TestBin1"))
-	print "TestBin 2 TTL: {0}".format(eb.ttl(policy, key, "TestBin2"))
-	print "TestBin 3 TTL: {0}".format(eb.ttl(policy, key, "TestBin3"))
-	print "TestBin 4 TTL: {0}".format(eb.ttl(policy, key, "TestBin4"))
-	print "TestBin 5 TTL: {0}".format(eb.ttl(policy, key, "TestBin5"))
+	print("Current time is: {0}\nGetting bin TTLs...".format(time.time() - CITRUSLEAF_EPOCH))
+	print("TestBin 1 TTL: {0}".format(eb.ttl(policy, key, "TestBin1")))
+	print("TestBin 2 TTL: {0}".format(eb.ttl(policy, key, "TestBin2")))
+	print("TestBin 3 TTL: {0}".format(eb.ttl(policy, key, "TestBin3")))
+	print("TestBin 4 TTL: {0}".format(eb.ttl(policy, key, "TestBin4")))
+	print("TestBin 5 TTL: {0}".format(eb.ttl(policy, key, "TestBin5")))
 
 
-	print "Waiting for TestBin 3 to expire..."
+	print("Waiting for TestBin 3 to expire...")
 
 	time.sleep(10)
 
-	print "Getting expire bins again..."
+	print("Getting expire bins again...")
+
+	print("TestBins: {0}".format(eb.get(policy, key, "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5")))
+
+	print("Getting expire bins again, removing the expired ones...")
+
+	print("TestBins: {0}".format(eb.get_repair(policy, key, 60, "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5")))
+
+	print("Getting expire bins without the UDF...")
 
-	print "TestBins: {0}".format(eb.get(policy, key, "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5"))
+	print("TestBins: {0}".format(eb.get_exp(policy, key, "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5")))
 
-	print "Changing expiration times..."
+	print("Getting expire bins of two records in a batch...")
+
+	for rec_key, status, bins in eb.get_many(policy, [key, ("test", "expireBin", "missingKey")], "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5"):
+		print("{0}: {1}".format(rec_key[2], bins if status == AEROSPIKE_OK else "status {0}".format(status)))
+
+	print("Changing expiration times...")
 
 	eb.touch(policy, key, {'bin' : "TestBin1", 'bin_ttl' : 10}, {'bin' : "TestBin4", 'bin_ttl' : 5});
 
-	print "Getting bin TTLs again..."
+	print("Getting bin TTLs again...")
+
+	print("TestBin 1 TTL: {0}".format(eb.ttl(policy, key, "TestBin1")))
+	print("TestBin 2 TTL: {0}".format(eb.ttl(policy, key, "TestBin2")))
+	print("TestBin 3 TTL: {0}".format(eb.ttl(policy, key, "TestBin3")))
+	print("TestBin 4 TTL: {0}".format(eb.ttl(policy, key, "TestBin4")))
+	print("TestBin 5 TTL: {0}".format(eb.ttl(policy, key, "TestBin5")))
+
+
+	print("Inserting elements into ElemBin...")
+
+	eb.put_elem(policy, key, "ElemBin", "short", 1, 2)
+	eb.put_elem(policy, key, "ElemBin", "long", 2, 60)
+	eb.put_elem(policy, key, "ElemBin", "forever", 3, -1)
+	print("Elements: {0}".format(eb.get_elems(policy, key, "ElemBin")))
+
+	print("Waiting for the short element to expire...")
 
-	print "TestBin 1 TTL: {0}".format(eb.ttl(policy, key, "TestBin1"))
-	print "TestBin 2 TTL: {0}".format(eb.ttl(policy, key, "TestBin2"))
-	print "TestBin 3 TTL: {0}".format(eb.ttl(policy, key, "TestBin3"))
-	print "TestBin 4 TTL: {0}".format(eb.ttl(policy, key, "TestBin4"))
-	print "TestBin 5 TTL: {0}".format(eb.ttl(policy, key, "TestBin5"))
+	time.sleep(3)
 
+	print("Elements: {0}".format(eb.get_elems(policy, key, "ElemBin")))
+	print("Elements dropped: {0}".format(eb.trim(policy, key, "ElemBin")))
 
-	# scan udf not yet implemented in python client
-	print "Cleaning bins..."
+	print("Cleaning bins...")
+
+	def log_scan(info):
+		print("{progress_pct}% done, {records_read} records read".format(**info))
 
 	testScan = testClient.scan("test", "expireBin")
-	try:
-		eb.clean(policy, testScan, "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5")
-	except NotImplementedError as e:
-		print "Scan UDF not implemented in current version of python client."
+	eb.clean(policy, testScan, "TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5", progress=log_scan)
+
+	print("Cleaning bins partition by partition, 4 workers at up to 1000 records per second...")
+
+	def log_progress(progress):
+		if progress['partitions_done'] % 1024 == 0:
+			print("{partitions_done}/{partitions_total} partitions, {records} records, {bins_removed} bins removed".format(**progress))
+
+	result = eb.clean_partitions(policy, "test", "expireBin", ["TestBin1", "TestBin2", "TestBin3", "TestBin4", "TestBin5"],
+		threads=4, records_per_second=1000, progress=log_progress)
+	print("Partition clean completed, {0} bins removed.".format(result['bins_removed']))
+
+	print("Writing 10000 records asynchronously, in batches of 100...")
+
+	asyncio.run(async_example(ExpireBinAsync(eb, max_in_flight=16), policy))
 
 	testClient.close()
 if __name__ == "__main__":